@@ -28,13 +28,21 @@ SOURCES += \
     ../src/ForestDecor.cpp \
     ../src/Flower.cpp \
     ../src/Log.cpp \
+    ../src/InputRecording.cpp \
+    ../src/Benchmarks.cpp \
+    ../src/SystemProfiler.cpp \
+    ../src/StageTimer.cpp \
+    ../src/TraceZones.cpp \
+    ../src/RecordingGraphics.cpp \
     \ # maps
     ../src/maps/Maps.cpp \
     ../src/maps/MapObjectLoader.cpp \
     ../src/maps/LineMapLoader.cpp \
+    ../src/maps/LineMapCache.cpp \
     ../src/maps/SurfaceRef.cpp \
     ../src/maps/MapLinks.cpp \
     ../src/maps/MapMultiplexer.cpp \
+    ../src/maps/MapTileIndex.cpp \
     \ # components
     ../src/components/ComponentsMisc.cpp \
     ../src/components/Platform.cpp \
@@ -48,6 +56,10 @@ SOURCES += \
     ../src/systems/LineTrackerPhysics.cpp \
     ../src/systems/EnvironmentCollisionSystem.cpp \
     ../src/systems/FreeBodyPhysics.cpp \
+    ../src/systems/PlatformBroadphase.cpp \
+    ../src/systems/SegmentBatch.cpp \
+    ../src/systems/SystemScheduler.cpp \
+    ../src/systems/EntityQuery.cpp \
     ../src/systems/DrawSystems.cpp
 
 #SOURCES += \
@@ -63,6 +75,7 @@ SOURCES += \
 
 HEADERS += \
     ../src/GridRange.hpp \
+    ../src/ChunkedGrid.hpp \
     ../src/Defs.hpp \
     ../src/Systems.hpp \
     ../src/GameDriver.hpp \
@@ -77,13 +90,21 @@ HEADERS += \
     ../src/ForestDecor.hpp \
     ../src/Flower.hpp \
     ../src/Log.hpp \
+    ../src/InputRecording.hpp \
+    ../src/Benchmarks.hpp \
+    ../src/SystemProfiler.hpp \
+    ../src/StageTimer.hpp \
+    ../src/TraceZones.hpp \
+    ../src/RecordingGraphics.hpp \
     \ # maps
     ../src/maps/Maps.hpp \
     ../src/maps/MapObjectLoader.hpp \
     ../src/maps/LineMapLoader.hpp \
+    ../src/maps/LineMapCache.hpp \
     ../src/maps/SurfaceRef.hpp \
     ../src/maps/MapLinks.hpp \
     ../src/maps/MapMultiplexer.hpp \
+    ../src/maps/MapTileIndex.hpp \
     \ # components
     ../src/components/ComponentsComplete.hpp \
     ../src/components/DisplayFrame.hpp \
@@ -94,6 +115,10 @@ HEADERS += \
     ../src/components/PltfTargets.hpp \
     \ # systems
     ../src/systems/FreeBodyPhysics.hpp \
+    ../src/systems/PlatformBroadphase.hpp \
+    ../src/systems/SegmentBatch.hpp \
+    ../src/systems/SystemScheduler.hpp \
+    ../src/systems/EntityQuery.hpp \
     ../src/systems/SystemsComplete.hpp \
     ../src/systems/EnvironmentCollisionSystem.hpp \
     ../src/systems/LineTrackerPhysics.hpp \
@@ -0,0 +1,560 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "Benchmarks.hpp"
+#include "Components.hpp"
+#include "GameDriver.hpp"
+#include "StageTimer.hpp"
+
+#include "maps/Maps.hpp"
+#include "maps/LineMapLoader.hpp"
+#include "systems/EnvironmentCollisionSystem.hpp"
+#include "systems/FreeBodyPhysics.hpp"
+#include "systems/LineTrackerPhysics.hpp"
+
+#include <SFML/Graphics/View.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+#include <cassert>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using InvArg = std::invalid_argument;
+
+constexpr const double k_tile_size  = 16.;
+constexpr const double k_frame_time = 1. / 60.;
+
+constexpr const int k_entity_counts[] = { 100, 500, 1000, 2500, 5000, 10000, 25000, 50000 };
+// items are spawned on a grid above the player, this many columns wide
+constexpr const int k_spawn_columns = 128;
+constexpr const double k_spawn_spacing = 8.;
+// lets spawned items fall and start colliding before timing
+constexpr const int k_warmup_frames = 30;
+
+// builds a line map from world space polylines, each segment is placed into
+// the tile its midpoint falls in, so segments should be short compared to
+// tiles
+class SyntheticMapBuilder final {
+public:
+    struct SegmentPlace {
+        VectorI tile;
+        int segment_number = 0;
+    };
+
+    void add_polyline(const std::vector<VectorD> &, bool closed);
+
+    std::unique_ptr<LineMap> build(int width, int height) const;
+
+    /// @returns where a segment (in the order added) landed on the map
+    SegmentPlace place_of(std::size_t idx) const { return m_places.at(idx); }
+
+    const LineSegment & segment(std::size_t idx) const { return m_segments.at(idx); }
+
+    std::size_t segment_count() const { return m_segments.size(); }
+
+private:
+    static VectorI tile_of(const LineSegment &);
+
+    std::vector<LineSegment> m_segments;
+    std::vector<SegmentPlace> m_places;
+    std::map<std::pair<int, int>, int> m_tile_counts;
+};
+
+struct BodyStart {
+    enum Type { k_freebody, k_tracker_on_map, k_tracker_on_platform };
+    Type type = k_freebody;
+    FreeBody freebody;
+    // tracker things
+    SyntheticMapBuilder::SegmentPlace place;
+    Entity platform;
+    double position = 0.5;
+    double speed    = 0.;
+    bool inverted_normal = false;
+};
+
+struct Scenario {
+    std::string name;
+    std::unique_ptr<LineMap> map;
+    std::vector<Entity> platforms;
+    PlatformBroadphase platform_broadphase;
+    std::vector<BodyStart> starts;
+};
+
+struct BenchResult {
+    int calls    = 0;
+    int failures = 0;
+    double total_ns = 0.;
+    long long total_depth  = 0;
+    int max_depth          = 0;
+    long long total_probes = 0;
+    // calls cut short by the handler call budget
+    int capped = 0;
+};
+
+std::vector<VectorD> make_polyline(VectorD start, VectorD end, int count);
+
+bool normal_faces(const LineSegment &, bool inverted_normal, VectorD dir);
+
+Scenario make_slopes_scenario(EntityManager &);
+
+Scenario make_loop_scenario(EntityManager &);
+
+Scenario make_platform_stack_scenario(EntityManager &);
+
+void reset_body(Entity body, const LineMap &, const BodyStart &);
+
+BenchResult run_case(Entity body, const Scenario &, BodyStart::Type, int repetitions);
+
+void print_result(const std::string & scenario, const char * case_name, const BenchResult &);
+
+std::vector<std::string> find_maps_in_working_directory();
+
+} // end of <anonymous> namespace
+
+void run_physics_benchmark(int repetitions) {
+    if (repetitions < 1) {
+        throw InvArg("run_physics_benchmark: repetitions must be positive.");
+    }
+    EntityManager emanager;
+    std::vector<Scenario> scenarios;
+    scenarios.emplace_back(make_slopes_scenario        (emanager));
+    scenarios.emplace_back(make_loop_scenario          (emanager));
+    scenarios.emplace_back(make_platform_stack_scenario(emanager));
+
+    auto body = emanager.create_new_entity();
+    body.add<PhysicsComponent>();
+
+    std::cout << std::left << std::setw(16) << "scenario" << std::setw(10) << "case"
+              << std::right << std::setw(9) << "calls" << std::setw(12) << "ns/call"
+              << std::setw(11) << "avg depth" << std::setw(11) << "max depth"
+              << std::setw(13) << "probes/call" << std::setw(10) << "failures"
+              << std::setw(8) << "capped" << std::endl;
+    for (const auto & scenario : scenarios) {
+        print_result(scenario.name, "freebody",
+                     run_case(body, scenario, BodyStart::k_freebody, repetitions));
+        auto tracker_type = scenario.platforms.empty()
+            ? BodyStart::k_tracker_on_map : BodyStart::k_tracker_on_platform;
+        print_result(scenario.name, "tracker",
+                     run_case(body, scenario, tracker_type, repetitions));
+    }
+}
+
+void run_map_load_benchmark(std::vector<std::string> map_files, int repetitions) {
+    if (repetitions < 1) {
+        throw InvArg("run_map_load_benchmark: repetitions must be positive.");
+    }
+    if (map_files.empty()) map_files = find_maps_in_working_directory();
+    if (map_files.empty()) {
+        std::cout << "No maps to load (no *.tmx files in the working directory)."
+                  << std::endl;
+        return;
+    }
+
+    StartupOptions opts;
+    for (const auto & map_file : map_files) {
+        opts.test_map = map_file;
+        StageTimings timings;
+        double total_secs = 0.;
+        try {
+            StageTimings::Collecting collecting(timings);
+            for (int i = 0; i != repetitions; ++i) {
+                // teardown (which may wait on tree making threads) is not
+                // part of the measurement
+                GameDriver gdriver;
+                auto beg = Clock::now();
+                gdriver.setup(opts, sf::View());
+                total_secs += std::chrono::duration<double>(Clock::now() - beg).count();
+            }
+        } catch (std::exception & exp) {
+            std::cout << "\"" << map_file << "\" failed to load: "
+                      << exp.what() << std::endl;
+            continue;
+        }
+        std::cout << "\"" << map_file << "\" average of " << repetitions
+                  << " loads: " << std::fixed << std::setprecision(3)
+                  << (total_secs*1000. / double(repetitions)) << " ms"
+                  << std::defaultfloat << "\n";
+        timings.print(std::cout, repetitions);
+        std::cout << std::endl;
+    }
+}
+
+void run_entity_scaling_benchmark(const std::string & map_file, int frames) {
+    if (frames < 1) {
+        throw InvArg("run_entity_scaling_benchmark: frames must be positive.");
+    }
+    StartupOptions opts;
+    opts.test_map        = map_file;
+    opts.profile_systems = true;
+
+    std::cout << "Spawning items on \"" << map_file << "\", timing "
+              << frames << " frames per count.\n"
+              << std::setw(9) << "entities" << std::setw(14) << "ms/frame"
+              << std::setw(14) << "max ms" << std::setw(16) << "ns/entity"
+              << std::endl;
+    std::vector<std::string> system_breakdowns;
+    for (int count : k_entity_counts) {
+        GameDriver gdriver;
+        gdriver.setup_headless(opts);
+        auto origin = gdriver.get_player().get<PhysicsComponent>().location()
+            + VectorD(-k_spawn_columns*k_spawn_spacing*0.5, -100.);
+        for (int i = 0; i != count; ++i) {
+            gdriver.spawn_item_at(origin + VectorD(
+                 double(i % k_spawn_columns)*k_spawn_spacing,
+                -double(i / k_spawn_columns)*k_spawn_spacing));
+        }
+        for (int i = 0; i != k_warmup_frames; ++i) {
+            gdriver.update(k_frame_time);
+        }
+
+        double total_secs = 0., max_secs = 0.;
+        for (int i = 0; i != frames; ++i) {
+            auto beg = Clock::now();
+            gdriver.update(k_frame_time);
+            auto secs = std::chrono::duration<double>(Clock::now() - beg).count();
+            total_secs += secs;
+            max_secs    = std::max(max_secs, secs);
+        }
+        auto avg_secs = total_secs / double(frames);
+        std::cout << std::setw(9) << count << std::fixed << std::setprecision(3)
+                  << std::setw(14) << (avg_secs*1000.)
+                  << std::setw(14) << (max_secs*1000.)
+                  << std::setw(16) << std::setprecision(1)
+                  << (avg_secs*1'000'000'000. / double(count))
+                  << std::defaultfloat << std::endl;
+
+        std::stringstream sstrm;
+        sstrm << "With " << count << " items:\n";
+        if (const auto * profiler = gdriver.system_profiler()) {
+            profiler->print_summary(sstrm);
+        }
+        system_breakdowns.emplace_back(sstrm.str());
+    }
+    std::cout << "\n";
+    for (const auto & breakdown : system_breakdowns) {
+        std::cout << breakdown << "\n";
+    }
+    std::cout << std::flush;
+}
+
+namespace {
+
+void SyntheticMapBuilder::add_polyline(const std::vector<VectorD> & pts, bool closed) {
+    if (pts.size() < 2) {
+        throw InvArg("SyntheticMapBuilder::add_polyline: polyline requires at "
+                     "least two points.");
+    }
+    auto add_segment = [this](VectorD a, VectorD b) {
+        LineSegment seg(a, b);
+        auto tile = tile_of(seg);
+        auto & count = m_tile_counts[std::make_pair(tile.x, tile.y)];
+        m_places.push_back(SegmentPlace { tile, count++ });
+        m_segments.push_back(seg);
+    };
+    for (auto itr = pts.begin() + 1; itr != pts.end(); ++itr) {
+        add_segment(*(itr - 1), *itr);
+    }
+    if (closed) add_segment(pts.back(), pts.front());
+}
+
+std::unique_ptr<LineMap> SyntheticMapBuilder::build(int width, int height) const {
+    LineMapLoader::SegmentsInfo nfo;
+    Grid<int> gids;
+    gids.set_size(width, height, 0);
+    for (std::size_t i = 0; i != m_segments.size(); ++i) {
+        auto tile = m_places[i].tile;
+        if (!gids.has_position(tile)) {
+            throw InvArg("SyntheticMapBuilder::build: segment lies outside of the map.");
+        }
+        // every non-empty tile is unique
+        int gid = tile.x + tile.y*width + 1;
+        gids(tile) = gid;
+        auto offset = VectorD(tile.x*k_tile_size, tile.y*k_tile_size);
+        auto & tile_segs = nfo.segment_map[gid].segments;
+        assert(int(tile_segs.size()) == m_places[i].segment_number);
+        tile_segs.emplace_back(m_segments[i].a - offset, m_segments[i].b - offset);
+        ++nfo.total_segments_count;
+    }
+
+    LineMapLoader::TileSize tsize;
+    tsize.width = tsize.height = k_tile_size;
+    LineMapLoader loader;
+    loader.load_map(nfo, gids, gids, tsize);
+    auto rv = std::make_unique<LineMap>();
+    rv->load_map_from(loader);
+    return rv;
+}
+
+/* private static */ VectorI SyntheticMapBuilder::tile_of(const LineSegment & seg) {
+    auto mid = (seg.a + seg.b)*0.5;
+    return VectorI(int(std::floor(mid.x / k_tile_size)),
+                   int(std::floor(mid.y / k_tile_size)));
+}
+
+// ----------------------------------------------------------------------------
+
+std::vector<VectorD> make_polyline(VectorD start, VectorD end, int count) {
+    std::vector<VectorD> rv;
+    rv.reserve(std::size_t(count) + 1);
+    for (int i = 0; i != count + 1; ++i) {
+        rv.push_back(start + (end - start)*(double(i) / double(count)));
+    }
+    return rv;
+}
+
+bool normal_faces(const LineSegment & seg, bool inverted_normal, VectorD dir)
+    { return dot(normal_for(seg, inverted_normal), dir) > 0.; }
+
+Scenario make_slopes_scenario(EntityManager &) {
+    static constexpr const int k_width  = 120;
+    static constexpr const int k_height = 30;
+    // rolling hills, steepest parts are near 50 degrees
+    std::vector<VectorD> pts;
+    for (double x = 4.; x < k_width*k_tile_size - 4.; x += 8.) {
+        pts.emplace_back(x, k_height*k_tile_size*0.6 + 48.*std::sin(x / 40.));
+    }
+    SyntheticMapBuilder builder;
+    builder.add_polyline(pts, false);
+
+    Scenario rv;
+    rv.name = "slopes";
+    rv.map  = builder.build(k_width, k_height);
+    for (std::size_t i = 8; i < builder.segment_count() - 8; i += 7) {
+        const auto & seg = builder.segment(i);
+        auto above = (seg.a + seg.b)*0.5 + VectorD(0, -40);
+        for (auto vel : { VectorD(0, 2400), VectorD(900, 1800), VectorD(-1200, 1200) }) {
+            BodyStart start;
+            start.freebody.location = above;
+            start.freebody.velocity = vel;
+            rv.starts.push_back(start);
+        }
+        for (auto px_speed : { 300., 900., -1800. }) {
+            BodyStart start;
+            start.type  = BodyStart::k_tracker_on_map;
+            start.place = builder.place_of(i);
+            start.speed = px_speed / segment_length(seg);
+            start.inverted_normal = !normal_faces(seg, false, VectorD(0, -1));
+            rv.starts.push_back(start);
+        }
+    }
+    return rv;
+}
+
+Scenario make_loop_scenario(EntityManager &) {
+    static constexpr const int k_width  = 40;
+    static constexpr const int k_height = 40;
+    static constexpr const double k_radius = 128.;
+    const VectorD center(k_width*k_tile_size*0.5, k_height*k_tile_size*0.5);
+    // segments approximately 8 pixels long
+    const int count = int(std::ceil(2.*k_pi*k_radius / 8.));
+    std::vector<VectorD> pts;
+    for (int i = 0; i != count; ++i) {
+        auto t = 2.*k_pi*double(i) / double(count);
+        pts.push_back(center + VectorD(std::cos(t), std::sin(t))*k_radius);
+    }
+    SyntheticMapBuilder builder;
+    builder.add_polyline(pts, true);
+
+    Scenario rv;
+    rv.name = "loops";
+    rv.map  = builder.build(k_width, k_height);
+    for (std::size_t i = 0; i < builder.segment_count(); i += 5) {
+        const auto & seg = builder.segment(i);
+        auto mid = (seg.a + seg.b)*0.5;
+        auto inward = normalize(center - mid);
+        // free bodies cross the inside of the loop, hitting the far side
+        for (auto speed : { 600., 2400. }) {
+            BodyStart start;
+            start.freebody.location = mid + inward*4.;
+            start.freebody.velocity = inward*speed + VectorD(speed*0.25, 0);
+            rv.starts.push_back(start);
+        }
+        for (auto px_speed : { 900., 1800., -3600. }) {
+            BodyStart start;
+            start.type  = BodyStart::k_tracker_on_map;
+            start.place = builder.place_of(i);
+            start.speed = px_speed / segment_length(seg);
+            start.inverted_normal = !normal_faces(seg, false, inward);
+            rv.starts.push_back(start);
+        }
+    }
+    return rv;
+}
+
+Scenario make_platform_stack_scenario(EntityManager & emanager) {
+    static constexpr const int k_width  = 40;
+    static constexpr const int k_height = 40;
+    static constexpr const int k_platform_count = 8;
+    static constexpr const double k_platform_gap = 24.;
+    const double floor_y = k_height*k_tile_size - 32.;
+    SyntheticMapBuilder builder;
+    builder.add_polyline(make_polyline(VectorD(4., floor_y),
+                                       VectorD(k_width*k_tile_size - 4., floor_y),
+                                       k_width*2 - 1), false);
+
+    Scenario rv;
+    rv.name = "platform-stacks";
+    rv.map  = builder.build(k_width, k_height);
+
+    const double left = k_width*k_tile_size*0.5 - 64.;
+    for (int i = 0; i != k_platform_count; ++i) {
+        // slightly slanted, and alternating
+        auto y = floor_y - k_platform_gap*double(i + 1);
+        auto slant = (i % 2) ? 6. : -6.;
+        auto pts = make_polyline(VectorD(left, y - slant), VectorD(left + 128., y + slant), 8);
+        std::vector<Surface> surfaces;
+        for (auto itr = pts.begin() + 1; itr != pts.end(); ++itr) {
+            surfaces.emplace_back(LineSegment(*(itr - 1), *itr));
+        }
+        auto e = emanager.create_new_entity();
+        e.add<Platform>().set_surfaces(std::move(surfaces));
+        rv.platforms.push_back(e);
+    }
+    rv.platform_broadphase.update(rv.platforms);
+
+    const double top_y = floor_y - k_platform_gap*double(k_platform_count + 2);
+    for (int i = 0; i != 16; ++i) {
+        auto x = left + 4. + 120.*double(i) / 15.;
+        // falling into the top of the stack, and launched through its side
+        for (auto vel : { VectorD(0, 2400), VectorD(300, 1200), VectorD(-600, 1800) }) {
+            BodyStart start;
+            start.freebody.location = VectorD(x, top_y);
+            start.freebody.velocity = vel;
+            rv.starts.push_back(start);
+        }
+        BodyStart start;
+        start.freebody.location = VectorD(left - 24., floor_y - 8. - 10.*double(i));
+        start.freebody.velocity = VectorD(3000, -300);
+        rv.starts.push_back(start);
+    }
+    for (const auto & platform : rv.platforms) {
+        const auto & plat = platform.get<Platform>();
+        for (std::size_t i = 0; i != plat.surface_count(); ++i) {
+            const auto seg = plat.get_surface(i);
+            for (auto px_speed : { 300., 1200., -2400. }) {
+                BodyStart start;
+                start.type     = BodyStart::k_tracker_on_platform;
+                start.platform = platform;
+                start.place.segment_number = int(i);
+                start.speed    = px_speed / segment_length(seg);
+                start.inverted_normal = !normal_faces(seg, false, VectorD(0, -1));
+                rv.starts.push_back(start);
+            }
+        }
+    }
+    return rv;
+}
+
+void reset_body(Entity body, const LineMap & map, const BodyStart & start) {
+    auto & pcomp = body.get<PhysicsComponent>();
+    pcomp.active_layer = Layer::foreground;
+    pcomp.et_debt      = 0.;
+    switch (start.type) {
+    case BodyStart::k_freebody:
+        pcomp.reset_state<FreeBody>() = start.freebody;
+        return;
+    case BodyStart::k_tracker_on_map: case BodyStart::k_tracker_on_platform: {
+        SurfaceRef ref;
+        if (start.type == BodyStart::k_tracker_on_map) {
+            ref.set(map.get_layer(Layer::foreground), start.place.tile, start.place.segment_number);
+        } else {
+            ref.set(start.platform, start.place.segment_number);
+        }
+        auto & tracker = pcomp.reset_state<LineTracker>();
+        tracker.set_surface_ref(ref);
+        tracker.position        = start.position;
+        tracker.speed           = start.speed;
+        tracker.inverted_normal = start.inverted_normal;
+        }
+        return;
+    }
+    throw BadBranchException();
+}
+
+BenchResult run_case
+    (Entity body, const Scenario & scenario, BodyStart::Type type, int repetitions)
+{
+    BenchResult rv;
+    auto & counters = EnvColCounters::instance();
+    for (int rep = 0; rep != repetitions; ++rep) {
+    for (const auto & start : scenario.starts) {
+        if ((start.type == BodyStart::k_freebody) != (type == BodyStart::k_freebody)) continue;
+        reset_body(body, *scenario.map, start);
+
+        auto & pcomp = body.get<PhysicsComponent>();
+        EnvColParams ecp(pcomp, *scenario.map, nullptr, scenario.platform_broadphase);
+        ecp.set_owner(body);
+        counters.reset();
+        auto beg_time = Clock::now();
+        try {
+            if (type == BodyStart::k_freebody) {
+                const auto & fb = pcomp.state_as<FreeBody>();
+                handle_freebody_physics(ecp, fb.location + fb.velocity*k_frame_time);
+            } else {
+                handle_tracker_physhics(ecp, k_frame_time);
+            }
+        } catch (std::exception &) {
+            // physics code isn't bullet proof, but the benchmark should be
+            ++rv.failures;
+        }
+        rv.total_ns += double(std::chrono::duration_cast<std::chrono::nanoseconds>
+            (Clock::now() - beg_time).count());
+        ++rv.calls;
+        rv.total_depth  += counters.max_recursion_depth;
+        rv.max_depth     = std::max(rv.max_depth, counters.max_recursion_depth);
+        rv.total_probes += counters.bisection_probes;
+        rv.capped       += counters.budget_exhaustions;
+    }}
+    return rv;
+}
+
+void print_result(const std::string & scenario, const char * case_name, const BenchResult & res) {
+    auto calls = double(std::max(1, res.calls));
+    std::cout << std::left << std::setw(16) << scenario << std::setw(10) << case_name
+              << std::right << std::setw(9) << res.calls
+              << std::fixed << std::setprecision(1)
+              << std::setw(12) << (res.total_ns / calls)
+              << std::setw(11) << (double(res.total_depth) / calls)
+              << std::setw(11) << res.max_depth
+              << std::setw(13) << (double(res.total_probes) / calls)
+              << std::setw(10) << res.failures
+              << std::setw(8) << res.capped
+              << std::defaultfloat << std::endl;
+}
+
+std::vector<std::string> find_maps_in_working_directory() {
+    namespace fs = std::filesystem;
+    std::vector<std::string> rv;
+    for (const auto & entry : fs::directory_iterator(fs::current_path())) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".tmx")
+            { continue; }
+        rv.push_back(entry.path().filename().string());
+    }
+    std::sort(rv.begin(), rv.end());
+    return rv;
+}
+
+} // end of <anonymous> namespace
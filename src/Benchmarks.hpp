@@ -0,0 +1,44 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// benchmarks are run from command line options, and quit before the game
+// starts
+
+/// runs both free body and line tracker physics handlers directly on
+/// synthetic maps (slopes, loops, platform stacks)
+/// @param repetitions number of times each starting state is run
+void run_physics_benchmark(int repetitions);
+
+/// loads each map through the same setup the game runs, printing a per stage
+/// breakdown of where load time is spent
+/// @param map_files if empty, every *.tmx file in the working directory
+/// @param repetitions number of times each map is loaded
+void run_map_load_benchmark(std::vector<std::string> map_files, int repetitions);
+
+/// spawns increasing numbers of items (as a mouse click would) on a map, and
+/// times frames in headless mode, reporting how per frame cost scales with
+/// entity count, followed by a per system breakdown
+/// @param map_file map to spawn items on
+/// @param frames number of frames timed for each entity count
+void run_entity_scaling_benchmark(const std::string & map_file, int frames);
@@ -0,0 +1,155 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "Defs.hpp"
+
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+/// A grid split into square chunks, where a chunk's storage is only
+/// allocated once something writes into it. Reading from a chunk that was
+/// never written yields the grid's default value.
+///
+/// Memory therefore scales with how much of the grid is occupied, rather
+/// than its area, which matters for very large, mostly empty levels.
+///
+/// Iteration (begin_position/next/end_position) only visits positions of
+/// allocated chunks: chunks are visited in row major order, and positions
+/// within a chunk are also visited in row major order.
+template <typename T>
+class ChunkedGrid final {
+public:
+    static constexpr const int k_chunk_size = 64;
+
+    ChunkedGrid() {}
+
+    int width () const noexcept { return m_width ; }
+
+    int height() const noexcept { return m_height; }
+
+    bool has_position(VectorI r) const noexcept
+        { return r.x >= 0 && r.y >= 0 && r.x < m_width && r.y < m_height; }
+
+    /// all chunks are unallocated afterward
+    void set_size(int width, int height, const T & default_value) {
+        if (width < 0 || height < 0) {
+            throw std::invalid_argument("ChunkedGrid::set_size: width and "
+                                        "height must be non-negative.");
+        }
+        m_width   = width;
+        m_height  = height;
+        m_default = default_value;
+        m_chunks_wide = (width  + k_chunk_size - 1) / k_chunk_size;
+        int chunks_tall = (height + k_chunk_size - 1) / k_chunk_size;
+        m_chunks.clear();
+        m_chunks.resize(std::size_t(m_chunks_wide)*std::size_t(chunks_tall));
+    }
+
+    void clear() {
+        m_chunks.clear();
+        m_width = m_height = m_chunks_wide = 0;
+    }
+
+    /// @returns the default value if the position's chunk is unallocated
+    const T & operator () (VectorI r) const {
+        const auto & chunk = m_chunks[chunk_index_of(r)];
+        if (chunk.empty()) return m_default;
+        return chunk[cell_index_of(r)];
+    }
+
+    /// allocates the position's chunk if need be
+    T & operator () (VectorI r) {
+        auto idx = chunk_index_of(r);
+        allocate_chunk(idx);
+        return m_chunks[idx][cell_index_of(r)];
+    }
+
+    // ------------------------------- chunks ---------------------------------
+
+    /// @returns number of chunks, allocated or not
+    std::size_t chunk_count() const noexcept { return m_chunks.size(); }
+
+    std::size_t allocated_chunk_count() const noexcept {
+        return std::size_t(std::count_if(m_chunks.begin(), m_chunks.end(),
+            [](const std::vector<T> & chunk) { return !chunk.empty(); }));
+    }
+
+    bool is_allocated(std::size_t chunk_index) const
+        { return !m_chunks.at(chunk_index).empty(); }
+
+    void allocate_chunk(std::size_t chunk_index) {
+        auto & chunk = m_chunks.at(chunk_index);
+        if (!chunk.empty()) return;
+        chunk.resize(std::size_t(k_chunk_size*k_chunk_size), m_default);
+    }
+
+    std::size_t chunk_index_of(VectorI r) const {
+        if (!has_position(r)) {
+            throw std::out_of_range("ChunkedGrid::chunk_index_of: position "
+                                    "is not on the grid.");
+        }
+        return std::size_t(r.y / k_chunk_size)*std::size_t(m_chunks_wide)
+               + std::size_t(r.x / k_chunk_size);
+    }
+
+    // ------------------------------ iteration -------------------------------
+
+    VectorI begin_position() const { return first_position_from(0); }
+
+    VectorI end_position() const noexcept { return VectorI(0, m_height); }
+
+    VectorI next(VectorI r) const {
+        VectorI chunk_start(r.x - r.x % k_chunk_size, r.y - r.y % k_chunk_size);
+        int x_end = std::min(chunk_start.x + k_chunk_size, m_width );
+        int y_end = std::min(chunk_start.y + k_chunk_size, m_height);
+        if (r.x + 1 < x_end) return VectorI(r.x + 1, r.y);
+        if (r.y + 1 < y_end) return VectorI(chunk_start.x, r.y + 1);
+        return first_position_from(chunk_index_of(r) + 1);
+    }
+
+    void swap(ChunkedGrid & rhs) {
+        std::swap(m_width      , rhs.m_width      );
+        std::swap(m_height     , rhs.m_height     );
+        std::swap(m_chunks_wide, rhs.m_chunks_wide);
+        std::swap(m_default    , rhs.m_default    );
+        m_chunks.swap(rhs.m_chunks);
+    }
+
+private:
+    std::size_t cell_index_of(VectorI r) const noexcept {
+        return std::size_t(r.y % k_chunk_size)*k_chunk_size
+               + std::size_t(r.x % k_chunk_size);
+    }
+
+    VectorI first_position_from(std::size_t chunk_index) const {
+        for (auto i = chunk_index; i < m_chunks.size(); ++i) {
+            if (m_chunks[i].empty()) continue;
+            return VectorI(int(i % std::size_t(m_chunks_wide))*k_chunk_size,
+                           int(i / std::size_t(m_chunks_wide))*k_chunk_size);
+        }
+        return end_position();
+    }
+
+    int m_width = 0, m_height = 0, m_chunks_wide = 0;
+    T m_default = T();
+    std::vector<std::vector<T>> m_chunks;
+};
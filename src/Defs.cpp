@@ -47,6 +47,19 @@ LineSegment move_segment(const LineSegment & segment, VectorD offset) {
     return rv;
 }
 
+SegmentGeometry compute_geometry(const LineSegment & segment) {
+    SegmentGeometry rv;
+    auto diff = segment.b - segment.a;
+    rv.length = magnitude(diff);
+    if (rv.length == 0.) return rv;
+    rv.inverse_length  = 1. / rv.length;
+    rv.unit_direction  = diff*rv.inverse_length;
+    // same as normal_for
+    rv.normal          = normalize(rotate_vector(diff,  k_pi*0.5));
+    rv.inverted_normal = normalize(rotate_vector(diff, -k_pi*0.5));
+    return rv;
+}
+
 Surface move_surface(const Surface & surface, VectorD offset) {
     auto rv = surface;
     rv.a += offset;
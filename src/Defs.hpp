@@ -62,6 +62,25 @@ extern const VectorD k_gravity        ;
 struct StartupOptions {
     std::string test_map = "test-map.tmx";
     bool quit_before_game = false;
+    // zero frames means a normal windowed run
+    int headless_frames = 0;
+    double headless_step = 1. / 60.;
+    // input recording is saved here on exit (if set)
+    std::string record_file;
+    // replays are always run headless
+    std::string replay_file;
+    // times every system, shown on the hud, and printed on exit
+    bool profile_systems = false;
+    // chrome trace event json is written here on exit (if set)
+    std::string trace_file;
+    // headless only, draw submissions are recorded and summarized on exit
+    bool draw_stats = false;
+    // systems without conflicting accesses update on this many threads,
+    // one (or less) runs them all in order on the main thread
+    int system_threads = 1;
+    // windowed only, passes each frame's time straight to the game driver,
+    // rather than updating in fixed steps
+    bool variable_step = false;
 };
 
 template <typename IterType>
@@ -109,12 +128,36 @@ inline bool operator == (const SurfaceDetails & rhs, const SurfaceDetails & lhs)
 inline bool operator != (const SurfaceDetails & rhs, const SurfaceDetails & lhs)
     { return !are_same(rhs, lhs); }
 
+/// everything about a segment which translation doesn't change, the physics
+/// code asks for these constantly, so surfaces carry them
+struct SegmentGeometry {
+    // a to b
+    VectorD unit_direction;
+    // as normal_for gives, without and with the inverted normal flag
+    VectorD normal;
+    VectorD inverted_normal;
+    double length         = 0.;
+    // zero for degenerate segments
+    double inverse_length = 0.;
+};
+
+SegmentGeometry compute_geometry(const LineSegment &);
+
 struct Surface final : public LineSegment, public SurfaceDetails {
     Surface() {}
-    explicit Surface(const LineSegment & rhs): LineSegment(rhs) {}
+    explicit Surface(const LineSegment & rhs):
+        LineSegment(rhs), geometry(compute_geometry(rhs)) {}
     Surface(const LineSegment & seg_, const SurfaceDetails & dets_):
-        LineSegment(seg_), SurfaceDetails(dets_)
+        LineSegment(seg_), SurfaceDetails(dets_), geometry(compute_geometry(seg_))
     {}
+    /// for segments whose geometry is already known (map layers keep it)
+    Surface(const LineSegment & seg_, const SurfaceDetails & dets_,
+            const SegmentGeometry & geo_):
+        LineSegment(seg_), SurfaceDetails(dets_), geometry(geo_)
+    {}
+
+    // must be recomputed if a or b are changed (other than by translation)
+    SegmentGeometry geometry;
 };
 
 class LineMap;
@@ -136,6 +179,9 @@ Surface move_surface(const Surface &, VectorD);
 inline double segment_length(const LineSegment & seg)
     { return magnitude(seg.a - seg.b); }
 
+inline double segment_length(const Surface & surface)
+    { return surface.geometry.length; }
+
 inline VectorD location_along(double x, const LineSegment & seg)
     { return (seg.b - seg.a)*x + seg.a; }
 
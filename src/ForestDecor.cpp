@@ -18,8 +18,10 @@
 *****************************************************************************/
 
 #include "ForestDecor.hpp"
-#include "maps/LineMapLoader.hpp"
+#include "maps/MapTileIndex.hpp"
 #include "maps/MapObjectLoader.hpp"
+#include "StageTimer.hpp"
+#include "TraceZones.hpp"
 
 //#include <tmap/TilePropertiesInterface.hpp>
 #include <tmap/TiledMap.hpp>
@@ -105,8 +107,7 @@ struct ForestLoadTemp final : public MapDecorDrawer::TempRes {
 
 } // end of <anonymous> namespace
 
-static GroundsClassMap load_grounds_map
-    (const tmap::TileLayer & layer, const LineMapLoader::SegmentMap & segments_map);
+static GroundsClassMap load_grounds_map(const MapTileIndex &);
 
 // multithreaded version
 static std::unique_ptr<ForestDecor::FutureTreeMaker> make_future_tree_maker();
@@ -660,18 +661,25 @@ void ForestDecor::set_view_size(int width, int height) {
 }
 
 /* private */ std::unique_ptr<ForestDecor::TempRes> ForestDecor::prepare_map_objects
-    (const tmap::TiledMap & tmap, MapObjectLoader & objloader)
+    (const tmap::TiledMap & tmap, const MapTileIndex & tile_index, MapObjectLoader & objloader)
 {
-    load_map_vegetation(tmap, objloader);
+    {
+    // trees may still be growing on worker threads after this returns
+    StageTimer timer("ForestDecor::load_map_vegetation");
+    load_map_vegetation(tmap, tile_index, objloader);
+    }
+    StageTimer timer("ForestDecor::load_map_waterfalls");
     // there needs to be a better way to handle temporaries!
     // can I alleviate this to some degree with double dispatch? or something else?
-    return load_map_waterfalls(tmap);
+    return load_map_waterfalls(tmap, tile_index);
 }
 
 /* private */ void ForestDecor::prepare_map
-    (tmap::TiledMap & tmap, std::unique_ptr<ForestDecor::TempRes> resptr)
+    (tmap::TiledMap & tmap, const MapTileIndex & tile_index,
+     std::unique_ptr<ForestDecor::TempRes> resptr)
 {
     using tmap::TileLayer;
+    StageTimer timer("ForestDecor::prepare_map");
     auto & gid_to_strips = dynamic_cast<ForestLoadTemp &>(*resptr).gid_to_strips;
 
     auto get_wf_ptr = [&gid_to_strips](int gid) -> std::shared_ptr<WfFramesInfo> {
@@ -679,34 +687,38 @@ void ForestDecor::set_view_size(int width, int height) {
         return itr == gid_to_strips.end() ? nullptr : itr->second;
     };
 
+    // indexed by the tile index's layer numbers
+    std::vector<TileLayer *> layers;
     for (auto * layer : tmap) {
-        if (!dynamic_cast<TileLayer *>(layer)) continue;
-        //if (!tmap.convert_to_writable_tile_layer(layer)) continue;
-        auto & map_tiles = dynamic_cast<TileLayer &>(*layer); //*tmap.convert_to_writable_tile_layer(layer);
-        std::shared_ptr<const WfFramesInfo> ptr = nullptr;
-        // order of dimensions important here
-        for (int x = 0; x != map_tiles.width (); ++x) {
-            // must reset per column
-            int count = 0;
-            for (int y = 0; y != map_tiles.height(); ++y) {
-                int gid = map_tiles.tile_gid(x, y);
-                if (ptr != get_wf_ptr(gid)) {
-                    count = 0;
-                    ptr = get_wf_ptr(gid);
-                }
+        layers.push_back(dynamic_cast<TileLayer *>(layer));
+    }
 
-                if (ptr) {
-                    // if it's a magic tile, there must be a tileset associated with it
-                    auto tsptr = tmap.get_tile_set_for_gid(gid);
-                    assert(tsptr);
-                    int new_tid = ptr->get_new_tid( count++ );
-#                   if 0
-                    map_tiles.set_tile_gid(x, y, tsptr->convert_to_gid( new_tid ));
-#                   endif
-                    map_tiles.set_tile_tid(x, y, new_tid);
-                }
-            }
-        }
+    // only waterfall tiles are visited, these come in column order, and a
+    // run of the same strip down a column counts up
+    const MapTileIndex::TilePosition * last = nullptr;
+    std::shared_ptr<const WfFramesInfo> ptr = nullptr;
+    int count = 0;
+    for (const auto & pos : tile_index.waterfall_tiles()) {
+        auto & map_tiles = *layers.at(std::size_t(pos.layer));
+        auto r = pos.location;
+        int gid = map_tiles.tile_gid(r.x, r.y);
+        auto wf_ptr = get_wf_ptr(gid);
+        bool continues_run =    last && last->layer == pos.layer
+                             && last->location == r - VectorI(0, 1)
+                             && ptr == wf_ptr;
+        if (!continues_run) count = 0;
+        ptr  = wf_ptr;
+        last = &pos;
+        assert(ptr);
+
+        // if it's a magic tile, there must be a tileset associated with it
+        auto tsptr = tmap.get_tile_set_for_gid(gid);
+        assert(tsptr);
+        int new_tid = ptr->get_new_tid( count++ );
+#       if 0
+        map_tiles.set_tile_gid(r.x, r.y, tsptr->convert_to_gid( new_tid ));
+#       endif
+        map_tiles.set_tile_tid(r.x, r.y, new_tid);
     }
 
     for (auto & pair : gid_to_strips) {
@@ -721,24 +733,16 @@ void ForestDecor::set_view_size(int width, int height) {
 
     // ensure all magic tiles are replaced
 #   ifdef MACRO_DEBUG
-    for (const auto * layer : tmap) {
-        if (!dynamic_cast<const TileLayer *>(layer)) continue;
-#       if 0
-        if (!tmap.convert_to_writable_tile_layer(layer)) continue;
-        auto & map_tiles = *tmap.convert_to_writable_tile_layer(layer);
-#       endif
-        const auto & map_tiles = dynamic_cast<const TileLayer &>(*layer);
-
-        // order of dimensions important here
-        for (int x = 0; x != map_tiles.width (); ++x) {
-        for (int y = 0; y != map_tiles.height(); ++y) {
-            assert(gid_to_strips.find(map_tiles.tile_gid(x, y)) == gid_to_strips.end());
-        }}
+    for (const auto & pos : tile_index.waterfall_tiles()) {
+        const auto & map_tiles = *layers.at(std::size_t(pos.layer));
+        assert(gid_to_strips.find(map_tiles.tile_gid(pos.location.x, pos.location.y)) == gid_to_strips.end());
     }
 #   endif
 }
 
-/* private */ void ForestDecor::load_map_vegetation(const tmap::TiledMap & tmap, MapObjectLoader & objloader) {
+/* private */ void ForestDecor::load_map_vegetation
+    (const tmap::TiledMap & tmap, const MapTileIndex & tile_index, MapObjectLoader & objloader)
+{
     if (k_use_multithreaded_tree_loading)
         { m_tree_maker = make_future_tree_maker(); }
     else
@@ -753,9 +757,9 @@ void ForestDecor::set_view_size(int width, int height) {
     if (itr == tmap.end()) return;
     const auto * ground = dynamic_cast<const tmap::TileLayer *>(*itr);
     if (!ground) return;
-    auto tile_size   = LineMapLoader::load_tile_size(tmap);
-    auto segments    = LineMapLoader::load_tileset_map(tmap, tile_size.width, tile_size.height);
-    const auto grounds_map = load_grounds_map(*ground, segments.segment_map);
+    auto tile_size   = tile_index.tile_size();
+    const auto & segments = tile_index.segments_info();
+    const auto grounds_map = load_grounds_map(tile_index);
     static constexpr const int k_seed = 0xDEADBEEF;
     std::default_random_engine rng { k_seed };
     for (int y = 0; y != ground->height(); ++y) {
@@ -791,35 +795,15 @@ void ForestDecor::set_view_size(int width, int height) {
     }}
 }
 
-/* private */ std::unique_ptr<ForestDecor::TempRes> ForestDecor::load_map_waterfalls(const tmap::TiledMap & tmap) {
-    // I need to seperate loading information on "magic" link tiles
-    // and then modifying the actual map tiles
-    // so... maybe this function can "just load" information on this linked tiles
-    // and then another chain of calls which will modify the map following a load
-
+/* private */ std::unique_ptr<ForestDecor::TempRes> ForestDecor::load_map_waterfalls
+    (const tmap::TiledMap & tmap, const MapTileIndex & tile_index)
+{
+    // this "just loads" information on the linked tiles, the actual map
+    // tiles are modified by prepare_map following a load
     auto rv = std::make_unique<ForestLoadTemp>();
-    std::map<int, std::shared_ptr<WfFramesInfo>> & gid_to_strips = rv->gid_to_strips;
-    for (const tmap::MapLayer * layer : tmap) {
-        const auto * tile_layer = dynamic_cast<const tmap::TileLayer *>(layer);
-        if (!tile_layer) continue;
-        for (int x = 0; x != tile_layer->width (); ++x) {
-        for (int y = 0; y != tile_layer->height(); ++y) {
-            auto wf_itr_ptr = tile_layer->properties_of(x, y);
-
-            if (!wf_itr_ptr) continue;
-            auto gid = tile_layer->tile_gid(x, y);
-            make_do_if_found(*wf_itr_ptr)("animation-falls", [gid, &gid_to_strips, &tmap]
-                        (const std::string & val)
-            {
-                auto itr = gid_to_strips.find(gid);
-                // if already initialized... skip
-                if (itr == gid_to_strips.end()) {
-                    gid_to_strips[gid] = load_new_strip(tmap, gid, val);
-                }
-            });
-        }}
+    for (const auto & [gid, val] : tile_index.waterfall_strips()) {
+        rv->gid_to_strips[gid] = load_new_strip(tmap, gid, val);
     }
-
     return rv;
 }
 
@@ -989,24 +973,16 @@ std::enable_if_t<std::is_integral_v<T> && std::is_floating_point_v<U>, T>
 
 } // end of <anonymous> namespace
 
-static GroundsClassMap load_grounds_map
-    (const tmap::TileLayer & layer, const LineMapLoader::SegmentMap & segments_map)
-{
+static GroundsClassMap load_grounds_map(const MapTileIndex & tile_index) {
     GroundsClassMap rv;
-    for (int y = 0; y != layer.height(); ++y) {
-    for (int x = 0; x != layer.width (); ++x) {
-        auto itr = segments_map.find(layer.tile_gid(x, y));
-        // tile has no segments? skip
-        if (itr == segments_map.end()) continue;
-        // already loaded? skip
-        if (rv.find(layer.tile_gid(x, y)) != rv.end()) continue;
-
-        auto & classes = rv[layer.tile_gid(x, y)];
-        auto segment_count = itr->second.segments.size();
+    // only gids with segments can be grounds
+    for (const auto & [gid, tile_info] : tile_index.segments_info().segment_map) {
+        auto & classes = rv[gid];
+        auto segment_count = tile_info.segments.size();
         classes.reserve(segment_count);
 
-        assert(layer.properties_of(x, y) != nullptr);
-        auto & props = *layer.properties_of(x, y);
+        assert(tile_index.properties_of(gid) != nullptr);
+        auto & props = *tile_index.properties_of(gid);
         auto decor_itr = props.find("decor-class");
         if (decor_itr == props.end()) {
             // has no decor-class... default all to "not ground"
@@ -1030,7 +1006,7 @@ static GroundsClassMap load_grounds_map
             classes.clear();
             classes.resize(segment_count, false);
         }
-    }}
+    }
     return rv;
 }
 
@@ -1094,6 +1070,7 @@ static std::unique_ptr<ForestDecor::FutureTreeMaker> make_future_tree_maker() {
         }
 
         void worker_entry_point() {
+            TraceRecorder::instance().name_this_thread("tree maker");
             TaskList task_list;
             while (!m_worker_done) {
                 // wait for more is task list is empty
@@ -1102,6 +1079,7 @@ static std::unique_ptr<ForestDecor::FutureTreeMaker> make_future_tree_maker() {
                     m_hold_loop.wait(lk);
                 }
                 for (auto & [prom, params] : task_list) {
+                    TraceZone zone("PlantTree::plant");
                     PlantTree tree;
                     tree.plant(params.location, static_cast<PlantTree::CreationParams>(params));
                     prom.set_value(std::move(tree));
@@ -249,12 +249,13 @@ public:
 private:
     static constexpr const bool k_use_multithreaded_tree_loading = true;
 
-    std::unique_ptr<TempRes> prepare_map_objects(const tmap::TiledMap & tmap, MapObjectLoader &) override;
+    std::unique_ptr<TempRes> prepare_map_objects
+        (const tmap::TiledMap & tmap, const MapTileIndex &, MapObjectLoader &) override;
 
-    void prepare_map(tmap::TiledMap &, std::unique_ptr<TempRes>) override;
+    void prepare_map(tmap::TiledMap &, const MapTileIndex &, std::unique_ptr<TempRes>) override;
 
-    void load_map_vegetation(const tmap::TiledMap &, MapObjectLoader &);
-    std::unique_ptr<TempRes> load_map_waterfalls(const tmap::TiledMap &);
+    void load_map_vegetation(const tmap::TiledMap &, const MapTileIndex &, MapObjectLoader &);
+    std::unique_ptr<TempRes> load_map_waterfalls(const tmap::TiledMap &, const MapTileIndex &);
 
     void plant_new_flower(std::default_random_engine &, VectorD, MapObjectLoader &);
 
@@ -19,6 +19,7 @@
 
 #include "GameDriver.hpp"
 #include "ForestDecor.hpp"
+#include "maps/MapTileIndex.hpp"
 
 #include <tmap/MapLayer.hpp>
 
@@ -26,6 +27,7 @@
 
 #include <iostream>
 
+#include <cmath>
 #include <cassert>
 
 namespace {
@@ -115,36 +117,75 @@ void HudTimePiece::draw(sf::RenderTarget & target, sf::RenderStates states) cons
 // ----------------------------------------------------------------------------
 
 void GameDriver::setup(const StartupOptions & opts, const sf::View &) {
-    m_rng = std::default_random_engine { std::random_device()() };
-    m_tmap.load_from_file(opts.test_map);
-
-    m_lmapnn.load_map_from(m_tmap);
+    StageTimer timer("GameDriver::setup");
     auto decor = std::make_unique<ForestDecor>();
-
-#   if 0
-    m_graphics.load_decor(m_tmap);
-#   endif
-    DriverMapObjectLoader dmol(m_player, m_emanager);
-#   if 0
-    decor->load_map(m_tmap, dmol);
-#   endif
     decor->set_view_size(k_view_width, k_view_height);
-    decor->prepare_with_map(m_tmap, dmol);
-    dmol.load_map_objects(m_tmap.map_objects());
+    load_map(opts, &*decor);
     m_graphics.take_decor<ForestDecor>(std::move(decor));
+    {
+    StageTimer systems_timer("setup_systems");
+    m_system_threads = opts.system_threads;
+    setup_systems(CompleteSystemList());
+    }
+    if (!opts.record_file.empty()) {
+        m_recording = std::make_unique<InputRecording>();
+        m_recording->set_map_filename(opts.test_map);
+        m_record_filename = opts.record_file;
+    }
+}
+
+void GameDriver::setup_headless(const StartupOptions & opts) {
+    if (opts.draw_stats) {
+        auto recorder = std::make_unique<RecordingGraphics>();
+        m_draw_recorder = &*recorder;
+        m_headless_graphics = std::move(recorder);
+    } else {
+        m_headless_graphics = std::make_unique<NullGraphics>();
+    }
+    load_map(opts, nullptr);
+    m_system_threads = opts.system_threads;
     setup_systems(CompleteSystemList());
 }
 
 void GameDriver::update(double et) {
-    m_graphics.reset_for_new_frame();
+    TraceZone zone("GameDriver::update");
+    step(et);
+    draw_frame();
+}
+
+void GameDriver::update_fixed_steps(double et) {
+    static constexpr const double k_max_time_left = k_fixed_step*k_max_steps_per_frame;
+    m_step_time_left = std::min(m_step_time_left + et, k_max_time_left);
+    int steps = int(std::floor(m_step_time_left / k_fixed_step));
+    m_step_time_left = std::max(0., m_step_time_left - k_fixed_step*steps);
+    for (int i = 0; i != steps; ++i) {
+        if (m_player)
+            { m_prior_player_location = m_player.get<PhysicsComponent>().location(); }
+        step(k_fixed_step);
+    }
+    // with no step, the same two steps are drawn between, only further along
+    set_step_interpolation(m_step_time_left / k_fixed_step);
+    draw_frame();
+}
+
+/* private */ void GameDriver::step(double et) {
+    TraceZone zone("GameDriver::step");
     for (auto * tsys : m_time_aware_systems) {
         tsys->set_elapsed_time(et);
     }
-    m_timer.update(et);
+    if (!is_headless()) m_timer.update(et);
+    {
+    EntityChangeListener::Scope listen(m_query_index);
     m_emanager.update_systems();
-
+    }
+    m_query_index.apply_changes();
+    m_query_index.drop_deleted();
     m_emanager.process_deletion_requests();
+    if (m_map_multiplexer) update_linked_maps();
+    if (m_recording) m_recording->push_frame(et, state_hash());
+    if (m_profiler ) m_profiler ->on_frame_end();
 
+    if (is_headless()) return;
     m_graphics.update(et);
 
     m_timer.update_velocity(m_player.get<PhysicsComponent>().velocity());
@@ -153,9 +194,32 @@ void GameDriver::update(double et) {
     m_timer.set_debug_line(0, std::string("Layer: ") + to_string(m_player.get<PhysicsComponent>().active_layer));
     m_vtrkr.update(m_player.get<PhysicsComponent>().velocity(), m_timer);
     m_ltrkr.update(m_player.get<PhysicsComponent>().location(), m_timer);
+
+    if (m_profiler && m_profiler->hud_is_due()) {
+        // first three lines are taken by the above
+        int line = 3;
+        for (const auto & str : m_profiler->summary_lines()) {
+            m_timer.set_debug_line(line++, str);
+        }
+    }
+}
+
+/* private */ void GameDriver::draw_frame() {
+    TraceZone zone("GameDriver::draw_frame");
+    active_graphics().reset_for_new_frame();
+    if (m_draw_recorder) {
+        // where the camera would be, if there were a window
+        auto cam = camera_position();
+        m_draw_recorder->set_view_rect(Rect(cam.x - k_view_width*0.5, cam.y - k_view_height*0.5,
+                                            k_view_width, k_view_height));
+    }
+    for (auto * drawer : m_frame_drawers) {
+        drawer->draw_frame();
+    }
 }
 
 void GameDriver::render_to(sf::RenderTarget & target) {
+    TraceZone zone("GameDriver::render_to");
     m_graphics.set_view(target.getView());
 
     auto itr = m_tmap.begin();
@@ -183,7 +247,7 @@ void GameDriver::process_event(const sf::Event & event) {
 #   endif
     using IntDistri = std::uniform_int_distribution<int>;
     if (m_player) {
-        get_script(m_player)->process_control_event(to_control_event(event));
+        process_control_event(to_control_event(event));
     }
     switch (event.type) {
     case sf::Event::KeyReleased:
@@ -192,58 +256,205 @@ void GameDriver::process_event(const sf::Event & event) {
             m_ltrkr.clear_record();
         }
         break;
-    case sf::Event::MouseButtonReleased: {
-        auto e = m_emanager.create_new_entity();
-        auto & freebody = e.add<PhysicsComponent>().reset_state<FreeBody>();
-        freebody.location = m_player.get<PhysicsComponent>().location()
-            + VectorD(0, -100);
-
-        add_color_circle(e, random_color(m_rng), 8);
-        e.add<Lifetime>().value = 30.;
-
-        auto htype = e.add<Item>().hold_type = Item::simple;
-        const char * msg = [htype]() {switch (htype) {
-        case Item::platform_breaker: return "platform breaker";
-        case Item::run_booster     : return "run booster";
-        case Item::crate           : return "crate";
-        default: return "<unknown>";
-        }}();
-        if (msg) {
-            std::cout << msg << std::endl;
-        }
-        if (htype != Item::jump_booster)
-            freebody.velocity = VectorD(0, -100);
-#       if 0
-        if (htype == Item::crate) {
-            e.add<ScriptUPtr>() = std::make_unique<PrintOutLandingsDepartingsScript>();
-        }
-#       endif
-        e.get<PhysicsComponent>().active_layer = m_player.get<PhysicsComponent>().active_layer;
-        if (htype == Item::simple) {
-             //e.get<PhysicsComponent>().bounce_thershold = 10;
-        } else if (htype == Item::jump_booster) {
-            e.get<PhysicsComponent>().affected_by_gravity = false;
-        }
-        }
+    case sf::Event::MouseButtonReleased:
+        if (m_recording) m_recording->push_item_spawn();
+        spawn_item();
         break;
     default: break;
     }
 }
 
+void GameDriver::process_control_event(const ControlEvent & event) {
+    if (m_recording) m_recording->push_event(event);
+    get_script(m_player)->process_control_event(event);
+}
+
+void GameDriver::replay_event(const RecordedEvent & event) {
+    switch (event.type) {
+    case RecordedEvent::k_control   : process_control_event(event.control); break;
+    case RecordedEvent::k_item_spawn: spawn_item(); break;
+    default: throw BadBranchException();
+    }
+}
+
 VectorD GameDriver::camera_position() const {
     if (!m_player) return VectorD();
     const auto & pcomp = m_player.get<PhysicsComponent>();
-    const auto & layer = m_lmapnn.get_layer(pcomp.active_layer);
-    return box_in(pcomp.location(), layer);
+    const auto & layer = m_active_map->get_layer(pcomp.active_layer);
+    auto loc = pcomp.location();
+    loc = m_prior_player_location + (loc - m_prior_player_location)*m_step_alpha;
+    return box_in(loc, layer);
+}
+
+uint64_t GameDriver::state_hash() const
+    { return m_state_hasher ? m_state_hasher->last_hash() : 0; }
+
+void GameDriver::on_exit() {
+    if (m_profiler) m_profiler->print_summary(std::cout);
+    if (m_draw_recorder) m_draw_recorder->print_summary(std::cout);
+    if (m_recording) {
+        m_recording->save_to_file(m_record_filename);
+        std::cout << "Saved recording of " << m_recording->frames().size()
+                  << " frames to \"" << m_record_filename << "\"." << std::endl;
+    }
+}
+
+/* private */ void GameDriver::load_map
+    (const StartupOptions & opts, MapDecorDrawer * decor)
+{
+    // recorded runs must be reproducible
+    bool deterministic =    k_map_object_loader_rng_is_deterministic
+                         || !opts.record_file.empty() || !opts.replay_file.empty();
+    if (deterministic) {
+        static constexpr const auto k_seed = 0xDEADBEEF;
+        m_rng = std::default_random_engine { k_seed };
+        m_state_hasher = std::make_unique<PhysicsStateHasher>();
+    } else {
+        m_rng = std::default_random_engine { std::random_device()() };
+    }
+    if (opts.profile_systems) {
+        m_profiler = std::make_unique<SystemProfiler>();
+    }
+    {
+    StageTimer timer("tmx parse");
+    m_tmap.load_from_file(opts.test_map);
+    }
+    // one walk over the map's tiles, shared by line map loading and decor
+    MapTileIndex tile_index;
+    tile_index.load_from(m_tmap);
+    const auto & map_props = m_tmap.map_properties();
+    if (map_props.find("map-link-names") != map_props.end()) {
+        StageTimer timer("MapMultiplexer::load_start");
+        m_map_multiplexer = std::make_unique<MapMultiplexer>();
+        m_map_multiplexer->load_start(opts.test_map);
+        m_active_map = &m_map_multiplexer->subject_map();
+    } else {
+        StageTimer timer("LineMap::load_map_from");
+        m_lmapnn.load_map_from(m_tmap, tile_index, opts.test_map);
+    }
+#   if 0
+    m_graphics.load_decor(m_tmap);
+#   endif
+    DriverMapObjectLoader dmol(m_player, m_emanager, deterministic);
+#   if 0
+    decor->load_map(m_tmap, dmol);
+#   endif
+    // decor only plants things to look at, it has no bearing on physics
+    if (decor) {
+        StageTimer timer("MapDecorDrawer::prepare_with_map");
+        decor->prepare_with_map(m_tmap, tile_index, dmol);
+    }
+    dmol.load_map_objects(m_tmap.map_objects());
+}
+
+/* private */ System * GameDriver::add_query_change_applier(const SystemAccess & access) {
+    // only systems which may make entities, or add/remove components
+    if (!access.writes_to<EntityStructureResource>()) return nullptr;
+    m_query_change_appliers.emplace_back(
+        std::make_unique<EntityQueryIndex::ChangeApplier>(m_query_index));
+    return &*m_query_change_appliers.back();
+}
+
+/* private */ void GameDriver::update_linked_maps() {
+    if (!m_player) return;
+    const auto & pcomp = m_player.get<PhysicsComponent>();
+    m_map_multiplexer->prefetch_toward(pcomp.location(), pcomp.velocity());
+    m_map_multiplexer->set_subject_location(pcomp.location(), pcomp.active_layer);
+    const auto & subject = m_map_multiplexer->subject_map();
+    if (&subject == m_active_map) return;
+    m_active_map = &subject;
+    for (auto * lmap_sys : m_map_aware_systems) {
+        lmap_sys->assign_map(subject);
+    }
+}
+
+/* private */ GraphicsBase & GameDriver::active_graphics() {
+    if (m_headless_graphics) return *m_headless_graphics;
+    return m_graphics;
+}
+
+Entity GameDriver::spawn_item_at(VectorD location) {
+    auto e = m_emanager.create_new_entity();
+    auto & freebody = e.add<PhysicsComponent>().reset_state<FreeBody>();
+    freebody.location = location;
+
+    add_color_circle(e, random_color(m_rng), 8);
+    e.add<Lifetime>().value = 30.;
+
+    auto htype = e.add<Item>().hold_type = Item::simple;
+    if (htype != Item::jump_booster)
+        freebody.velocity = VectorD(0, -100);
+#   if 0
+    if (htype == Item::crate) {
+        e.add<ScriptUPtr>() = std::make_unique<PrintOutLandingsDepartingsScript>();
+    }
+#   endif
+    e.get<PhysicsComponent>().active_layer = m_player.get<PhysicsComponent>().active_layer;
+    if (htype == Item::simple) {
+         //e.get<PhysicsComponent>().bounce_thershold = 10;
+    } else if (htype == Item::jump_booster) {
+        e.get<PhysicsComponent>().affected_by_gravity = false;
+    }
+    // spawned between frames, listed by the first system of the next
+    m_query_index.note_changed(e);
+    return e;
+}
+
+/* private */ void GameDriver::spawn_item() {
+    auto e = spawn_item_at(m_player.get<PhysicsComponent>().location()
+                           + VectorD(0, -100));
+    auto htype = e.get<Item>().hold_type;
+    const char * msg = [htype]() {switch (htype) {
+    case Item::platform_breaker: return "platform breaker";
+    case Item::run_booster     : return "run booster";
+    case Item::crate           : return "crate";
+    default: return "<unknown>";
+    }}();
+    if (msg) {
+        std::cout << msg << std::endl;
+    }
+}
+
+/* private */ void GameDriver::set_step_interpolation(double alpha) {
+    m_step_alpha = alpha;
+    for (auto * gfx_sys : m_graphics_aware_systems) {
+        gfx_sys->set_step_interpolation(alpha);
+    }
 }
 
 template <typename ... Types>
 /* private */ void GameDriver::setup_systems(cul::TypeList<>) {
-    for (auto & sys_uptr : m_systems) {
-        m_emanager.register_system(&*sys_uptr);
+    for (auto * query_sys : m_query_aware_systems) {
+        query_sys->setup_queries(m_query_index);
+    }
+    m_emanager.register_system(&m_query_index);
+    if (m_system_threads > 1) {
+        m_worker_pool = std::make_unique<SystemWorkerPool>(m_system_threads);
+        m_scheduler = std::make_unique<SystemScheduler>(&*m_worker_pool);
+        for (auto * pool_sys : m_worker_pool_aware_systems) {
+            pool_sys->assign_worker_pool(*m_worker_pool);
+        }
+        for (std::size_t i = 0; i != m_systems.size(); ++i) {
+            m_scheduler->add(*m_systems[i], m_system_accesses[i]);
+            if (auto * applier = add_query_change_applier(m_system_accesses[i])) {
+                // ordered after the system, and before anything walking entities
+                m_scheduler->add(*applier, SystemAccess().writes<EntityStructureResource>());
+            }
+        }
+        m_emanager.register_system(&*m_scheduler);
+    } else {
+        for (std::size_t i = 0; i != m_systems.size(); ++i) {
+            m_emanager.register_system(&*m_systems[i]);
+            if (auto * applier = add_query_change_applier(m_system_accesses[i]))
+                { m_emanager.register_system(applier); }
+        }
+    }
+    // must be last, the hash is of the state at the end of the frame
+    if (m_state_hasher) {
+        m_emanager.register_system(&*m_state_hasher);
     }
     for (auto & lmap_sys : m_map_aware_systems) {
-        lmap_sys->assign_map(m_lmapnn);
+        lmap_sys->assign_map(*m_active_map);
     }
     for (auto & sys_uptr : m_systems) {
         sys_uptr->setup();
@@ -260,11 +471,29 @@ template <typename HeadType, typename ... Types>
     if constexpr (std::is_base_of<MapAware, HeadType>::value) {
         m_map_aware_systems.push_back(&*new_sys);
     }
+    if constexpr (std::is_base_of_v<QueryAware, HeadType>) {
+        m_query_aware_systems.push_back(&*new_sys);
+    }
+    if constexpr (std::is_base_of_v<WorkerPoolAware, HeadType>) {
+        m_worker_pool_aware_systems.push_back(&*new_sys);
+    }
     if constexpr (std::is_base_of_v<GraphicsAware, HeadType>) {
         GraphicsAware & gfxaware = *new_sys;
-        gfxaware.assign_graphics(m_graphics);
+        gfxaware.assign_graphics(active_graphics());
+        m_graphics_aware_systems.push_back(&gfxaware);
+    }
+    if constexpr (std::is_base_of_v<FrameDrawer, HeadType>) {
+        m_frame_drawers.push_back(&*new_sys);
+    }
+    std::unique_ptr<System> sys = std::move(new_sys);
+    if (TraceRecorder::instance().is_recording()) {
+        sys = make_traced_system(std::move(sys), SystemProfiler::name_of<HeadType>());
+    }
+    if (m_profiler) {
+        sys = m_profiler->wrap(std::move(sys), SystemProfiler::name_of<HeadType>());
     }
-    m_systems.emplace_back(new_sys.release());
+    m_systems.emplace_back(std::move(sys));
+    m_system_accesses.emplace_back(access_of<HeadType>());
     setup_systems<Types...>(cul::TypeList<Types...>());
 }
 
@@ -27,9 +27,15 @@
 #include "Systems.hpp"
 #include "GraphicalEffects.hpp"
 #include "GraphicsDrawer.hpp"
+#include "InputRecording.hpp"
+#include "RecordingGraphics.hpp"
+#include "SystemProfiler.hpp"
+#include "systems/SystemScheduler.hpp"
+#include "StageTimer.hpp"
 
 #include "maps/Maps.hpp"
 #include "maps/MapObjectLoader.hpp"
+#include "maps/MapMultiplexer.hpp"
 
 #include <algorithm>
 #include <iostream>
@@ -50,12 +56,10 @@ using CompleteSystemList = cul::TypeList<
     SnakeSystem,
     PlayerControlSystem,
     AnimatorSystem,
-    DrawSystem,
     TriggerBoxSystem,
     TriggerBoxOccupancySystem,
     GravityUpdateSystem,
     ExtremePositionsControlSystem,
-    PlatformDrawer,
     WaypointPositionSystem,
     PlatformMovementSystem,
     HoldItemSystem,
@@ -63,16 +67,20 @@ using CompleteSystemList = cul::TypeList<
     CratePositionUpdateSystem,
     RecallBoundsSystem,
     FallOffSystem,
-    ScriptUpdateSystem
+    ScriptUpdateSystem,
+    // last, so they see where things ended up each step
+    DrawSystem,
+    PlatformDrawer
 >;
 
 class DriverMapObjectLoader final : public MapObjectLoader {
 public:
     using MapObjectContainer = tmap::MapObject::MapObjectContainer;
-    DriverMapObjectLoader(Entity & player_, EntityManager & ent_man_):
+    DriverMapObjectLoader(Entity & player_, EntityManager & ent_man_,
+                          bool deterministic_rng = k_map_object_loader_rng_is_deterministic):
         m_player(player_), m_ent_man(ent_man_)
     {
-        if constexpr (k_map_object_loader_rng_is_deterministic) {
+        if (deterministic_rng) {
             static constexpr const auto k_seed = 0xDEADBEEF;
             m_rng = std::default_random_engine{ k_seed };
         } else {
@@ -120,7 +128,11 @@ private:
 
 public:
     void load_map_objects(const MapObjectContainer & cont) {
-        auto order = get_map_load_order(cont, &m_name_obj_map);
+        StageTimer load_timer("DriverMapObjectLoader::load_map_objects");
+        auto order = [this, &cont] {
+            StageTimer timer("get_map_load_order");
+            return get_map_load_order(cont, &m_name_obj_map);
+        } ();
         for (const auto * obj : order) {
             m_current_object = obj;
             get_loader_function(obj->type)(*this, *obj);
@@ -307,19 +319,70 @@ inline /* private */ void LocationTracker::update_hud(HudTimePiece & hud) const
 
 class GameDriver final {
 public:
+    // fixed steps are short enough that even quick bodies only move a
+    // little per step
+    static constexpr const double k_fixed_step = 1. / 120.;
+    // at most a 15fps frame worth of steps, any more time is dropped rather
+    // than having slow frames make for more steps, and slower frames
+    static constexpr const int k_max_steps_per_frame = 8;
 
     void setup(const StartupOptions &, const sf::View &);
+    // no decor, no hud, and nothing is sent to the graphics drawer
+    // (drawing systems are given a graphics object which ignores everything)
+    void setup_headless(const StartupOptions &);
+    // one step of et, then draws
     void update(double);
+    // banks et, and steps by as many whole fixed steps as it covers (if any),
+    // then draws once, placed between the last two steps by what's left over
+    void update_fixed_steps(double et);
     void render_to(sf::RenderTarget &);
     void render_hud_to(sf::RenderTarget &);
     void process_event(const sf::Event &);
+    void process_control_event(const ControlEvent &);
+    void replay_event(const RecordedEvent &);
     VectorD camera_position() const;
 
+    // only available if recording or replaying (or zero otherwise)
+    uint64_t state_hash() const;
+
+    // called once after the last frame
+    void on_exit();
+
 #   if 1
     const Entity & get_player() const { return m_player; }
 #   endif
 
+    bool is_headless() const noexcept { return bool(m_headless_graphics); }
+
+    /// spawns an item as a mouse click would, without logging
+    Entity spawn_item_at(VectorD location);
+
+    // only available if profiling systems (or nullptr otherwise)
+    const SystemProfiler * system_profiler() const noexcept
+        { return m_profiler.get(); }
+
 private:
+    void load_map(const StartupOptions &, MapDecorDrawer *);
+
+    GraphicsBase & active_graphics();
+
+    /// @returns a new applier of query changes, if the access may change
+    ///          entities' structure, otherwise nullptr
+    System * add_query_change_applier(const SystemAccess &);
+
+    void spawn_item();
+
+    void step(double et);
+
+    /// resets graphics for a new frame, and has everything drawn again
+    void draw_frame();
+
+    void set_step_interpolation(double alpha);
+
+    /// prefetches linked maps the player is heading toward, and moves
+    /// systems onto whichever map the player is now on
+    void update_linked_maps();
+
     template <typename ... Types>
     void setup_systems(cul::TypeList<>);
 
@@ -333,10 +396,29 @@ private:
     EntityManager m_emanager;
 
     LineMap m_lmapnn;
+    // only used if the map links to others ("map-link-names"), in which case
+    // it owns the line maps instead
+    std::unique_ptr<MapMultiplexer> m_map_multiplexer;
+    // the line map systems are given
+    const LineMap * m_active_map = &m_lmapnn;
 
     std::vector<std::unique_ptr<System>> m_systems;
+    // parallel to the above
+    std::vector<SystemAccess> m_system_accesses;
+    // both only present when updating systems on more than one thread
+    std::unique_ptr<SystemWorkerPool> m_worker_pool;
+    std::unique_ptr<SystemScheduler> m_scheduler;
+    int m_system_threads = 1;
     std::vector<TimeAware *> m_time_aware_systems;
     std::vector<MapAware *> m_map_aware_systems;
+    std::vector<WorkerPoolAware *> m_worker_pool_aware_systems;
+    std::vector<GraphicsAware *> m_graphics_aware_systems;
+    std::vector<FrameDrawer *> m_frame_drawers;
+    std::vector<QueryAware *> m_query_aware_systems;
+    // updated before any other system, and after each which may change
+    // entities' structure (by the change appliers)
+    EntityQueryIndex m_query_index;
+    std::vector<std::unique_ptr<System>> m_query_change_appliers;
 
     Entity m_player;
 
@@ -344,6 +426,21 @@ private:
 
     HudTimePiece m_timer;
     GraphicsDrawer m_graphics;
+    std::unique_ptr<GraphicsBase> m_headless_graphics;
+    // points into the above, if draws are being recorded
+    RecordingGraphics * m_draw_recorder = nullptr;
+
+    std::unique_ptr<PhysicsStateHasher> m_state_hasher;
+    std::unique_ptr<InputRecording> m_recording;
+    std::string m_record_filename;
+
+    std::unique_ptr<SystemProfiler> m_profiler;
+
+    // time not yet covered by a fixed step
+    double m_step_time_left = 0.;
+    double m_step_alpha = 1.;
+    // for placing the camera between steps
+    VectorD m_prior_player_location;
 
     // info only
     TopSpdTracker m_vtrkr;
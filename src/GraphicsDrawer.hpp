@@ -140,6 +140,7 @@ std::enable_if_t<std::is_floating_point_v<T>, T>
 }
 
 class MapObjectLoader;
+class MapTileIndex;
 
 class MapDecorDrawer {
 public:
@@ -154,17 +155,21 @@ public:
 
     virtual void render_backdrop(sf::RenderTarget &) const = 0;
 
-    void prepare_with_map(tmap::TiledMap & map, MapObjectLoader & objloader) {
-        auto gv = prepare_map_objects(map, objloader);
-        prepare_map(map, std::move(gv));
+    /// the tile index must have been loaded from the same map
+    void prepare_with_map(tmap::TiledMap & map, const MapTileIndex & tile_index,
+                          MapObjectLoader & objloader)
+    {
+        auto gv = prepare_map_objects(map, tile_index, objloader);
+        prepare_map(map, tile_index, std::move(gv));
     }
 
     virtual void set_view_size(int width, int height) = 0;
 
 protected:
-    virtual std::unique_ptr<TempRes> prepare_map_objects(const tmap::TiledMap & tmap, MapObjectLoader &) = 0;
+    virtual std::unique_ptr<TempRes> prepare_map_objects
+        (const tmap::TiledMap & tmap, const MapTileIndex &, MapObjectLoader &) = 0;
 
-    virtual void prepare_map(tmap::TiledMap &, std::unique_ptr<TempRes>) {}
+    virtual void prepare_map(tmap::TiledMap &, const MapTileIndex &, std::unique_ptr<TempRes>) {}
 
     MapDecorDrawer() {}
 };
@@ -274,3 +279,21 @@ private:
 
     VariablePlatformDrawer m_platform_drawer;
 };
+
+// ----------------------------------------------------------------------------
+
+// for running without a window (or a display at all), everything posted here
+// is simply dropped
+class NullGraphics final : public GraphicsBase {
+public:
+    void draw_line(VectorD, VectorD, sf::Color, double) override {}
+    void draw_rectangle(VectorD, double, double, sf::Color) override {}
+    void draw_circle(VectorD, double, sf::Color) override {}
+    void draw_sprite(const sf::Sprite &) override {}
+    void draw_holocrate(Rect, sf::Color) override {}
+
+    void post_item_collection(VectorD, AnimationPtr) override {}
+    void post_flag_raise(ecs::EntityRef, VectorD, VectorD) override {}
+
+    void reset_for_new_frame() override {}
+};
@@ -0,0 +1,207 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "InputRecording.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include <cstring>
+
+namespace {
+
+using RtError = std::runtime_error;
+
+const char * to_string(ControlMove);
+
+ControlMove to_control_move(const std::string &);
+
+constexpr const uint64_t k_fnv_offset = 0xCBF29CE484222325ull;
+constexpr const uint64_t k_fnv_prime  = 0x100000001B3ull;
+
+uint64_t hash_in(uint64_t seed, uint64_t value) {
+    for (int i = 0; i != 8; ++i) {
+        seed ^= (value >> (i*8)) & 0xFF;
+        seed *= k_fnv_prime;
+    }
+    return seed;
+}
+
+uint64_t hash_in(uint64_t seed, double value) {
+    uint64_t bits = 0;
+    static_assert(sizeof(bits) == sizeof(value), "");
+    std::memcpy(&bits, &value, sizeof(value));
+    return hash_in(seed, bits);
+}
+
+uint64_t hash_in(uint64_t seed, VectorD r)
+    { return hash_in(hash_in(seed, r.x), r.y); }
+
+} // end of <anonymous> namespace
+
+void InputRecording::push_event(const ControlEvent & event) {
+    if (!event.is_valid()) return;
+    m_events.emplace_back(int(m_frames.size()), m_total_time, event);
+}
+
+void InputRecording::push_item_spawn()
+    { m_events.emplace_back(int(m_frames.size()), m_total_time); }
+
+void InputRecording::push_frame(double et, uint64_t state_hash) {
+    m_total_time += et;
+    m_frames.push_back(Frame { et, state_hash });
+}
+
+View<InputRecording::EventIterator> InputRecording::events_for_frame(int frame) const {
+    // events are always pushed in frame order
+    auto beg = std::lower_bound(m_events.begin(), m_events.end(), frame,
+        [](const RecordedEvent & event, int frame) { return event.frame < frame; });
+    auto end = std::find_if(beg, m_events.end(),
+        [frame](const RecordedEvent & event) { return event.frame != frame; });
+    return View<EventIterator>(beg, end);
+}
+
+void InputRecording::save_to_file(const std::string & filename) const {
+    std::ofstream fout(filename);
+    if (!fout) {
+        throw RtError("InputRecording::save_to_file: cannot open \"" + filename + "\".");
+    }
+    // hex floats, every bit of the elapsed time must survive the trip
+    fout << std::hexfloat;
+    fout << "map " << m_map_filename << "\n";
+    auto eitr = m_events.begin();
+    for (const auto & frame : m_frames) {
+        int frame_num = int(&frame - &m_frames.front());
+        for (; eitr != m_events.end() && eitr->frame == frame_num; ++eitr) {
+            fout << "event " << eitr->frame << " " << eitr->elapsed_time << " ";
+            if (eitr->type == RecordedEvent::k_item_spawn) {
+                fout << "spawn\n";
+            } else if (eitr->control.type_id() == k_press_event) {
+                fout << "press " << to_string(eitr->control.as<PressEvent>().button) << "\n";
+            } else {
+                fout << "release " << to_string(eitr->control.as<ReleaseEvent>().button) << "\n";
+            }
+        }
+        fout << "frame " << frame_num << " " << frame.elapsed_time << " "
+             << std::hex << frame.state_hash << std::dec << "\n";
+    }
+}
+
+void InputRecording::load_from_file(const std::string & filename) {
+    std::ifstream fin(filename);
+    if (!fin) {
+        throw RtError("InputRecording::load_from_file: cannot open \"" + filename + "\".");
+    }
+    auto throw_bad_line = [&filename](int line_num) {
+        throw RtError("InputRecording::load_from_file: \"" + filename
+                      + "\" line " + std::to_string(line_num) + " is malformed.");
+    };
+    *this = InputRecording();
+    std::string line;
+    for (int line_num = 1; std::getline(fin, line); ++line_num) {
+        std::istringstream sin(line);
+        std::string kind;
+        if (!(sin >> kind)) continue;
+        if (kind == "map") {
+            sin >> std::ws;
+            std::getline(sin, m_map_filename);
+            continue;
+        }
+        int frame_num = 0;
+        double et = 0.;
+        // hexfloat input with streams is broken in libstdc++, hence strtod
+        std::string et_str;
+        if (!(sin >> frame_num >> et_str)) throw_bad_line(line_num);
+        et = std::strtod(et_str.c_str(), nullptr);
+        if (kind == "frame") {
+            uint64_t hash = 0;
+            if (!(sin >> std::hex >> hash)) throw_bad_line(line_num);
+            if (frame_num != int(m_frames.size())) throw_bad_line(line_num);
+            push_frame(et, hash);
+        } else if (kind == "event") {
+            std::string type, button;
+            if (!(sin >> type)) throw_bad_line(line_num);
+            if (type == "spawn") {
+                m_events.emplace_back(frame_num, et);
+                continue;
+            }
+            if (!(sin >> button)) throw_bad_line(line_num);
+            auto move = to_control_move(button);
+            if (type == "press") {
+                m_events.emplace_back(frame_num, et, ControlEvent(PressEvent(move)));
+            } else if (type == "release") {
+                m_events.emplace_back(frame_num, et, ControlEvent(ReleaseEvent(move)));
+            } else {
+                throw_bad_line(line_num);
+            }
+        } else {
+            throw_bad_line(line_num);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void PhysicsStateHasher::update(const ContainerView & view) {
+    m_hash = k_fnv_offset;
+    for (const auto & e : view) {
+        if (!e.has<PhysicsComponent>()) continue;
+        m_hash = hash_of(e.get<PhysicsComponent>(), m_hash);
+    }
+}
+
+/* static */ uint64_t PhysicsStateHasher::hash_of
+    (const PhysicsComponent & pcomp, uint64_t seed)
+{
+    seed = hash_in(seed, uint64_t(pcomp.state_type_id()));
+    seed = hash_in(seed, uint64_t(pcomp.active_layer));
+    switch (pcomp.state_type_id()) {
+    case k_freebody_state: case k_tracker_state:
+        seed = hash_in(seed, pcomp.velocity());
+        [[fallthrough]];
+    case k_rectangle_state:
+        return hash_in(seed, pcomp.location());
+    // held entities are wherever their holder is
+    default: return seed;
+    }
+}
+
+namespace {
+
+const char * to_string(ControlMove move) {
+    switch (move) {
+    case ControlMove::jump      : return "jump"      ;
+    case ControlMove::move_left : return "move_left" ;
+    case ControlMove::move_right: return "move_right";
+    case ControlMove::use       : return "use"       ;
+    }
+    throw BadBranchException();
+}
+
+ControlMove to_control_move(const std::string & str) {
+    for (auto move : { ControlMove::jump, ControlMove::move_left,
+                       ControlMove::move_right, ControlMove::use })
+    {
+        if (str == to_string(move)) return move;
+    }
+    throw RtError("to_control_move: \"" + str + "\" is not a control move.");
+}
+
+} // end of <anonymous> namespace
@@ -0,0 +1,103 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "systems/SystemsDefs.hpp"
+
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+// Records everything that drives a run of the game (control events, spawns,
+// and the elapsed time of each frame) so that the exact same run may be
+// reproduced later. Each frame also stores a hash of every entity's physics
+// state, which a replay checks frame by frame.
+//
+// Recordings are only useful if the map object loader's rng is seeded, see
+// GameDriver's setup.
+
+struct RecordedEvent {
+    // mouse click spawns are not control events, but they do effect physics
+    enum Type : uint8_t { k_control, k_item_spawn };
+
+    RecordedEvent() {}
+    RecordedEvent(int frame_, double elapsed_time_, const ControlEvent & event_):
+        frame(frame_), elapsed_time(elapsed_time_), control(event_), type(k_control) {}
+    RecordedEvent(int frame_, double elapsed_time_):
+        frame(frame_), elapsed_time(elapsed_time_), type(k_item_spawn) {}
+
+    // index of the frame which the event happens before
+    int frame = 0;
+    // total elapsed time when the event happened
+    double elapsed_time = 0.;
+    ControlEvent control;
+    Type type = k_control;
+};
+
+class InputRecording {
+public:
+    struct Frame {
+        double elapsed_time = 0.;
+        uint64_t state_hash = 0;
+    };
+
+    using EventIterator = std::vector<RecordedEvent>::const_iterator;
+
+    void set_map_filename(const std::string & fn) { m_map_filename = fn; }
+
+    const std::string & map_filename() const { return m_map_filename; }
+
+    // events are posted for the frame which has yet to be pushed
+    void push_event(const ControlEvent &);
+
+    void push_item_spawn();
+
+    void push_frame(double et, uint64_t state_hash);
+
+    const std::vector<Frame> & frames() const { return m_frames; }
+
+    View<EventIterator> events_for_frame(int frame) const;
+
+    void save_to_file(const std::string & filename) const;
+
+    void load_from_file(const std::string & filename);
+
+private:
+    std::string m_map_filename;
+    std::vector<Frame> m_frames;
+    std::vector<RecordedEvent> m_events;
+    double m_total_time = 0.;
+};
+
+// ----------------------------------------------------------------------------
+
+// goes last so that it sees the results of every other system
+class PhysicsStateHasher final : public System {
+public:
+    void update(const ContainerView &) override;
+
+    uint64_t last_hash() const noexcept { return m_hash; }
+
+    static uint64_t hash_of(const PhysicsComponent &, uint64_t seed);
+
+private:
+    uint64_t m_hash = 0;
+};
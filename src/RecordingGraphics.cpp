@@ -0,0 +1,184 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "RecordingGraphics.hpp"
+
+#include <SFML/Graphics/Sprite.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <numeric>
+#include <algorithm>
+
+int RecordingGraphics::FrameStats::total_submitted() const noexcept
+    { return std::accumulate(submitted.begin(), submitted.end(), 0); }
+
+/* static */ const char * RecordingGraphics::to_string(CommandType type) {
+    switch (type) {
+    case k_line           : return "line"           ;
+    case k_rectangle      : return "rectangle"      ;
+    case k_circle         : return "circle"         ;
+    case k_sprite         : return "sprite"         ;
+    case k_holocrate      : return "holocrate"      ;
+    case k_item_collection: return "item collection";
+    case k_flag_raise     : return "flag raise"     ;
+    default: break;
+    }
+    throw BadBranchException();
+}
+
+void RecordingGraphics::print_summary(std::ostream & out) const {
+    auto frame_count = std::max(std::size_t(1), m_frame_stats.size());
+    auto per_frame = [frame_count](int x) { return double(x) / double(frame_count); };
+    out << "Draw submissions over " << m_frame_stats.size() << " frames:\n"
+        << std::left << std::setw(17) << "type" << std::right
+        << std::setw(14) << "avg submitted" << std::setw(14) << "max submitted"
+        << std::setw(12) << "avg culled" << "\n"
+        << std::fixed << std::setprecision(1);
+    for (int i = 0; i != k_command_type_count; ++i) {
+        int total_sub = 0, max_sub = 0, total_culled = 0;
+        for (const auto & stats : m_frame_stats) {
+            total_sub    += stats.submitted[i];
+            max_sub       = std::max(max_sub, stats.submitted[i]);
+            total_culled += stats.culled[i];
+        }
+        out << std::left << std::setw(17) << to_string(CommandType(i)) << std::right
+            << std::setw(14) << per_frame(total_sub) << std::setw(14) << max_sub
+            << std::setw(12) << per_frame(total_culled) << "\n";
+    }
+    int total_offscreen = 0, total_switches = 0, max_switches = 0;
+    for (const auto & stats : m_frame_stats) {
+        total_offscreen += stats.offscreen;
+        total_switches  += stats.texture_switches;
+        max_switches     = std::max(max_switches, stats.texture_switches);
+    }
+    out << "submitted but offscreen (avg): " << per_frame(total_offscreen) << "\n"
+        << "texture switches (avg/max): " << per_frame(total_switches) << "/"
+        << max_switches << std::defaultfloat << std::endl;
+}
+
+void RecordingGraphics::draw_line(VectorD a, VectorD b, sf::Color, double) {
+    Command cmd;
+    cmd.type   = k_line;
+    // same as GraphicsDrawer
+    cmd.culled =    m_has_view
+                 && !is_contained_in(a, m_view_rect) && !is_contained_in(b, m_view_rect);
+    cmd.x = float(a.x);
+    cmd.y = float(a.y);
+    cmd.w = float(b.x);
+    cmd.h = float(b.y);
+    push_command(cmd);
+}
+
+void RecordingGraphics::draw_rectangle
+    (VectorD r, double width, double height, sf::Color)
+{
+    Command cmd;
+    cmd.type = k_rectangle;
+    cmd.x = float(r.x);
+    cmd.y = float(r.y);
+    cmd.w = float(width);
+    cmd.h = float(height);
+    if (is_offscreen(Rect(r.x, r.y, width, height))) ++m_current.offscreen;
+    push_command(cmd);
+}
+
+void RecordingGraphics::draw_circle(VectorD loc, double radius, sf::Color) {
+    Command cmd;
+    cmd.type = k_circle;
+    if (m_has_view) {
+        // same (slightly lopsided) expansion as GraphicsDrawer
+        Rect expanded = m_view_rect;
+        expanded.left   -= radius;
+        expanded.top    -= radius;
+        expanded.width  += radius;
+        expanded.height += radius;
+        cmd.culled = !is_contained_in(loc, expanded);
+    }
+    cmd.x = float(loc.x);
+    cmd.y = float(loc.y);
+    cmd.w = cmd.h = float(radius);
+    push_command(cmd);
+}
+
+void RecordingGraphics::draw_sprite(const sf::Sprite & spt) {
+    Command cmd;
+    cmd.type    = k_sprite;
+    cmd.x       = spt.getPosition().x;
+    cmd.y       = spt.getPosition().y;
+    cmd.w       = float(spt.getTextureRect().width );
+    cmd.h       = float(spt.getTextureRect().height);
+    cmd.texture = spt.getTexture();
+    if (is_offscreen(Rect(cmd.x, cmd.y, cmd.w, cmd.h))) ++m_current.offscreen;
+    // sprites are drawn in submission order, so any change is a switch
+    if (m_last_texture && cmd.texture != m_last_texture)
+        { ++m_current.texture_switches; }
+    m_last_texture = cmd.texture;
+    push_command(cmd);
+}
+
+void RecordingGraphics::draw_holocrate(Rect rect, sf::Color) {
+    Command cmd;
+    cmd.type = k_holocrate;
+    cmd.x = float(rect.left );
+    cmd.y = float(rect.top  );
+    cmd.w = float(rect.width);
+    cmd.h = float(rect.height);
+    push_command(cmd);
+}
+
+void RecordingGraphics::post_item_collection(VectorD r, AnimationPtr) {
+    Command cmd;
+    cmd.type = k_item_collection;
+    cmd.x = float(r.x);
+    cmd.y = float(r.y);
+    push_command(cmd);
+}
+
+void RecordingGraphics::post_flag_raise(ecs::EntityRef, VectorD bottom, VectorD top) {
+    Command cmd;
+    cmd.type = k_flag_raise;
+    cmd.x = float(bottom.x);
+    cmd.y = float(bottom.y);
+    cmd.w = float(top.x);
+    cmd.h = float(top.y);
+    push_command(cmd);
+}
+
+void RecordingGraphics::reset_for_new_frame() {
+    if (m_frame_started) m_frame_stats.push_back(m_current);
+    m_frame_started = true;
+    m_current       = FrameStats();
+    m_last_texture  = nullptr;
+    m_commands.clear();
+}
+
+/* private */ void RecordingGraphics::push_command(const Command & cmd) {
+    auto & counts = cmd.culled ? m_current.culled : m_current.submitted;
+    ++counts[cmd.type];
+    m_commands.push_back(cmd);
+}
+
+/* private */ bool RecordingGraphics::is_offscreen(const Rect & rect) const {
+    if (!m_has_view) return false;
+    return    rect.left + rect.width  < m_view_rect.left
+           || rect.top  + rect.height < m_view_rect.top
+           || rect.left > m_view_rect.left + m_view_rect.width
+           || rect.top  > m_view_rect.top  + m_view_rect.height;
+}
@@ -0,0 +1,106 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "Defs.hpp"
+#include "systems/SystemsDefs.hpp"
+
+#include <array>
+#include <iosfwd>
+#include <vector>
+
+namespace sf { class Texture; }
+
+/// Records everything posted to graphics as a compact command log, and keeps
+/// per frame draw statistics. Nothing is actually drawn, so this works
+/// without a window or OpenGL (e.g. in headless runs).
+///
+/// Culling follows the same rules as GraphicsDrawer, so "culled" commands
+/// are those the real drawer would have thrown away.
+class RecordingGraphics final : public GraphicsBase {
+public:
+    enum CommandType : uint8_t {
+        k_line, k_rectangle, k_circle, k_sprite, k_holocrate,
+        k_item_collection, k_flag_raise,
+        k_command_type_count
+    };
+
+    struct Command {
+        CommandType type = k_line;
+        bool culled = false;
+        // location, second point or size, depends on the type
+        float x = 0.f, y = 0.f, w = 0.f, h = 0.f;
+        // sprites only
+        const sf::Texture * texture = nullptr;
+    };
+
+    struct FrameStats {
+        std::array<int, k_command_type_count> submitted = {};
+        std::array<int, k_command_type_count> culled    = {};
+        // sprites and rectangles are never culled, but may still be entirely
+        // outside the view
+        int offscreen        = 0;
+        int texture_switches = 0;
+
+        int total_submitted() const noexcept;
+    };
+
+    static const char * to_string(CommandType);
+
+    /// culling is done against this, everything is "in view" by default
+    void set_view_rect(const Rect & rect) {
+        m_view_rect = rect;
+        m_has_view  = true;
+    }
+
+    /// commands of the frame in progress
+    const std::vector<Command> & commands() const noexcept { return m_commands; }
+
+    /// statistics of every completed frame
+    const std::vector<FrameStats> & frame_stats() const noexcept { return m_frame_stats; }
+
+    /// average and maximum counts per frame
+    void print_summary(std::ostream &) const;
+
+    void draw_line(VectorD, VectorD, sf::Color, double thickness) override;
+    void draw_rectangle(VectorD, double width, double height, sf::Color) override;
+    void draw_circle(VectorD loc, double radius, sf::Color) override;
+    void draw_sprite(const sf::Sprite &) override;
+    void draw_holocrate(Rect, sf::Color) override;
+
+    void post_item_collection(VectorD, AnimationPtr) override;
+    void post_flag_raise(ecs::EntityRef, VectorD bottom, VectorD top) override;
+
+    void reset_for_new_frame() override;
+
+private:
+    void push_command(const Command &);
+
+    bool is_offscreen(const Rect &) const;
+
+    Rect m_view_rect;
+    bool m_has_view = false;
+
+    std::vector<Command> m_commands;
+    FrameStats m_current;
+    const sf::Texture * m_last_texture = nullptr;
+    bool m_frame_started = false;
+    std::vector<FrameStats> m_frame_stats;
+};
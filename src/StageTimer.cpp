@@ -0,0 +1,103 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "StageTimer.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+
+#include <cstring>
+
+namespace {
+
+thread_local StageTimings * t_current_timings = nullptr;
+
+} // end of <anonymous> namespace
+
+StageTimings::Collecting::Collecting(StageTimings & timings):
+    m_old(t_current_timings)
+{ t_current_timings = &timings; }
+
+StageTimings::Collecting::~Collecting()
+    { t_current_timings = m_old; }
+
+/* static */ StageTimings * StageTimings::current() noexcept
+    { return t_current_timings; }
+
+std::size_t StageTimings::start_stage(const char * name) {
+    auto itr = std::find_if(m_records.begin(), m_records.end(),
+        [this, name](const Record & rec)
+        { return rec.depth == m_depth && ::strcmp(rec.name, name) == 0; });
+    if (itr == m_records.end()) {
+        Record rec;
+        rec.name  = name;
+        rec.depth = m_depth;
+        m_records.push_back(rec);
+        itr = m_records.end() - 1;
+    }
+    ++m_depth;
+    return std::size_t(itr - m_records.begin());
+}
+
+void StageTimings::finish_stage(std::size_t idx, double seconds) {
+    --m_depth;
+    auto & rec = m_records.at(idx);
+    ++rec.calls;
+    rec.seconds += seconds;
+}
+
+void StageTimings::print(std::ostream & out, int runs) const {
+    if (runs < 1) {
+        throw std::invalid_argument("StageTimings::print: runs must be a "
+                                    "positive integer.");
+    }
+    auto flags = out.flags();
+    auto prec  = out.precision();
+    out << std::fixed << std::setprecision(3);
+    for (const auto & rec : m_records) {
+        std::string label = std::string(std::size_t(rec.depth)*2, ' ') + rec.name;
+        out << std::left << std::setw(40) << label << std::right
+            << std::setw(11) << (rec.seconds*1000. / double(runs)) << " ms";
+        if (rec.calls != runs)
+            { out << " (" << rec.calls << " calls)"; }
+        out << "\n";
+    }
+    out.flags(flags);
+    out.precision(prec);
+}
+
+// ----------------------------------------------------------------------------
+
+StageTimer::StageTimer(const char * name):
+    m_timings(StageTimings::current()),
+    m_zone(name)
+{
+    if (!m_timings) return;
+    m_idx   = m_timings->start_stage(name);
+    m_start = Clock::now();
+}
+
+StageTimer::~StageTimer() {
+    if (!m_timings) return;
+    m_timings->finish_stage
+        (m_idx, std::chrono::duration<double>(Clock::now() - m_start).count());
+}
@@ -0,0 +1,93 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "TraceZones.hpp"
+
+#include <chrono>
+#include <iosfwd>
+#include <vector>
+
+/// Collects wall times of named, possibly nested, stages of some one off
+/// piece of work (e.g. loading a map).
+///
+/// Stage timers report to whichever collector is current on their thread,
+/// when there isn't one they do nothing. So code deep in loaders may be
+/// instrumented without having a collector threaded through to it.
+class StageTimings final {
+public:
+    struct Record {
+        // names are expected to be string literals
+        const char * name = nullptr;
+        int depth = 0;
+        int calls = 0;
+        double seconds = 0.;
+    };
+
+    /// makes a collector current for this thread while in scope
+    class Collecting final {
+    public:
+        explicit Collecting(StageTimings &);
+        Collecting(const Collecting &) = delete;
+        Collecting & operator = (const Collecting &) = delete;
+        ~Collecting();
+
+    private:
+        StageTimings * m_old;
+    };
+
+    static StageTimings * current() noexcept;
+
+    /// @returns record index, which is to be passed to finish_stage
+    std::size_t start_stage(const char * name);
+
+    void finish_stage(std::size_t idx, double seconds);
+
+    /// records appear in the order their stages started, with stages of the
+    /// same name and depth merged
+    const std::vector<Record> & records() const noexcept { return m_records; }
+
+    void clear() { m_records.clear(); }
+
+    /// prints stages indented by depth, times are divided by runs
+    void print(std::ostream &, int runs = 1) const;
+
+private:
+    std::vector<Record> m_records;
+    int m_depth = 0;
+};
+
+/// times its scope as a stage of the current collector (if any), stages also
+/// appear as zones in traces
+class StageTimer final {
+public:
+    explicit StageTimer(const char * name);
+    StageTimer(const StageTimer &) = delete;
+    StageTimer & operator = (const StageTimer &) = delete;
+    ~StageTimer();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    StageTimings * m_timings;
+    std::size_t m_idx = 0;
+    Clock::time_point m_start;
+    TraceZone m_zone;
+};
@@ -0,0 +1,172 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "SystemProfiler.hpp"
+#include "TraceZones.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+
+#include <cstdlib>
+
+#ifdef MACRO_COMPILER_GCC
+#   include <cxxabi.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::string to_microseconds(double seconds) {
+    std::stringstream sstrm;
+    sstrm << std::fixed << std::setprecision(1) << seconds*1'000'000.;
+    return sstrm.str();
+}
+
+class TracedSystem final : public System {
+public:
+    TracedSystem(std::unique_ptr<System> && inner, const std::string & name):
+        m_inner(std::move(inner)), m_name(name) {}
+
+    void setup() override { m_inner->setup(); }
+
+    void update(const ContainerView & view) override {
+        TraceZone zone(m_name.c_str());
+        static_cast<EntityManager::SystemType &>(*m_inner).update(view);
+    }
+
+private:
+    std::unique_ptr<System> m_inner;
+    std::string m_name;
+};
+
+} // end of <anonymous> namespace
+
+class SystemProfiler::ProfiledSystem final : public System {
+public:
+    ProfiledSystem(std::unique_ptr<System> && inner, Record & record):
+        m_inner(std::move(inner)), m_record(record) {}
+
+    void setup() override { m_inner->setup(); }
+
+    void update(const ContainerView & view) override {
+        auto beg = Clock::now();
+        static_cast<EntityManager::SystemType &>(*m_inner).update(view);
+        m_record.add_sample(std::chrono::duration<double>(Clock::now() - beg).count());
+    }
+
+private:
+    std::unique_ptr<System> m_inner;
+    Record & m_record;
+};
+
+std::unique_ptr<System> SystemProfiler::wrap
+    (std::unique_ptr<System> sys, const std::string & name)
+{
+    if (!sys) {
+        throw std::invalid_argument("SystemProfiler::wrap: cannot wrap a nullptr.");
+    }
+    m_records.emplace_back(std::make_unique<Record>());
+    m_records.back()->name = name;
+    return std::make_unique<ProfiledSystem>(std::move(sys), *m_records.back());
+}
+
+std::vector<std::string> SystemProfiler::summary_lines() const {
+    std::vector<std::string> rv;
+    rv.reserve(m_records.size() + 1);
+    rv.emplace_back("system (us) min/avg/p99");
+    for (const auto & rec : m_records) {
+        auto stats = rec->window_stats();
+        rv.emplace_back(rec->name + " " + to_microseconds(stats.min) + "/"
+                        + to_microseconds(stats.avg) + "/" + to_microseconds(stats.p99));
+    }
+    return rv;
+}
+
+void SystemProfiler::print_summary(std::ostream & out) const {
+    std::size_t name_width = 6;
+    for (const auto & rec : m_records) {
+        name_width = std::max(name_width, rec->name.length() + 1);
+    }
+    out << "System timings over " << m_frame_count << " frames (last "
+        << std::min(std::size_t(m_frame_count), k_window_size)
+        << " for min/avg/p99) in microseconds:\n"
+        << std::left << std::setw(int(name_width)) << "system" << std::right;
+    for (auto head : { "min", "avg", "p99", "all avg", "all max" }) {
+        out << std::setw(10) << head;
+    }
+    out << "\n";
+    for (const auto & rec : m_records) {
+        auto stats = rec->window_stats();
+        auto all_avg = rec->sample_count ? rec->total_time / double(rec->sample_count) : 0.;
+        out << std::left << std::setw(int(name_width)) << rec->name << std::right;
+        for (auto x : { stats.min, stats.avg, stats.p99, all_avg, rec->max_time }) {
+            out << std::setw(10) << to_microseconds(x);
+        }
+        out << "\n";
+    }
+    out << std::flush;
+}
+
+/* private */ void SystemProfiler::Record::add_sample(double x) {
+    samples[sample_count % k_window_size] = x;
+    ++sample_count;
+    total_time += x;
+    max_time    = std::max(max_time, x);
+}
+
+/* private */ SystemProfiler::Stats SystemProfiler::Record::window_stats() const {
+    auto count = std::min(sample_count, k_window_size);
+    if (count == 0) return Stats();
+    std::array<double, k_window_size> sorted;
+    auto end = std::copy(samples.begin(), samples.begin() + count, sorted.begin());
+    std::sort(sorted.begin(), end);
+
+    Stats rv;
+    rv.min = sorted.front();
+    rv.avg = std::accumulate(sorted.begin(), end, 0.) / double(count);
+    rv.p99 = sorted[std::min(count - 1, (count*99) / 100)];
+    return rv;
+}
+
+/* private static */ std::string SystemProfiler::demangle(const char * name) {
+#   ifdef MACRO_COMPILER_GCC
+    int status = 0;
+    char * demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status == 0 && demangled) {
+        std::string rv = demangled;
+        std::free(demangled);
+        return rv;
+    }
+#   endif
+    return name;
+}
+
+std::unique_ptr<System> make_traced_system
+    (std::unique_ptr<System> sys, const std::string & name)
+{
+    if (!sys) {
+        throw std::invalid_argument("make_traced_system: cannot wrap a nullptr.");
+    }
+    return std::make_unique<TracedSystem>(std::move(sys), name);
+}
@@ -0,0 +1,86 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "systems/SystemsDefs.hpp"
+
+#include <array>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <memory>
+#include <typeinfo>
+
+/// Times each system's update, keeping a rolling window of samples per system.
+///
+/// Systems are wrapped as they're created, the wrapper owns the system and
+/// is registered in its place.
+class SystemProfiler final {
+public:
+    // little over four seconds at 60fps
+    static constexpr const std::size_t k_window_size = 256;
+    // in frames, how often the hud lines are worth refreshing
+    static constexpr const int k_hud_refresh_rate = 30;
+
+    struct Stats {
+        double min = 0., avg = 0., p99 = 0.;
+    };
+
+    std::unique_ptr<System> wrap(std::unique_ptr<System>, const std::string & name);
+
+    /// called once per frame, after all systems have updated
+    void on_frame_end() { ++m_frame_count; }
+
+    bool hud_is_due() const noexcept
+        { return m_frame_count % k_hud_refresh_rate == 0; }
+
+    /// one line per system, values are in microseconds
+    std::vector<std::string> summary_lines() const;
+
+    /// includes all time averages and maximums too
+    void print_summary(std::ostream &) const;
+
+    template <typename T>
+    static std::string name_of() { return demangle(typeid(T).name()); }
+
+private:
+    class ProfiledSystem;
+
+    struct Record {
+        std::string name;
+        std::array<double, k_window_size> samples;
+        std::size_t sample_count = 0;
+        double total_time = 0.;
+        double max_time   = 0.;
+
+        void add_sample(double);
+        Stats window_stats() const;
+    };
+
+    static std::string demangle(const char *);
+
+    std::vector<std::unique_ptr<Record>> m_records;
+    int m_frame_count = 0;
+};
+
+/// wraps a system so that its updates appear as zones in traces
+/// (see TraceZones.hpp)
+std::unique_ptr<System> make_traced_system
+    (std::unique_ptr<System>, const std::string & name);
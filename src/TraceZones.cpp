@@ -0,0 +1,173 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "TraceZones.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace {
+
+using RtError = std::runtime_error;
+
+// event count, beyond which the vector doesn't need to grow during the
+// first few seconds
+constexpr const std::size_t k_initial_event_capacity = 1 << 16;
+
+void write_json_string(std::ostream &, const std::string &);
+
+} // end of <anonymous> namespace
+
+TraceRecorder::Session::Session(const std::string & filename) {
+    if (filename.empty()) return;
+    TraceRecorder::instance().start(filename);
+    TraceRecorder::instance().name_this_thread("main");
+    m_started = true;
+}
+
+TraceRecorder::Session::~Session() {
+    if (!m_started) return;
+    try {
+        TraceRecorder::instance().finish();
+    } catch (std::exception & exp) {
+        std::cerr << exp.what() << std::endl;
+    }
+}
+
+/* static */ TraceRecorder & TraceRecorder::instance() {
+    static TraceRecorder inst;
+    return inst;
+}
+
+void TraceRecorder::start(const std::string & filename) {
+    std::unique_lock lk(m_mutex);
+    if (is_recording()) {
+        throw RtError("TraceRecorder::start: already recording to \""
+                      + m_filename + "\".");
+    }
+    m_filename = filename;
+    m_origin   = Clock::now();
+    m_events.clear();
+    m_events.reserve(k_initial_event_capacity);
+    m_thread_names.clear();
+    m_recording = true;
+}
+
+void TraceRecorder::finish() {
+    std::vector<Event> events;
+    std::vector<std::pair<int, std::string>> thread_names;
+    std::string filename;
+    {
+    std::unique_lock lk(m_mutex);
+    if (!is_recording()) return;
+    m_recording = false;
+    events.swap(m_events);
+    thread_names.swap(m_thread_names);
+    filename = m_filename;
+    }
+
+    std::ofstream fout(filename);
+    if (!fout) {
+        throw RtError("TraceRecorder::finish: cannot open \"" + filename
+                      + "\" for writing.");
+    }
+    fout << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+    bool first = true;
+    auto next_line = [&first, &fout] {
+        if (!first) fout << ",\n";
+        first = false;
+    };
+    for (const auto & [tid, name] : thread_names) {
+        next_line();
+        fout << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+             << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+        write_json_string(fout, name);
+        fout << "}}";
+    }
+    for (const auto & event : events) {
+        next_line();
+        fout << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread_id
+             << ",\"ts\":" << event.start << ",\"dur\":" << event.duration
+             << ",\"name\":";
+        write_json_string(fout, event.name);
+        fout << "}";
+    }
+    fout << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    std::cout << "Wrote " << events.size() << " trace zones to \""
+              << filename << "\"." << std::endl;
+}
+
+void TraceRecorder::push_zone
+    (const char * name, Clock::time_point beg, Clock::time_point end)
+{
+    using MicroSeconds = std::chrono::duration<double, std::micro>;
+    Event event;
+    event.name      = name;
+    event.thread_id = this_thread_id();
+    std::unique_lock lk(m_mutex);
+    // may have stopped since the zone began
+    if (!is_recording()) return;
+    event.start    = MicroSeconds(beg - m_origin).count();
+    event.duration = MicroSeconds(end - beg     ).count();
+    m_events.emplace_back(std::move(event));
+}
+
+void TraceRecorder::name_this_thread(const char * name) {
+    std::unique_lock lk(m_mutex);
+    if (!is_recording()) return;
+    m_thread_names.emplace_back(this_thread_id(), name);
+}
+
+/* private static */ int TraceRecorder::this_thread_id() {
+    static std::atomic_int s_next_id { 1 };
+    thread_local int t_id = s_next_id++;
+    return t_id;
+}
+
+// ----------------------------------------------------------------------------
+
+TraceZone::TraceZone(const char * name) {
+    if (!TraceRecorder::instance().is_recording()) return;
+    m_name  = name;
+    m_start = TraceRecorder::Clock::now();
+}
+
+TraceZone::~TraceZone() {
+    if (!m_name) return;
+    TraceRecorder::instance().push_zone(m_name, m_start, TraceRecorder::Clock::now());
+}
+
+namespace {
+
+void write_json_string(std::ostream & out, const std::string & str) {
+    out << '"';
+    for (char c : str) {
+        switch (c) {
+        case '"' : out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n" ; break;
+        default  : out << c     ; break;
+        }
+    }
+    out << '"';
+}
+
+} // end of <anonymous> namespace
@@ -0,0 +1,96 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// Collects scoped zones from any thread, writing them out as Chrome trace
+/// event JSON (loadable by about:tracing or Perfetto's ui).
+///
+/// While not recording, zones cost a relaxed atomic load.
+class TraceRecorder final {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// records for the duration of its scope, writing on destruction
+    class Session final {
+    public:
+        /// @param filename if empty, no recording happens
+        explicit Session(const std::string & filename);
+        Session(const Session &) = delete;
+        Session & operator = (const Session &) = delete;
+        ~Session();
+
+    private:
+        bool m_started = false;
+    };
+
+    static TraceRecorder & instance();
+
+    void start(const std::string & filename);
+
+    /// stops recording and writes all zones collected so far
+    void finish();
+
+    bool is_recording() const noexcept
+        { return m_recording.load(std::memory_order_relaxed); }
+
+    void push_zone(const char * name, Clock::time_point beg, Clock::time_point end);
+
+    /// labels the calling thread in the trace
+    void name_this_thread(const char * name);
+
+private:
+    struct Event {
+        std::string name;
+        int thread_id = 0;
+        double start    = 0.; // microseconds since recording started
+        double duration = 0.;
+    };
+
+    TraceRecorder() {}
+
+    static int this_thread_id();
+
+    std::atomic_bool m_recording { false };
+    std::mutex m_mutex;
+    std::string m_filename;
+    Clock::time_point m_origin;
+    std::vector<Event> m_events;
+    std::vector<std::pair<int, std::string>> m_thread_names;
+};
+
+/// times its scope as a zone in the trace, if one is being recorded
+class TraceZone final {
+public:
+    /// @param name must outlive the zone
+    explicit TraceZone(const char * name);
+    TraceZone(const TraceZone &) = delete;
+    TraceZone & operator = (const TraceZone &) = delete;
+    ~TraceZone();
+
+private:
+    const char * m_name = nullptr;
+    TraceRecorder::Clock::time_point m_start;
+};
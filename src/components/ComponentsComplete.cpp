@@ -49,6 +49,26 @@ void add_color_circle(Entity e, sf::Color c, double radius) {
     auto & cir = e.add<DisplayFrame>().reset<ColorCircle>();
     cir.color = c;
     cir.radius = radius;
+    EntityChangeListener::notify(e);
+}
+
+// ----------------------------------------------------------------------------
+
+EntityChangeListener::Scope::Scope(EntityChangeListener & listener):
+    m_previous(open_on_this_thread())
+{ open_on_this_thread() = &listener; }
+
+EntityChangeListener::Scope::~Scope()
+    { open_on_this_thread() = m_previous; }
+
+/* static */ void EntityChangeListener::notify(const Entity & e) {
+    if (auto * listener = open_on_this_thread())
+        { listener->on_entity_changed(e); }
+}
+
+/* private static */ EntityChangeListener *& EntityChangeListener::open_on_this_thread() {
+    thread_local EntityChangeListener * inst = nullptr;
+    return inst;
 }
 
 // ----------------------------------------------------------------------------
@@ -419,6 +439,7 @@ std::unique_ptr<LinkedOnBoxHit<Func>>
 
     m_bouncable.remove<TriggerBox>();
     m_bouncable.get<PhysicsComponent>().reset_state<Rect>();
+    EntityChangeListener::notify(m_bouncable);
 }
 
 /* private */ void BalloonScript::on_update(Entity e, double) {
@@ -449,6 +470,7 @@ std::unique_ptr<LinkedOnBoxHit<Func>>
     launcher.launch_velocity = m_bounce;
     auto & rect = m_bouncable.ensure<PhysicsComponent>().reset_state<Rect>();
     rect.width = rect.height = m_radius;
+    EntityChangeListener::notify(m_bouncable);
     sync_bouncable_location_to(e);
 }
 
@@ -508,6 +530,7 @@ void LeavesDecorScript::make_leaf_fall(Entity other, VectorD r) {
     m_falling_leaves.insert(itr, leaf_ent);
 #   endif
     leaf_ent.add<DecoItem>();
+    EntityChangeListener::notify(leaf_ent);
     std::cout << "made leaf" << std::endl;
     check_invarients();
 }
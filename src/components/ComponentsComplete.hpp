@@ -143,6 +143,41 @@ struct EntityHasher {
     std::size_t operator () (const Entity & e) const { return e.hash(); }
 };
 
+/// Told of entities made, and components added or removed, since the ecs
+/// library has no hooks of its own. Each thread has at most one listener open.
+///
+/// Anything which adds or removes components while the game is running calls
+/// notify afterward. Changes while no listener is open (like loading a map)
+/// are only picked up by whatever the listener does to catch up wholesale.
+class EntityChangeListener {
+public:
+    class Scope final {
+    public:
+        explicit Scope(EntityChangeListener &);
+
+        Scope(const Scope &) = delete;
+        Scope & operator = (const Scope &) = delete;
+
+        ~Scope();
+
+    private:
+        EntityChangeListener * m_previous;
+    };
+
+    /// tells the listener open on this thread (if any) that e was made, or
+    /// had components added or removed
+    static void notify(const Entity &);
+
+protected:
+    EntityChangeListener() {}
+    ~EntityChangeListener() {}
+
+    virtual void on_entity_changed(const Entity &) = 0;
+
+private:
+    static EntityChangeListener *& open_on_this_thread();
+};
+
 inline Script * get_script(Entity e) {
     if (auto * uptrptr = e.ptr<ScriptUPtr>()) return uptrptr->get();
     return nullptr;
@@ -21,6 +21,16 @@
 
 #include "ComponentsComplete.hpp"
 
+#include <utility>
+
+#include <cassert>
+
+namespace {
+
+inline double cross_magnitude(VectorD a, VectorD b) { return a.x*b.y - a.y*b.x; }
+
+} // end of <anonymous> namespace
+
 LineTracker::LineTracker(const LineTracker & rhs):
     inverted_normal(rhs.inverted_normal),
     position       (rhs.position       ),
@@ -44,12 +54,77 @@ LineTracker & LineTracker::operator = (LineTracker && rhs) {
     return *this;
 }
 
+DeferredSurfaceCallbacks::Scope::Scope(DeferredSurfaceCallbacks & callbacks):
+    m_previous(open_on_this_thread())
+{ open_on_this_thread() = &callbacks; }
+
+DeferredSurfaceCallbacks::Scope::~Scope()
+    { open_on_this_thread() = m_previous; }
+
+void DeferredSurfaceCallbacks::call_all() {
+    // anything the scripts themselves set off happens right away
+    auto * previous = std::exchange(open_on_this_thread(), nullptr);
+    for (const auto & call : m_calls) {
+        make_call(call);
+    }
+    m_calls.clear();
+    open_on_this_thread() = previous;
+}
+
+/* static */ void DeferredSurfaceCallbacks::on_landing
+    (EntityRef surface_owner, VectorD impact_vel, EntityRef tracker_owner)
+{
+    Call call;
+    call.is_landing    = true;
+    call.surface_owner = surface_owner;
+    call.tracker_owner = tracker_owner;
+    call.impact_vel    = impact_vel;
+    if (auto * deferred = open_on_this_thread()) {
+        deferred->m_calls.push_back(call);
+    } else {
+        make_call(call);
+    }
+}
+
+/* static */ void DeferredSurfaceCallbacks::on_departing
+    (EntityRef surface_owner, EntityRef tracker_owner)
+{
+    Call call;
+    call.surface_owner = surface_owner;
+    call.tracker_owner = tracker_owner;
+    if (auto * deferred = open_on_this_thread()) {
+        deferred->m_calls.push_back(call);
+    } else {
+        make_call(call);
+    }
+}
+
+/* private static */ DeferredSurfaceCallbacks *&
+    DeferredSurfaceCallbacks::open_on_this_thread()
+{
+    thread_local DeferredSurfaceCallbacks * inst = nullptr;
+    return inst;
+}
+
+/* private static */ void DeferredSurfaceCallbacks::make_call(const Call & call) {
+    Entity e { call.surface_owner };
+    if (!e) return;
+    auto * script = e.ptr<ScriptUPtr>();
+    if (!script) return;
+    if (call.is_landing) {
+        (**script).on_landing(e, call.impact_vel, call.tracker_owner);
+    } else {
+        (**script).on_departing(e, call.tracker_owner);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 LineTracker::~LineTracker() {
     if (!m_owning_entity) return;
-    if (Entity e = Entity(m_surface_ref.attached_entity())) {
-        if (auto * script = e.ptr<ScriptUPtr>()) {
-            (**script).on_departing(e, m_owning_entity);
-        }
+    if (m_surface_ref.attached_entity()) {
+        DeferredSurfaceCallbacks::on_departing
+            (m_surface_ref.attached_entity(), m_owning_entity);
     }
 }
 
@@ -57,15 +132,13 @@ void LineTracker::set_surface_ref(const SurfaceRef & ref, VectorD impact_vel) {
     bool is_internal_transfer = (   m_surface_ref.attached_entity()
                                  && m_surface_ref.attached_entity() == ref.attached_entity());
     if (m_owning_entity && m_surface_ref != ref && !is_internal_transfer) {
-        if (Entity e = Entity(m_surface_ref.attached_entity())) {
-            if (auto * script = e.ptr<ScriptUPtr>()) {
-                (**script).on_departing(e, m_owning_entity);
-            }
+        if (m_surface_ref.attached_entity()) {
+            DeferredSurfaceCallbacks::on_departing
+                (m_surface_ref.attached_entity(), m_owning_entity);
         }
-        if (Entity e = Entity(ref.attached_entity())) {
-            if (auto * script = e.ptr<ScriptUPtr>()) {
-                (**script).on_landing(e, impact_vel, m_owning_entity);
-            }
+        if (ref.attached_entity()) {
+            DeferredSurfaceCallbacks::on_landing
+                (ref.attached_entity(), impact_vel, m_owning_entity);
         }
     }
     m_surface_ref = ref;
@@ -137,6 +210,54 @@ VectorD normal_for(const LineSegment & segment, bool inverted_normal) {
     return normalize(rotate_vector(segment.b - segment.a, perp));
 }
 
+double angle_between(const LineSegment & old, const LineSegment & new_,
+                     bool inverted_normal_on_old)
+{
+    assert(!are_very_close(old.a, old.b));
+    assert(!are_very_close(new_.a, new_.b));
+    const VectorD * pivot     = nullptr;
+    const VectorD * extremity = nullptr;
+    const VectorD * other_ext = nullptr;
+    if (are_very_close(old.a, new_.b)) {
+        pivot = &old.a;
+        extremity = &old.b;
+
+        other_ext = &new_.a;
+    } else if (are_very_close(old.b, new_.a)) {
+        pivot = &old.b;
+        extremity = &old.a;
+
+        other_ext = &new_.b;
+    } else if (are_very_close(old.a, new_.a)) {
+        pivot = &old.a;
+        extremity = &old.b;
+
+        other_ext = &new_.b;
+    } else if (are_very_close(old.b, new_.b)) {
+        pivot = &old.b;
+        extremity = &old.a;
+
+        other_ext = &new_.a;
+    } else {
+        throw std::invalid_argument("angle_between: segments do not connect");
+    }
+    assert(pivot && extremity && other_ext);
+    auto saught = normal_for(old, inverted_normal_on_old) + (old.a + old.b)*0.5;
+    auto shortest_ang = angle_between(*extremity - *pivot, *other_ext - *pivot);
+
+    if (magnitude(shortest_ang - k_pi) < k_error) return k_pi;
+
+    auto cross_z = cross_magnitude(saught - *pivot, *extremity - *pivot);
+    assert(cross_z != 0.);
+    shortest_ang *= (cross_z > 0.) ? -1. : 1.;
+    if (magnitude(normalize(rotate_vector(*extremity - *pivot, shortest_ang)) -
+                  normalize(              *other_ext - *pivot              )) < k_error)
+    {
+        return magnitude(shortest_ang);
+    }
+    return 2*k_pi - magnitude(shortest_ang);
+}
+
 VectorD location_of(const LineTracker & tracker) {
     return location_along(tracker.position, *tracker.surface_ref());
 }
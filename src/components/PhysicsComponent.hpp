@@ -61,6 +61,50 @@ private:
     EntityRef m_owning_entity;
 };
 
+/// Line trackers call scripts on surfaces they land on and depart from. While
+/// a scope is open on a thread, those calls are queued here instead, to be
+/// made later (and in a known order) on one thread.
+class DeferredSurfaceCallbacks final {
+public:
+    class Scope final {
+    public:
+        explicit Scope(DeferredSurfaceCallbacks &);
+
+        Scope(const Scope &) = delete;
+        Scope & operator = (const Scope &) = delete;
+
+        ~Scope();
+
+    private:
+        DeferredSurfaceCallbacks * m_previous;
+    };
+
+    /// makes all queued calls, in the order they were queued
+    void call_all();
+
+    bool is_empty() const noexcept { return m_calls.empty(); }
+
+    // used by line trackers, calls right away if no scope is open
+    static void on_landing(EntityRef surface_owner, VectorD impact_vel,
+                           EntityRef tracker_owner);
+
+    static void on_departing(EntityRef surface_owner, EntityRef tracker_owner);
+
+private:
+    struct Call {
+        bool is_landing = false;
+        EntityRef surface_owner;
+        EntityRef tracker_owner;
+        VectorD impact_vel;
+    };
+
+    static DeferredSurfaceCallbacks *& open_on_this_thread();
+
+    static void make_call(const Call &);
+
+    std::vector<Call> m_calls;
+};
+
 class ItemPickerPriv;
 struct HeldState {
     friend class ItemPickerPriv;
@@ -87,6 +131,10 @@ struct PhysicsComponent : public ecs::InlinedComponent {
 
     bool affected_by_gravity = true;
 
+    // time owed from updates cut short, made up on following updates
+    // (see EnvColParams)
+    double et_debt = 0.;
+
     template <typename Type>
     Type & reset_state() { return m_state.reset<Type>(); }
 
@@ -121,5 +169,16 @@ VectorD location_of(const LineTracker &);
 
 VectorD normal_for(const LineSegment &, bool inverted_normal);
 
+inline VectorD normal_for(const Surface & surface, bool inverted_normal) {
+    return inverted_normal ? surface.geometry.inverted_normal
+                           : surface.geometry.normal;
+}
+
+/// angle a tracker turns through going from one segment onto another, which
+/// must share an end point
+/// @throws if the segments do not connect
+double angle_between(const LineSegment & old, const LineSegment & new_,
+                     bool inverted_normal_on_old);
+
 inline VectorD normal_for(const LineTracker & tracker)
     { return normal_for(*tracker.surface_ref(), tracker.inverted_normal); }
@@ -57,6 +57,28 @@ std::size_t Platform::previous_surface(std::size_t idx) const noexcept {
 Surface Platform::get_surface(std::size_t idx) const
     { return move_surface(m_surfaces.at(idx), m_offset); }
 
+void Platform::set_surfaces(std::vector<Surface> && surfaces) {
+    m_surfaces = std::move(surfaces);
+    ++m_bounds_version;
+    // surfaces may have been built up a point at a time
+    for (auto & surf : m_surfaces)
+        { surf.geometry = compute_geometry(surf); }
+    m_local_bounds = Rect();
+    if (m_surfaces.empty()) return;
+
+    VectorD low  = m_surfaces.front().a;
+    VectorD high = low;
+    for (const auto & surf : m_surfaces) {
+        for (auto pt : { surf.a, surf.b }) {
+            low .x = std::min(low .x, pt.x);
+            low .y = std::min(low .y, pt.y);
+            high.x = std::max(high.x, pt.x);
+            high.y = std::max(high.y, pt.y);
+        }
+    }
+    m_local_bounds = Rect(low.x, low.y, high.x - low.x, high.y - low.y);
+}
+
 /* private */ bool Platform::surfaces_cycle() const noexcept {
     if (m_surfaces.size() < 2) return false;
     return are_very_close(m_surfaces.front().a, m_surfaces.back().b);
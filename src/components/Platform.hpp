@@ -87,10 +87,28 @@ public:
 
     Surface get_surface(std::size_t) const;
 
-    void set_surfaces(std::vector<Surface> && surfaces)
-        { m_surfaces = std::move(surfaces); }
+    void set_surfaces(std::vector<Surface> && surfaces);
 
-    void set_offset(VectorD r) { m_offset = r; }
+    void set_offset(VectorD r) {
+        if (r == m_offset) return;
+        m_offset = r;
+        ++m_bounds_version;
+    }
+
+    VectorD offset() const noexcept { return m_offset; }
+
+    /// surfaces without the offset applied
+    const std::vector<Surface> & local_surfaces() const noexcept
+        { return m_surfaces; }
+
+    /** @returns bounding box of all surfaces, with the offset applied */
+    Rect bounds() const
+        { return Rect(m_local_bounds.left + m_offset.x, m_local_bounds.top + m_offset.y,
+                      m_local_bounds.width, m_local_bounds.height); }
+
+    /// changes whenever bounds may have, so that anything keeping bounds
+    /// (like the broadphase) only has to look at those which moved
+    unsigned bounds_version() const noexcept { return m_bounds_version; }
 
 private:
     bool surfaces_cycle() const noexcept;
@@ -99,6 +117,9 @@ private:
 
     std::vector<Surface> m_surfaces;
     VectorD m_offset;
+    // surfaces' bounds, before the offset
+    Rect m_local_bounds;
+    unsigned m_bounds_version = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -21,9 +21,16 @@
 #include "GameDriver.hpp"
 #include "GenBuiltinTileSet.hpp"
 #include "Log.hpp"
+#include "Benchmarks.hpp"
 
 #include "maps/MapLinks.hpp"
+#include "maps/MapMultiplexer.hpp"
+#include "maps/LineMapLoader.hpp"
 #include "components/Platform.hpp"
+#include "systems/SegmentBatch.hpp"
+#include "systems/SystemScheduler.hpp"
+#include "systems/EntityQuery.hpp"
+#include "systems/DrawSystems.hpp"
 
 #include <tmap/TiledMap.hpp>
 
@@ -483,6 +490,34 @@ void save_builtin_tileset(StartupOptions &, char ** beg, char ** end);
 
 void test_backdrop(StartupOptions &, char ** beg, char ** end);
 
+void set_headless(StartupOptions &, char ** beg, char ** end);
+
+int run_headless(const StartupOptions &);
+
+void set_record_file(StartupOptions &, char ** beg, char ** end);
+
+void set_replay_file(StartupOptions &, char ** beg, char ** end);
+
+int run_replay(const StartupOptions &);
+
+void bench_physics(StartupOptions &, char ** beg, char ** end);
+
+void bench_map_load(StartupOptions &, char ** beg, char ** end);
+
+void bench_entities(StartupOptions &, char ** beg, char ** end);
+
+void set_profile_systems(StartupOptions &, char **, char **);
+
+void set_trace_file(StartupOptions &, char ** beg, char ** end);
+
+void set_draw_stats(StartupOptions &, char **, char **);
+
+void set_system_threads(StartupOptions &, char ** beg, char ** end);
+
+void set_variable_step(StartupOptions &, char **, char **);
+
+void compile_map(StartupOptions &, char ** beg, char ** end);
+
 class FrameTimer {
 public:
     static constexpr const int k_default_fps = 80;
@@ -586,15 +621,31 @@ int main(int argc, char ** argv) {
     ipv.push_back(1);
     }
     MapLinks::run_tests();
+    MapMultiplexer::run_tests();
     std::cout << &k_gravity << std::endl;
 
     StartupOptions opts = cul::parse_options<StartupOptions>(argc, argv, {
         { "test-map"            , 'm', load_test_map        },
         { "save-builtin-tileset", 's', save_builtin_tileset },
-        { "test-backdrop"       ,  0 , test_backdrop        }
+        { "test-backdrop"       ,  0 , test_backdrop        },
+        { "headless"            ,  0 , set_headless         },
+        { "record"              , 'r', set_record_file      },
+        { "replay"              ,  0 , set_replay_file      },
+        { "bench-physics"       ,  0 , bench_physics        },
+        { "bench-map-load"      ,  0 , bench_map_load       },
+        { "bench-entities"      ,  0 , bench_entities       },
+        { "profile-systems"     , 'p', set_profile_systems  },
+        { "trace"               , 't', set_trace_file       },
+        { "draw-stats"          ,  0 , set_draw_stats       },
+        { "system-threads"      ,  0 , set_system_threads   },
+        { "variable-step"       ,  0 , set_variable_step    },
+        { "compile-map"         ,  0 , compile_map          }
     });
 
     if (opts.quit_before_game) return 0;
+    TraceRecorder::Session trace_session(opts.trace_file);
+    if (!opts.replay_file.empty()) return run_replay(opts);
+    if (opts.headless_frames > 0) return run_headless(opts);
 
     {
     PlayerControl pc;
@@ -614,13 +665,24 @@ int main(int argc, char ** argv) {
     GameDriver gdriver;
 
     EnvironmentCollisionSystem::run_tests();
+    PlatformBroadphase::run_tests();
+    SegmentBatch::run_tests();
+    SystemScheduler::run_tests();
+    EntityQueryIndex::run_tests();
+    DrawSystem::run_tests();
     auto timer = FrameTimer::make_sfml_timer();
     //FrameTimer::make_stl_timer();
 
     win.create(sf::VideoMode(k_view_width*3, k_view_height*3), "Bouncy Bouncy UwU");
     win.setKeyRepeatEnabled(false);
 
+    {
+    StageTimings load_timings;
+    StageTimings::Collecting collecting(load_timings);
     gdriver.setup(opts, win.getView());
+    std::cout << "Loaded \"" << opts.test_map << "\":\n";
+    load_timings.print(std::cout);
+    }
     bool frame_advance_enabled = false;
     bool do_this_frame         = true ;
     timer->prepare_window(win);
@@ -659,7 +721,11 @@ int main(int argc, char ** argv) {
         }
         win.clear(sf::Color(100, 100, 255));
         if (do_this_frame) {
-            gdriver.update(timer->get_elapsed_time());
+            if (opts.variable_step) {
+                gdriver.update(timer->get_elapsed_time());
+            } else {
+                gdriver.update_fixed_steps(timer->get_elapsed_time());
+            }
         }
         timer->on_between_frames();
 
@@ -698,6 +764,7 @@ int main(int argc, char ** argv) {
         win.display();
 
     }
+    gdriver.on_exit();
     return 0;
 }
 
@@ -717,6 +784,176 @@ void save_builtin_tileset(StartupOptions &, char ** beg, char ** end) {
     to_image(generate_atlas()).saveToFile(*beg);
 }
 
+void set_headless(StartupOptions & opts, char ** beg, char ** end) {
+    static auto parse_positive = [](const char * arg, const char * what) {
+        double x = 0.;
+        if (!cul::string_to_number(arg, arg + ::strlen(arg), x)) {
+            throw std::invalid_argument(std::string("headless ") + what + " must be numeric");
+        }
+        if (x <= 0.) {
+            throw std::invalid_argument(std::string("headless ") + what + " must be positive");
+        }
+        return x;
+    };
+    if (beg == end) {
+        throw std::runtime_error("headless requires at least one argument (number of frames)");
+    }
+    opts.headless_frames = round_to<int>(parse_positive(*beg, "frame count"));
+    if (end - beg > 1) {
+        opts.headless_step = parse_positive(*(beg + 1), "time step");
+    }
+}
+
+int run_headless(const StartupOptions & opts) {
+    using Clock = std::chrono::steady_clock;
+    GameDriver gdriver;
+    gdriver.setup_headless(opts);
+
+    auto start = Clock::now();
+    for (int i = 0; i != opts.headless_frames; ++i) {
+        gdriver.update(opts.headless_step);
+    }
+    auto wall_secs = std::chrono::duration<double>(Clock::now() - start).count();
+    auto sim_secs  = double(opts.headless_frames)*opts.headless_step;
+    gdriver.on_exit();
+
+    std::cout << "Headless run of \"" << opts.test_map << "\": "
+              << opts.headless_frames << " frames ("
+              << sim_secs << "s simulated, step " << opts.headless_step
+              << "s) in " << wall_secs << "s wall time.\n"
+              << (double(opts.headless_frames) / wall_secs)
+              << " simulated frames per second ("
+              << (sim_secs / wall_secs) << "x real time)." << std::endl;
+    return 0;
+}
+
+void set_record_file(StartupOptions & opts, char ** beg, char ** end) {
+    if (beg == end) {
+        throw std::runtime_error("record requires a filename to save to");
+    }
+    opts.record_file = std::string(*beg);
+}
+
+void set_replay_file(StartupOptions & opts, char ** beg, char ** end) {
+    if (beg == end) {
+        throw std::runtime_error("replay requires a recording's filename");
+    }
+    opts.replay_file = std::string(*beg);
+}
+
+int run_replay(const StartupOptions & opts) {
+    using Clock = std::chrono::steady_clock;
+    InputRecording recording;
+    recording.load_from_file(opts.replay_file);
+
+    auto replay_opts = opts;
+    replay_opts.test_map = recording.map_filename();
+    GameDriver gdriver;
+    gdriver.setup_headless(replay_opts);
+
+    int mismatches = 0;
+    auto start = Clock::now();
+    for (const auto & frame : recording.frames()) {
+        int frame_num = int(&frame - &recording.frames().front());
+        for (const auto & event : recording.events_for_frame(frame_num)) {
+            gdriver.replay_event(event);
+        }
+        gdriver.update(frame.elapsed_time);
+        if (gdriver.state_hash() == frame.state_hash) continue;
+        if (mismatches++ == 0) {
+            std::cout << "Replay diverges from recording at frame "
+                      << frame_num << "." << std::endl;
+        }
+    }
+    auto wall_secs = std::chrono::duration<double>(Clock::now() - start).count();
+    gdriver.on_exit();
+
+    std::cout << "Replayed " << recording.frames().size() << " frames of \""
+              << recording.map_filename() << "\" in " << wall_secs << "s; "
+              << mismatches << " frame(s) did not match." << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+void bench_physics(StartupOptions & opts, char ** beg, char ** end) {
+    int repetitions = 20;
+    if (beg != end) {
+        if (!cul::string_to_number(*beg, *beg + ::strlen(*beg), repetitions)) {
+            throw std::invalid_argument("bench-physics repetitions must be numeric");
+        }
+    }
+    run_physics_benchmark(repetitions);
+    opts.quit_before_game = true;
+}
+
+void bench_map_load(StartupOptions & opts, char ** beg, char ** end) {
+    int repetitions = 10;
+    if (beg != end) {
+        if (!cul::string_to_number(*beg, *beg + ::strlen(*beg), repetitions)) {
+            throw std::invalid_argument("bench-map-load repetitions must be numeric");
+        }
+        ++beg;
+    }
+    run_map_load_benchmark(std::vector<std::string>(beg, end), repetitions);
+    opts.quit_before_game = true;
+}
+
+void bench_entities(StartupOptions & opts, char ** beg, char ** end) {
+    int frames = 120;
+    if (beg != end) {
+        if (!cul::string_to_number(*beg, *beg + ::strlen(*beg), frames)) {
+            throw std::invalid_argument("bench-entities frames must be numeric");
+        }
+        ++beg;
+    }
+    // map may also be given by test-map, but only if it appears earlier
+    run_entity_scaling_benchmark(beg == end ? opts.test_map : std::string(*beg), frames);
+    opts.quit_before_game = true;
+}
+
+void set_profile_systems(StartupOptions & opts, char **, char **)
+    { opts.profile_systems = true; }
+
+void set_trace_file(StartupOptions & opts, char ** beg, char ** end) {
+    if (beg == end) {
+        throw std::runtime_error("trace requires a filename to save to");
+    }
+    opts.trace_file = std::string(*beg);
+}
+
+void set_draw_stats(StartupOptions & opts, char **, char **)
+    { opts.draw_stats = true; }
+
+void set_system_threads(StartupOptions & opts, char ** beg, char ** end) {
+    if (beg == end) {
+        throw std::invalid_argument("system-threads requires a thread count");
+    }
+    if (!cul::string_to_number(*beg, *beg + ::strlen(*beg), opts.system_threads)) {
+        throw std::invalid_argument("system-threads thread count must be numeric");
+    }
+}
+
+void set_variable_step(StartupOptions & opts, char **, char **)
+    { opts.variable_step = true; }
+
+void compile_map(StartupOptions & opts, char ** beg, char ** end) {
+    if (beg == end) {
+        throw std::invalid_argument("compile-map requires a TMX file to compile");
+    }
+    // these write files, so they're run here rather than every launch
+    CompiledLineMap::run_tests();
+    std::string tmx_file = *beg++;
+    auto out_file = (beg == end) ? CompiledLineMap::filename_for(tmx_file) : std::string(*beg);
+
+    tmap::TiledMap tlmap;
+    tlmap.load_from_file(tmx_file);
+    LineMapLoader lml;
+    lml.load_map(tlmap);
+    lml.compile().save_to_file(out_file);
+    std::cout << "Compiled line map of \"" << tmx_file << "\" to \""
+              << out_file << "\"." << std::endl;
+    opts.quit_before_game = true;
+}
+
 static bool is_x(char c) { return c == 'x'; }
 
 void test_backdrop(StartupOptions & opts, char ** beg, char ** end) {
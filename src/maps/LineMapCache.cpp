@@ -0,0 +1,515 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "LineMapCache.hpp"
+
+#include <common/TestSuite.hpp>
+
+#include <fstream>
+#include <filesystem>
+#include <regex>
+#include <iterator>
+
+#include <cstring>
+#include <cassert>
+
+#if defined(__unix__)
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+namespace {
+
+using RtError = std::runtime_error;
+
+constexpr const char k_magic[4] = { 'R', 'G', 'L', 'M' };
+constexpr const uint32_t k_byte_order_marker = 0x01020304;
+
+// read only view of a whole file
+class MappedFile final {
+public:
+    explicit MappedFile(const std::string & filename);
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator = (const MappedFile &) = delete;
+
+    ~MappedFile();
+
+    bool is_open() const noexcept { return m_data != nullptr; }
+
+    const char * data() const noexcept { return m_data; }
+
+    std::size_t size() const noexcept { return m_size; }
+
+private:
+    const char * m_data = nullptr;
+    std::size_t m_size = 0;
+#   if !defined(__unix__)
+    std::vector<char> m_contents;
+#   endif
+};
+
+// writes to a temporary file next to the destination, which is only renamed
+// into place once everything is written, so that a reader never sees a
+// partially written file
+class CacheWriter final {
+public:
+    explicit CacheWriter(const std::string & filename):
+        m_filename(filename),
+        m_temp_filename(filename + ".part"),
+        m_out(m_temp_filename, std::ios::binary) {}
+
+    CacheWriter(const CacheWriter &) = delete;
+    CacheWriter & operator = (const CacheWriter &) = delete;
+
+    ~CacheWriter();
+
+    template <typename T>
+    void write(const T & obj) {
+        static_assert(std::is_trivially_copyable_v<T>, "");
+        m_out.write(reinterpret_cast<const char *>(&obj), sizeof(T));
+    }
+
+    /// @throws if anything failed to write, or the file can't be moved
+    ///         into place
+    void commit();
+
+private:
+    std::string m_filename;
+    std::string m_temp_filename;
+    std::ofstream m_out;
+    bool m_committed = false;
+};
+
+class CacheReader final {
+public:
+    CacheReader(const char * beg, const char * end):
+        m_pos(beg), m_end(end) {}
+
+    template <typename T>
+    T read() {
+        static_assert(std::is_trivially_copyable_v<T>, "");
+        if (std::size_t(m_end - m_pos) < sizeof(T)) {
+            throw RtError("CompiledLineMap::load_from_file: file is truncated.");
+        }
+        T rv;
+        std::memcpy(&rv, m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return rv;
+    }
+
+    bool at_end() const noexcept { return m_pos == m_end; }
+
+    std::size_t remaining() const noexcept { return std::size_t(m_end - m_pos); }
+
+private:
+    const char * m_pos;
+    const char * m_end;
+};
+
+void write_layer(CacheWriter &, const LayerSegments &);
+
+void read_layer(CacheReader &, int width, int height, LayerSegments &);
+
+void verify_layer(const LayerSegments &);
+
+// @returns external tileset (.tsx) files the TMX file refers to
+std::vector<std::string> tileset_files_of(const std::string & tmx_filename);
+
+} // end of <anonymous> namespace
+
+void CompiledLineMap::save_to_file(const std::string & filename) const {
+    CacheWriter writer(filename);
+    for (char c : k_magic) writer.write(c);
+    writer.write(k_byte_order_marker);
+    writer.write(k_version);
+
+    writer.write(tile_width );
+    writer.write(tile_height);
+    writer.write(int32_t(transitions.width ()));
+    writer.write(int32_t(transitions.height()));
+
+    write_layer(writer, foreground);
+    write_layer(writer, background);
+    for (VectorI r; r != transitions.end_position(); r = transitions.next(r)) {
+        writer.write(uint8_t(transitions(r)));
+    }
+    writer.commit();
+}
+
+bool CompiledLineMap::load_from_file(const std::string & filename) {
+    MappedFile file(filename);
+    if (!file.is_open()) return false;
+
+    CacheReader reader(file.data(), file.data() + file.size());
+    try {
+        for (char c : k_magic) {
+            if (reader.read<char>() != c) return false;
+        }
+        if (reader.read<uint32_t>() != k_byte_order_marker) return false;
+        if (reader.read<uint32_t>() != k_version) return false;
+    } catch (RtError &) {
+        // too short to even have a header, so not one of ours
+        return false;
+    }
+
+    tile_width  = reader.read<double>();
+    tile_height = reader.read<double>();
+    int width  = reader.read<int32_t>();
+    int height = reader.read<int32_t>();
+    if (width < 0 || height < 0 || tile_width <= 0. || tile_height <= 0.) {
+        throw RtError("CompiledLineMap::load_from_file: bad map or tile size.");
+    }
+    // there's at least one transition byte per tile
+    if (uint64_t(width)*uint64_t(height) > reader.remaining()) {
+        throw RtError("CompiledLineMap::load_from_file: map size is larger "
+                      "than the file allows.");
+    }
+
+    read_layer(reader, width, height, foreground);
+    read_layer(reader, width, height, background);
+    transitions.set_size(width, height, TransitionTileType::no_transition);
+    for (VectorI r; r != transitions.end_position(); r = transitions.next(r)) {
+        auto type = reader.read<uint8_t>();
+        if (type > uint8_t(TransitionTileType::to_foreground)) {
+            throw RtError("CompiledLineMap::load_from_file: bad transition tile type.");
+        }
+        transitions(r) = TransitionTileType(type);
+    }
+    if (!reader.at_end()) {
+        throw RtError("CompiledLineMap::load_from_file: trailing data after map.");
+    }
+    return true;
+}
+
+/* static */ std::string CompiledLineMap::filename_for
+    (const std::string & tmx_filename)
+{ return std::filesystem::path(tmx_filename).replace_extension(k_extension).string(); }
+
+/* static */ bool CompiledLineMap::is_current_for
+    (const std::string & tmx_filename)
+{
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    auto cache_time = fs::last_write_time(filename_for(tmx_filename), ec);
+    if (ec) return false;
+    auto tmx_time = fs::last_write_time(tmx_filename, ec);
+    if (ec || cache_time < tmx_time) return false;
+    // tiles' "lines" properties live in the tilesets, so they count too
+    for (const auto & tileset_file : tileset_files_of(tmx_filename)) {
+        auto tileset_time = fs::last_write_time(tileset_file, ec);
+        if (ec || cache_time < tileset_time) return false;
+    }
+    return true;
+}
+
+/* static */ void CompiledLineMap::run_tests() {
+    using namespace cul;
+    ts::TestSuite suite;
+    suite.start_series("CompiledLineMap tests");
+    static const std::string k_test_file =
+        (std::filesystem::temp_directory_path() / "rungun2-lmc-test.lmc").string();
+    static auto make_map = []() {
+        CompiledLineMap rv;
+        rv.tile_width = rv.tile_height = 16.;
+        rv.foreground.make_blank_of_size(2, 2);
+        rv.background.make_blank_of_size(2, 2);
+        rv.foreground.segments.emplace_back(VectorD(0, 8), VectorD(16, 8));
+        rv.foreground.segments.emplace_back(VectorD(16, 8), VectorD(32, 4));
+        rv.foreground.tiles(VectorI(1, 1)).count = 2;
+        SurfaceDetails icy;
+        icy.friction = 0.01;
+        rv.foreground.tiles(VectorI(1, 1)).details_index = rv.foreground.palette_index_of(icy);
+        rv.transitions.set_size(2, 2, TransitionTileType::no_transition);
+        rv.transitions(VectorI(0, 1)) = TransitionTileType::toggle_layers;
+        return rv;
+    };
+    suite.test([]() {
+        auto map = make_map();
+        map.save_to_file(k_test_file);
+        CompiledLineMap loaded;
+        bool ok = loaded.load_from_file(k_test_file);
+        std::filesystem::remove(k_test_file);
+        return ts::test(   ok
+                        && loaded.foreground.segments.size() == 2
+                        && loaded.foreground.segments[1].b == VectorD(32, 4)
+                        && loaded.foreground.count_at(VectorI(1, 1)) == 2
+                        && loaded.foreground.details_palette.size() == 2
+                        && loaded.foreground.details_palette[1] == map.foreground.details_palette[1]
+                        && loaded.background.segments.empty()
+                        && loaded.transitions(VectorI(0, 1)) == TransitionTileType::toggle_layers);
+    });
+    suite.test([]() {
+        // a nearly empty layer, many chunks in size, only stores the chunk
+        // in use
+        CompiledLineMap map;
+        map.tile_width = map.tile_height = 16.;
+        map.foreground.make_blank_of_size(200, 200);
+        map.background.make_blank_of_size(200, 200);
+        map.foreground.segments.emplace_back(VectorD(0, 0), VectorD(16, 16));
+        map.foreground.tiles(VectorI(150, 150)).count = 1;
+        map.transitions.set_size(200, 200, TransitionTileType::no_transition);
+        map.save_to_file(k_test_file);
+        CompiledLineMap loaded;
+        bool ok = loaded.load_from_file(k_test_file);
+        std::filesystem::remove(k_test_file);
+        return ts::test(   ok
+                        && loaded.foreground.tiles.allocated_chunk_count() == 1
+                        && loaded.background.tiles.allocated_chunk_count() == 0
+                        && loaded.foreground.count_at(VectorI(150, 150)) == 1
+                        && loaded.foreground.count_at(VectorI(149, 150)) == 0);
+    });
+    suite.test([]() {
+        CompiledLineMap map;
+        return ts::test(!map.load_from_file(k_test_file));
+    });
+    suite.test([]() {
+        make_map().save_to_file(k_test_file);
+        // chop off the transitions
+        std::filesystem::resize_file(k_test_file, std::filesystem::file_size(k_test_file) - 2);
+        bool threw = false;
+        try {
+            CompiledLineMap map;
+            map.load_from_file(k_test_file);
+        } catch (RtError &) {
+            threw = true;
+        }
+        std::filesystem::remove(k_test_file);
+        return ts::test(threw);
+    });
+    suite.test([]() {
+        // a segment count the file can't hold is caught before allocating
+        auto map = make_map();
+        map.save_to_file(k_test_file);
+        {
+        std::fstream file(k_test_file, std::ios::binary | std::ios::in | std::ios::out);
+        // foreground segment count follows the header and map size
+        file.seekp(sizeof(k_magic) + sizeof(uint32_t)*2 + sizeof(double)*2 + sizeof(int32_t)*2);
+        uint32_t huge_count = 0x40000000;
+        file.write(reinterpret_cast<const char *>(&huge_count), sizeof(huge_count));
+        }
+        bool threw = false;
+        try {
+            CompiledLineMap loaded;
+            loaded.load_from_file(k_test_file);
+        } catch (RtError &) {
+            threw = true;
+        }
+        std::filesystem::remove(k_test_file);
+        return ts::test(threw);
+    });
+    suite.test([]() {
+        // saving leaves no temporary file behind
+        make_map().save_to_file(k_test_file);
+        bool no_temp = !std::filesystem::exists(k_test_file + ".part");
+        std::filesystem::remove(k_test_file);
+        return ts::test(no_temp);
+    });
+    suite.test([]() {
+        // a newer tileset makes the compiled map out of date
+        namespace fs = std::filesystem;
+        auto dir = fs::temp_directory_path();
+        auto tmx_file = (dir / "rungun2-lmc-test.tmx").string();
+        auto tsx_file = (dir / "rungun2-lmc-test.tsx").string();
+        {
+        std::ofstream(tmx_file) << "<map>\n <tileset firstgid=\"1\" "
+                                   "source=\"rungun2-lmc-test.tsx\"/>\n</map>\n";
+        std::ofstream(tsx_file) << "<tileset/>\n";
+        }
+        make_map().save_to_file(filename_for(tmx_file));
+        auto now = fs::last_write_time(filename_for(tmx_file));
+        fs::last_write_time(tmx_file, now - std::chrono::hours(1));
+        fs::last_write_time(tsx_file, now - std::chrono::hours(1));
+        bool current_before = is_current_for(tmx_file);
+        fs::last_write_time(tsx_file, now + std::chrono::hours(1));
+        bool current_after = is_current_for(tmx_file);
+        for (const auto & file : { tmx_file, tsx_file, filename_for(tmx_file) })
+            { fs::remove(file); }
+        return ts::test(current_before && !current_after);
+    });
+}
+
+namespace {
+
+#if defined(__unix__)
+
+MappedFile::MappedFile(const std::string & filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void * addr = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            m_data = static_cast<const char *>(addr);
+            m_size = std::size_t(st.st_size);
+        }
+    }
+    // mapping stays valid after closing
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) ::munmap(const_cast<char *>(m_data), m_size);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string & filename) {
+    std::ifstream fin(filename, std::ios::binary);
+    if (!fin) return;
+    m_contents.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    if (m_contents.empty()) return;
+    m_data = m_contents.data();
+    m_size = m_contents.size();
+}
+
+MappedFile::~MappedFile() {}
+
+#endif
+
+CacheWriter::~CacheWriter() {
+    if (m_committed) return;
+    m_out.close();
+    std::error_code ec;
+    std::filesystem::remove(m_temp_filename, ec);
+}
+
+void CacheWriter::commit() {
+    m_out.close();
+    if (!m_out) {
+        throw RtError("CompiledLineMap::save_to_file: failed to write \""
+                      + m_temp_filename + "\".");
+    }
+    std::error_code ec;
+    std::filesystem::rename(m_temp_filename, m_filename, ec);
+    if (ec) {
+        throw RtError("CompiledLineMap::save_to_file: failed to move \""
+                      + m_temp_filename + "\" to \"" + m_filename + "\": "
+                      + ec.message());
+    }
+    m_committed = true;
+}
+
+void write_layer(CacheWriter & writer, const LayerSegments & layer) {
+    writer.write(uint32_t(layer.segments.size()));
+    writer.write(uint32_t(layer.details_palette.size()));
+    for (const auto & seg : layer.segments) {
+        for (double x : { seg.a.x, seg.a.y, seg.b.x, seg.b.y })
+            { writer.write(x); }
+    }
+    // only allocated chunks are written, and so only their tiles
+    writer.write(uint32_t(layer.tiles.allocated_chunk_count()));
+    for (std::size_t i = 0; i != layer.tiles.chunk_count(); ++i) {
+        if (layer.tiles.is_allocated(i)) writer.write(uint32_t(i));
+    }
+    const auto & tiles = layer.tiles;
+    for (auto r = tiles.begin_position(); r != tiles.end_position(); r = tiles.next(r)) {
+        const auto & tile = tiles(r);
+        writer.write(tile.offset);
+        writer.write(tile.count);
+        writer.write(tile.details_index);
+    }
+    for (const auto & details : layer.details_palette) {
+        writer.write(details.friction);
+        writer.write(details.stop_speed);
+        writer.write(uint8_t(details.hard_ceilling ? 1 : 0));
+    }
+}
+
+void read_layer(CacheReader & reader, int width, int height, LayerSegments & layer) {
+    auto segment_count = reader.read<uint32_t>();
+    auto palette_size  = reader.read<uint32_t>();
+    if (palette_size == 0 || palette_size > uint32_t(LayerSegments::k_max_palette_size)) {
+        throw RtError("CompiledLineMap::load_from_file: bad palette size.");
+    }
+    if (uint64_t(segment_count)*sizeof(double)*4 > reader.remaining()) {
+        throw RtError("CompiledLineMap::load_from_file: segment count is larger "
+                      "than the file allows.");
+    }
+    layer.make_blank_of_size(width, height);
+    layer.segments.reserve(segment_count);
+    for (uint32_t i = 0; i != segment_count; ++i) {
+        auto ax = reader.read<double>();
+        auto ay = reader.read<double>();
+        auto bx = reader.read<double>();
+        auto by = reader.read<double>();
+        layer.segments.emplace_back(ax, ay, bx, by);
+    }
+    auto chunk_count = reader.read<uint32_t>();
+    if (uint64_t(chunk_count)*sizeof(uint32_t) > reader.remaining()) {
+        throw RtError("CompiledLineMap::load_from_file: chunk count is larger "
+                      "than the file allows.");
+    }
+    for (uint32_t i = 0; i != chunk_count; ++i) {
+        auto chunk_index = reader.read<uint32_t>();
+        if (chunk_index >= layer.tiles.chunk_count()) {
+            throw RtError("CompiledLineMap::load_from_file: chunk is not on the layer.");
+        }
+        layer.tiles.allocate_chunk(chunk_index);
+    }
+    auto & tiles = layer.tiles;
+    for (auto r = tiles.begin_position(); r != tiles.end_position(); r = tiles.next(r)) {
+        auto & tile = tiles(r);
+        tile.offset        = reader.read<uint32_t>();
+        tile.count         = reader.read<uint8_t >();
+        tile.details_index = reader.read<uint8_t >();
+    }
+    layer.details_palette.clear();
+    for (uint32_t i = 0; i != palette_size; ++i) {
+        SurfaceDetails details;
+        details.friction      = reader.read<double >();
+        details.stop_speed    = reader.read<double >();
+        details.hard_ceilling = reader.read<uint8_t>() != 0;
+        layer.details_palette.push_back(details);
+    }
+    verify_layer(layer);
+    layer.update_geometry();
+}
+
+void verify_layer(const LayerSegments & layer) {
+    const auto & tiles = layer.tiles;
+    for (auto r = tiles.begin_position(); r != tiles.end_position(); r = tiles.next(r)) {
+        const auto & tile = tiles(r);
+        if (   std::size_t(tile.offset) + tile.count > layer.segments.size()
+            || tile.details_index >= layer.details_palette.size())
+        {
+            throw RtError("CompiledLineMap::load_from_file: tile refers to "
+                          "segments or details which do not exist.");
+        }
+    }
+}
+
+std::vector<std::string> tileset_files_of(const std::string & tmx_filename) {
+    std::ifstream fin(tmx_filename);
+    std::string contents { std::istreambuf_iterator<char>(fin),
+                           std::istreambuf_iterator<char>() };
+    static const std::regex k_tileset_source
+        { R"re(<tileset\b[^>]*\bsource\s*=\s*"([^"]*)")re" };
+    // sources are relative to the TMX file
+    auto dir = std::filesystem::path(tmx_filename).parent_path();
+    std::vector<std::string> rv;
+    for (std::sregex_iterator itr(contents.begin(), contents.end(), k_tileset_source), end;
+         itr != end; ++itr)
+    { rv.push_back((dir / (*itr)[1].str()).string()); }
+    return rv;
+}
+
+} // end of <anonymous> namespace
@@ -0,0 +1,75 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "Maps.hpp"
+
+#include <string>
+
+/** Collision data of a line map, compiled from a TMX file ahead of time (see
+ *  the "compile-map" option) so that starting a map needn't parse every
+ *  tile's "lines" property again.
+ *
+ *  Files are loaded by mapping them into memory. Neighbor tables and segment
+ *  geometry are cheap to rebuild, and so aren't stored.
+ *
+ *  Layout, all in native byte order:
+ *  - header: "RGLM", byte order marker (uint32), version (uint32)
+ *  - tile width, tile height (doubles), width, height (int32s)
+ *  - foreground then background layer, each:
+ *    - segment count, palette size (uint32s)
+ *    - segments (four doubles each)
+ *    - allocated chunk count, then each allocated chunk's index (uint32s)
+ *    - tiles of allocated chunks only, in chunked grid order (uint32 offset,
+ *      uint8 count, uint8 details index)
+ *    - palette (friction and stop speed doubles, uint8 hard ceiling)
+ *  - transition tile types, in grid order (uint8s)
+ */
+struct CompiledLineMap final {
+    // bump this whenever the layout changes, old files are then ignored
+    static constexpr const uint32_t k_version = 2;
+    static constexpr const char * k_extension = ".lmc";
+
+    double tile_width  = 0.;
+    double tile_height = 0.;
+    LayerSegments foreground;
+    LayerSegments background;
+    TransitionGrid transitions;
+
+    /// writes to a temporary file first, which replaces the file only once
+    /// it's complete
+    /// @throws if the file cannot be written
+    void save_to_file(const std::string & filename) const;
+
+    /// @returns false if the file is missing, isn't a compiled line map, or
+    ///          is of another version or byte order
+    /// @throws if the file looks like a compiled line map, but is truncated or
+    ///         otherwise inconsistent
+    bool load_from_file(const std::string & filename);
+
+    /// where the compiled line map for a TMX file is kept
+    static std::string filename_for(const std::string & tmx_filename);
+
+    /// @returns true if there's a compiled line map for the TMX file, which
+    ///          is at least as new as it and every tileset file it uses
+    static bool is_current_for(const std::string & tmx_filename);
+
+    static void run_tests();
+};
@@ -18,7 +18,9 @@
 *****************************************************************************/
 
 #include "LineMapLoader.hpp"
+#include "MapTileIndex.hpp"
 #include "../GridRange.hpp"
+#include "../StageTimer.hpp"
 
 #include <tmap/TiledMap.hpp>
 #include <tmap/TileLayer.hpp>
@@ -30,19 +32,10 @@ namespace {
 
 using RtError           = std::runtime_error;
 using InvArg            = std::invalid_argument;
-using SegmentsPtr       = LineMapLoader::SegmentsPtr;
-using LineViewMap       = LineMapLoader::LineViewMap;
-using TilePropertyMap   = tmap::TileLayer::PropertyMap;
 using TileInfo          = LineMapLoader::TileInfo;
 using SegmentMap        = LineMapLoader::SegmentMap;
-using SurfaceDetailsPtr = LineMapLoader::SurfaceDetailsPtr;
-using SurfaceDetailsMap = LineMapLoader::SurfaceDetailsMap;
 using SegmentsInfo      = LineMapLoader::SegmentsInfo;
 
-using cul::for_split;
-using cul::string_to_number;
-using cul::trim;
-
 /// value known from TilEd as the universally "empty" tile
 constexpr const int k_empty_tile_gid = 0;
 
@@ -53,15 +46,8 @@ Grid<int> get_layer_gids(const tmap::TiledMap &, int width, int height,
 
 Grid<int> get_layer_gids(const tmap::TiledMap &, const SegmentMap &, const char * layer_name);
 
-std::pair<SegmentsPtr, LineViewMap> produce_segment_view_map(const SegmentsInfo &);
-
-std::pair<SurfaceDetailsPtr, SurfaceDetailsMap>
-    produce_surface_details_map(const SegmentsInfo &);
-
 void overwrite_layer(Grid<int> &, const Grid<int> &, const char * layer_name);
 
-TileInfo load_tile_info(const TilePropertyMap &);
-
 template <typename Type>
 GridRange<Type> compute_range_for_tiles
     (Grid<Type> &, VectorD a, VectorD b, double tile_width, double tile_height);
@@ -72,14 +58,23 @@ const tmap::TileLayer * find_tile_layer(const tmap::TiledMap &, const char * nam
 } // end of <anonymous> namespace
 
 void LineMapLoader::load_map(const tmap::TiledMap & map) {
+    MapTileIndex tile_index;
+    tile_index.load_from(map);
+    load_map(map, tile_index);
+}
+
+void LineMapLoader::load_map
+    (const tmap::TiledMap & map, const MapTileIndex & tile_index)
+{
+    StageTimer load_timer("LineMapLoader::load_map");
     {
-    auto tsize = load_tile_size(map);
+    auto tsize = tile_index.tile_size();
     m_tile_width = tsize.width;
     m_tile_height = tsize.height;
     }
 
     assert(has_tile_size_initialized());
-    auto nfo = load_tileset_map(map, tile_width(), tile_height());
+    const auto & nfo = tile_index.segments_info();
 
     auto groundgids = get_layer_gids(map, nfo.segment_map, k_ground);
     int width  = groundgids.width ();
@@ -87,55 +82,74 @@ void LineMapLoader::load_map(const tmap::TiledMap & map) {
     auto foregids = get_layer_gids(map, width, height, nfo.segment_map, k_foreground);
     auto backgids = get_layer_gids(map, width, height, nfo.segment_map, k_background);
 
+    {
+    StageTimer timer("overwrite_layer");
     overwrite_layer(foregids, groundgids, k_foreground);
     overwrite_layer(backgids, groundgids, k_background);
+    }
 
-    auto [segs     , segs_map    ] = produce_segment_view_map   (nfo);
-    auto [surf_dets, surf_det_map] = produce_surface_details_map(nfo);
+    load_layers(nfo, foregids, backgids);
 
-    m_segments = segs;
-    m_details  = surf_dets;
+    load_transition_tiles(map, m_transition_tiles);
+}
 
-    auto layers = {
-        std::make_tuple(foregids, std::ref(m_foreground), std::ref(m_foreground_details)),
-        std::make_tuple(backgids, std::ref(m_background), std::ref(m_background_details))
-    };
-    for (auto & [grid, seggrid, detgrid] : layers) {
-        seggrid.set_size(width, height);
-        detgrid.set_size(width, height, nullptr);
-        assert(grid.width() == seggrid.width() && grid.height() == seggrid.height());
-        assert(detgrid.width() == seggrid.width() && detgrid.height() == seggrid.height());
-        for (VectorI r; r != grid.end_position(); r = grid.next(r)) {
-            if (grid(r) == k_empty_tile_gid) continue;
-            auto segitr = segs_map    .find(grid(r));
-            auto detitr = surf_det_map.find(grid(r));
-            if (segitr == segs_map.end() || detitr == surf_det_map.end()) {
-                throw RtError("LineMapLoader::load_map: non empty tile has missing info");
-            }
-            seggrid(r) = segitr->second;
-            detgrid(r) = detitr->second;
-        }
+void LineMapLoader::load_map
+    (const SegmentsInfo & nfo, const Grid<int> & foregids,
+     const Grid<int> & backgids, TileSize tsize)
+{
+    if (   foregids.width () != backgids.width ()
+        || foregids.height() != backgids.height())
+    {
+        throw InvArg("LineMapLoader::load_map: foreground and background "
+                     "must be the same size.");
     }
+    m_tile_width  = tsize.width ;
+    m_tile_height = tsize.height;
+    assert(has_tile_size_initialized());
 
-    load_transition_tiles(map, m_transition_tiles);
+    load_layers(nfo, foregids, backgids);
+
+    m_transition_tiles.set_size(foregids.width(), foregids.height(),
+                                TransitionTileType::no_transition);
+}
+
+void LineMapLoader::load_map(CompiledLineMap && compiled) {
+    m_tile_width  = compiled.tile_width ;
+    m_tile_height = compiled.tile_height;
+    assert(has_tile_size_initialized());
+    m_foreground.swap(compiled.foreground);
+    m_background.swap(compiled.background);
+    m_transition_tiles.swap(compiled.transitions);
+
+    StageTimer timer("SegmentNeighborTable::build");
+    m_foreground_neighbors.build(m_foreground);
+    m_background_neighbors.build(m_background);
+}
+
+CompiledLineMap LineMapLoader::compile() const {
+    CompiledLineMap rv;
+    rv.tile_width  = m_tile_width ;
+    rv.tile_height = m_tile_height;
+    rv.foreground  = m_foreground ;
+    rv.background  = m_background ;
+    rv.transitions = m_transition_tiles;
+    return rv;
 }
 
 void LineMapLoader::load_layer_into
-    (Grid<LinesView> & grid, Grid<const SurfaceDetails *> & dets, Layer layer)
+    (LayerSegments & segments, SegmentNeighborTable & neighbors, Layer layer)
 {
-    grid.clear();
-    dets.clear();
     switch (layer) {
     case Layer::neither:
         throw InvArg("LineMapLoader::load_layer_into: layer maybe foreground "
                      "or background only.");
     case Layer::background:
-        m_background        .swap(grid);
-        m_background_details.swap(dets);
+        m_background          .swap(segments );
+        m_background_neighbors.swap(neighbors);
         break;
     case Layer::foreground:
-        m_foreground        .swap(grid);
-        m_foreground_details.swap(dets);
+        m_foreground          .swap(segments );
+        m_foreground_neighbors.swap(neighbors);
         break;
     }
 }
@@ -145,6 +159,69 @@ void LineMapLoader::load_transitions_into(TransitionGrid & grid) {
     grid.swap(m_transition_tiles);
 }
 
+/* private */ void LineMapLoader::load_layers
+    (const SegmentsInfo & nfo, const Grid<int> & foregids,
+     const Grid<int> & backgids)
+{
+    {
+    StageTimer timer("pack_layer_segments");
+    pack_layer_segments(nfo, foregids, m_foreground);
+    pack_layer_segments(nfo, backgids, m_background);
+    }
+    StageTimer timer("SegmentNeighborTable::build");
+    m_foreground_neighbors.build(m_foreground);
+    m_background_neighbors.build(m_background);
+}
+
+/* private */ void LineMapLoader::pack_layer_segments
+    (const SegmentsInfo & nfo, const Grid<int> & gids, LayerSegments & layer) const
+{
+    auto find_tile_info = [&nfo](int gid) -> const TileInfo & {
+        auto itr = nfo.segment_map.find(gid);
+        if (itr == nfo.segment_map.end()) {
+            throw RtError("LineMapLoader::load_map: non empty tile has missing info");
+        }
+        return itr->second;
+    };
+
+    layer.make_blank_of_size(gids.width(), gids.height());
+    std::size_t total_segments = 0;
+    for (VectorI r; r != gids.end_position(); r = gids.next(r)) {
+        if (gids(r) == k_empty_tile_gid) continue;
+        total_segments += find_tile_info(gids(r)).segments.size();
+        // only chunks with something in them are ever allocated
+        layer.tiles.allocate_chunk(layer.tiles.chunk_index_of(r));
+    }
+    if (total_segments > std::numeric_limits<uint32_t>::max()) {
+        throw RtError("LineMapLoader::load_map: too many segments on one layer.");
+    }
+    layer.segments.reserve(total_segments);
+    layer.geometry.reserve(total_segments);
+
+    // segments must be stored in tile order (see SegmentNeighborTable), which
+    // is the packed tiles' own (chunked) iteration order
+    for (auto r = layer.tiles.begin_position(); r != layer.tiles.end_position();
+         r = layer.tiles.next(r))
+    {
+        if (gids(r) == k_empty_tile_gid) continue;
+        const auto & tile_info = find_tile_info(gids(r));
+        if (int(tile_info.segments.size()) > LayerSegments::k_max_segments_per_tile) {
+            throw RtError("LineMapLoader::load_map: tile gid "
+                          + std::to_string(gids(r)) + " has too many segments.");
+        }
+        auto & tile = layer.tiles(r);
+        tile.offset        = uint32_t(layer.segments.size());
+        tile.count         = uint8_t(tile_info.segments.size());
+        tile.details_index = layer.palette_index_of(tile_info);
+
+        VectorD offset(double(r.x)*m_tile_width, double(r.y)*m_tile_height);
+        for (const auto & seg : tile_info.segments) {
+            layer.segments.emplace_back(seg.a + offset, seg.b + offset);
+            layer.geometry.push_back(compute_geometry(seg));
+        }
+    }
+}
+
 /* static */ LineMapLoader::TileSize LineMapLoader::load_tile_size
     (const tmap::TiledMap & map)
 {
@@ -209,42 +286,6 @@ void LineMapLoader::load_transitions_into(TransitionGrid & grid) {
 
 }
 
-/* static */ LineMapLoader::SegmentsInfo LineMapLoader::load_tileset_map
-    (const tmap::TiledMap & map, double tile_width, double tile_height)
-{
-    std::unordered_map<int, TileInfo> segment_map;
-    int total_segments_count = 0;
-    for (auto layername : k_layer_list) {
-        auto * layer = find_tile_layer(map, layername);
-#       if 0
-                map.find_tile_layer(layername);
-#       endif
-        // we've established that there is definitely a ground layer
-        if (!layer) { continue; }
-        // better: be able to iterate tilesets themselves for this information
-        for (int y = 0; y != layer->height(); ++y) {
-        for (int x = 0; x != layer->width (); ++x) {
-            auto * properties = layer->properties_of(x, y);
-            if (!properties) continue;
-            auto itr = segment_map.find(layer->tile_gid(x, y));
-            if (itr != segment_map.end()) continue;
-            // great, we get to load up info if it's not filled!
-            auto tileinfo = load_tile_info(*properties);
-            for (auto & line : tileinfo.segments) {
-                line.a.x *= tile_width ;
-                line.a.y *= tile_height;
-                line.b.x *= tile_width ;
-                line.b.y *= tile_height;
-            }
-
-            if (tileinfo.segments.empty()) continue;
-            total_segments_count += int(tileinfo.segments.size());
-            segment_map[layer->tile_gid(x, y)] = std::move(tileinfo);
-        }}
-    }
-    return SegmentsInfo { std::move(segment_map), total_segments_count };
-}
-
 /* private */ void LineMapLoader::load_transition_tiles
     (const tmap::TiledMap & map, TransitionGrid & grid) const
 {
@@ -266,56 +307,6 @@ namespace {
 template <typename Type>
 VectorI limit_vector_to(const Grid<Type> &, VectorI);
 
-template <typename Key>
-const std::string * find_property(const TilePropertyMap &, const Key &);
-
-TileInfo load_tile_info(const TilePropertyMap & pmap) {
-    auto * lines = find_property(pmap, "lines");
-    if (!lines) return TileInfo();
-
-    TileInfo rv;
-    if (auto * hard_ceil = find_property(pmap, "hard-ceiling")) {
-        rv.hard_ceilling = *hard_ceil == "true";
-    }
-
-    static const constexpr auto k_exactly_points_msg =
-        "load_line_pairs: Each point pair must have exactly two points.";
-    static const constexpr auto k_exactly_two_nums_msg =
-        "load_line_pairs: Each point must have exactly two numbers.";
-    static const constexpr auto k_failed_str_to_num_msg =
-        "load_line_pairs: Cannot convert string to number for vector pairs.";
-
-    auto & segments = rv.segments;
-    for_split<is_semicolon>(lines->c_str(), lines->c_str() + lines->length(),
-        [&segments](const char * beg, const char * end)
-    {
-        VectorD a, b;
-        auto pts = { &a, &b };
-        auto vitr = pts.begin();
-        for_split<is_colon>(beg, end,
-            [&pts, &vitr](const char * beg, const char * end)
-        {
-            if (vitr == pts.end()) throw RtError(k_exactly_points_msg);
-            auto nums = { &(**vitr).x, &(**vitr).y };
-            ++vitr;
-            auto itr = nums.begin();
-            for_split<is_comma>(beg, end,
-                [&itr, &nums](const char * beg, const char * end)
-            {
-                if (itr == nums.end())
-                    throw RtError(k_exactly_two_nums_msg);
-                trim<is_whitespace>(beg, end);
-                if (!string_to_number(beg, end, **(itr++)))
-                    throw RtError(k_failed_str_to_num_msg);
-            });
-            if (itr != nums.end()) throw RtError(k_exactly_two_nums_msg);
-        });
-        if (vitr != pts.end()) throw RtError(k_exactly_points_msg);
-        segments.emplace_back(a, b);
-    });
-    return rv;
-}
-
 Grid<int> get_layer_gids
     (const tmap::TiledMap & map, const SegmentMap & surfacemap,
      const char * layer_name)
@@ -349,55 +340,6 @@ Grid<int> get_layer_gids(const tmap::TiledMap & map, int width, int height,
     return rv;
 }
 
-std::pair<SegmentsPtr, LineViewMap>
-    produce_segment_view_map(const SegmentsInfo & nfo)
-{
-    // prepare line segments container
-    // prevent iterator invalidation
-    SegmentsPtr segments = std::make_shared<std::vector<LineSegment>>();
-    segments->reserve(std::size_t(nfo.total_segments_count));
-    LineViewMap view_map;
-    for (auto & pair : nfo.segment_map) {
-        auto f = segments->end();
-        auto offset = segments->size();
-        auto & source_segments = pair.second.segments;
-        segments->insert(segments->end(), source_segments.begin(), source_segments.end());
-        assert(f == (segments->begin() + int(offset)));
-        view_map[pair.first] = LinesView(f, segments->end());
-    }
-    return std::make_pair(segments, view_map);
-}
-
-std::pair<SurfaceDetailsPtr, SurfaceDetailsMap>
-    produce_surface_details_map(const SegmentsInfo & nfo)
-{
-    static const SurfaceDetails k_default_details;
-    auto details = std::make_shared<SurfaceDetailsPtr::element_type>();
-
-    std::size_t diff_count = 0;
-    for (const auto & [gid, tilenfo] : nfo.segment_map) {
-        (void)gid;
-        auto dets = static_cast<const SurfaceDetails &>(tilenfo);
-        if (dets != k_default_details) { diff_count++; }
-    }
-    details->reserve(diff_count);
-
-    SurfaceDetailsMap viewmap;
-    for (const auto & [gid, tilenfo] : nfo.segment_map) {
-        auto dets = static_cast<const SurfaceDetails &>(tilenfo);
-        if (dets == k_default_details) {
-            viewmap[gid] = &k_default_details;
-        } else {
-            [[maybe_unused]] auto old_cap = details->capacity();
-            details->push_back(dets);
-            // *must* not reallocate!
-            assert(old_cap == details->capacity());
-            viewmap[gid] = &details->back();
-        }
-    }
-    return std::make_pair(details, viewmap);
-}
-
 void overwrite_layer
     (Grid<int> & layer,
      const Grid<int> & overwriting_layer, const char * layer_name)
@@ -462,11 +404,4 @@ VectorI limit_vector_to(const Grid<Type> & grid, VectorI r) {
                    std::max(std::min(r.y, grid.height() - 1), 0));
 }
 
-template <typename Key>
-const std::string * find_property(const TilePropertyMap & map, const Key & key) {
-    auto itr = map.find(key);
-    if (itr == map.end()) return nullptr;
-    return &itr->second;
-}
-
 } // end of <anonymous> namespace
@@ -20,15 +20,14 @@
 #pragma once
 
 #include "Maps.hpp"
+#include "LineMapCache.hpp"
 
 #include <memory>
 
+class MapTileIndex;
+
 class LineMapLoader {
 public:
-    using SegmentsPtr        = LineMapLayer::SegmentsPtr;
-    using SurfaceDetailsPtr  = LineMapLayer::SurfaceDetailsPtr;
-    using SurfaceDetailsGrid = Grid<const SurfaceDetails *>;
-
     static constexpr const char * k_ground     = "ground"    ;
     static constexpr const char * k_background = "background";
     static constexpr const char * k_foreground = "foreground";
@@ -38,16 +37,23 @@ public:
     static constexpr const char * k_transition_object = k_line_map_transition_object;
     static constexpr const double k_initial_tile_size = -1.;
 
+    /// indexes the map's tiles first (see MapTileIndex)
     void load_map(const tmap::TiledMap &);
 
-    /// meant to be called only by LineMap
-    void load_layer_into(Grid<LinesView> &, SurfaceDetailsGrid &, Layer);
+    void load_map(const tmap::TiledMap &, const MapTileIndex &);
 
-    void load_transitions_into(TransitionGrid &);
+    /// takes collision data compiled earlier, only neighbor tables have to be
+    /// rebuilt
+    void load_map(CompiledLineMap &&);
 
-    SegmentsPtr get_segments() const { return m_segments; }
+    /// @returns copy of everything loaded, for saving (must be called before
+    ///          anything is taken by a LineMap)
+    CompiledLineMap compile() const;
 
-    SurfaceDetailsPtr get_surface_details() const { return m_details; }
+    /// meant to be called only by LineMap
+    void load_layer_into(LayerSegments &, SegmentNeighborTable &, Layer);
+
+    void load_transitions_into(TransitionGrid &);
 
     double tile_width() const { return m_tile_width; }
 
@@ -59,9 +65,7 @@ public:
         std::vector<LineSegment> segments;
     };
 
-    using SegmentMap        = std::unordered_map<int, TileInfo >;
-    using LineViewMap       = std::unordered_map<int, LinesView>;
-    using SurfaceDetailsMap = std::unordered_map<int, const SurfaceDetails *>;
+    using SegmentMap = std::unordered_map<int, TileInfo>;
 
     struct SegmentsInfo {
         SegmentMap segment_map;
@@ -75,9 +79,21 @@ public:
 
     static TileSize load_tile_size(const tmap::TiledMap &);
 
-    static SegmentsInfo load_tileset_map(const tmap::TiledMap &, double tile_width, double tile_height);
+    /// loads from already prepared tile information rather than a TilEd map
+    /// (e.g. synthetic maps for benchmarking), no tiles are transition tiles
+    ///
+    /// gids of zero are empty tiles, all other gids must be in the segments
+    /// info's map
+    void load_map(const SegmentsInfo &, const Grid<int> & foreground_gids,
+                  const Grid<int> & background_gids, TileSize);
 
 private:
+    void load_layers(const SegmentsInfo &, const Grid<int> & foregids,
+                     const Grid<int> & backgids);
+
+    void pack_layer_segments(const SegmentsInfo &, const Grid<int> & gids,
+                             LayerSegments &) const;
+
     void load_transition_tiles(const tmap::TiledMap &, TransitionGrid &) const;
 
     bool has_tile_size_initialized() const noexcept {
@@ -85,11 +101,9 @@ private:
                && m_tile_height != k_initial_tile_size;
     }
 
-    Grid<LinesView> m_foreground, m_background;
-    SurfaceDetailsGrid m_foreground_details, m_background_details;
+    LayerSegments m_foreground, m_background;
+    SegmentNeighborTable m_foreground_neighbors, m_background_neighbors;
     TransitionGrid m_transition_tiles;
     double m_tile_width = k_initial_tile_size;
     double m_tile_height = k_initial_tile_size;
-    SegmentsPtr m_segments;
-    SurfaceDetailsPtr m_details;
 };
@@ -19,84 +19,395 @@
 
 #include "MapMultiplexer.hpp"
 #include "Maps.hpp"
-#include "MapObjectLoader.hpp"
+#include "LineMapLoader.hpp"
+#include "LineMapCache.hpp"
 
 #include <tmap/TiledMap.hpp>
 
+#include <common/TestSuite.hpp>
+
+#include <cstring>
 #include <cassert>
 
 namespace {
 
 using ElementPtr = MapMultiplexer::ElementPtr;
+using MapInfoPtr = MultiMapLoader::MapInfoPtr;
 using StringCIter = std::string::const_iterator;
+using RtError = std::runtime_error;
+using InvArg = std::invalid_argument;
 
-constexpr const int k_unset_depth = std::numeric_limits<int>::max();
+struct LinkInfo {
+    std::string filename;
+    VectorI offset;
+    MapEdge edge;
+};
 
 /// @note does not load linked maps
-void prepare_element(/*const std::string & filename, MultiMapLoader &,*/
-                     MapMultiplexerElement &/*, VectorD translation = VectorD()*/);
+void prepare_element(MapMultiplexerElement &);
+
+/// calls f for each readable link in the element's map properties
+template <typename Func>
+void for_each_link(const MapMultiplexerElement &, Func && f);
+
+/// @returns where the linked map goes, so that it sits against the given
+///          edge of its parent
+VectorD translation_from_edge(const LineMap & parent, const LineMap & linked,
+                              VectorI offset, MapEdge);
 
-void prepare_element_links(MapMultiplexerElement &, MultiMapLoader &,
-                           std::vector<ElementPtr> &, VectorD translation = VectorD(),
-                           int max_depth = k_unset_depth);
+/// @returns which edge of the map the location is past, not_an_edge if the
+///          location is on the map
+MapEdge edge_of(VectorD, const LineMap &);
+
+/// @returns seconds until the location, moving at velocity, is past the
+///          given edge (infinity if it never will be)
+double time_to_edge(VectorD location, VectorD velocity, const LineMap &, MapEdge);
+
+Rect global_bounds_of(const LineMap &);
+
+VectorI read_offset(const char * beg, const char * end, MapEdge);
+
+LinkInfo load_link(const std::string & link_string);
 
 } // end of <anonymous> namespace
 
-MultiMapLoader::MultiMapLoader() {
-    m_maps.set_loader_function(TypeTag<MapInfo>(),
-        [](const std::string & filename, MapInfo & info)
-    {
-        auto tmap_ptr = std::make_unique<tmap::TiledMap>();
-        tmap_ptr->load_from_file(filename);
+MultiMapLoader::MapInfoPtr MultiMapLoader::load_map(const std::string & filename) {
+    auto itr = m_pending.find(filename);
+    if (itr != m_pending.end()) return take_finished(itr);
 
-        auto lmap_ptr = std::make_unique<LineMap>();
-        lmap_ptr->load_map_from(*tmap_ptr);
+    auto jtr = m_loaded.find(filename);
+    if (jtr != m_loaded.end()) {
+        if (auto rv = jtr->second.lock()) return rv;
+    }
+    auto rv = load_map_info(filename);
+    m_loaded[filename] = rv;
+    return rv;
+}
 
-        info.linemap  = std::move(lmap_ptr);
-        info.tiledmap = std::move(tmap_ptr);
-    });
+void MultiMapLoader::prefetch(const std::string & filename) {
+    if (m_pending.find(filename) != m_pending.end()) return;
+    auto itr = m_loaded.find(filename);
+    if (itr != m_loaded.end() && !itr->second.expired()) return;
+    m_pending[filename] = std::async(std::launch::async, load_map_info, filename);
+}
+
+MultiMapLoader::MapInfoPtr MultiMapLoader::poll(const std::string & filename) {
+    auto itr = m_pending.find(filename);
+    if (itr == m_pending.end()) {
+        auto jtr = m_loaded.find(filename);
+        return jtr == m_loaded.end() ? nullptr : jtr->second.lock();
+    }
+    if (   itr->second.wait_for(std::chrono::microseconds(0))
+        != std::future_status::ready)
+    { return nullptr; }
+    return take_finished(itr);
+}
+
+/* private static */ MultiMapLoader::MapInfoPtr MultiMapLoader::load_map_info
+    (const std::string & filename)
+{
+    auto tmap_ptr = std::make_unique<tmap::TiledMap>();
+    tmap_ptr->load_from_file(filename);
+
+    auto lmap_ptr = std::make_unique<LineMap>();
+    lmap_ptr->load_map_from(*tmap_ptr, filename);
+
+    auto rv = std::make_shared<MapInfo>();
+    rv->filename = filename;
+    rv->linemap  = std::move(lmap_ptr);
+    rv->tiledmap = std::move(tmap_ptr);
+    return rv;
+}
+
+/* private */ MultiMapLoader::MapInfoPtr MultiMapLoader::take_finished
+    (std::map<std::string, std::future<MapInfoPtr>>::iterator itr)
+{
+    // out of pending first, as get rethrows whatever the worker threw
+    auto filename = itr->first;
+    auto future   = std::move(itr->second);
+    m_pending.erase(itr);
+
+    auto rv = future.get();
+    m_loaded[filename] = rv;
+    return rv;
+}
+
+// ----------------------------------------------------------------------------
+
+void MapMultiplexer::set_subject_location(VectorD location, Layer layer) {
+    take_in_finished_links();
+    if (is_inside(location, m_subject->map)) return;
+    if (is_on_edge(location, m_subject->map, layer)) {
+        // moving to linked map, which had better be prefetched by now
+        finish_links_toward(edge_of(location, m_subject->map));
+    }
+    // (otherwise teleportation) either way we'll have to check all loaded
+    // maps
+    auto itr = std::find_if(m_other_regions.begin(), m_other_regions.end(),
+        [location](const ElementPtr & el) { return is_inside(location, el->map); });
+    if (itr == m_other_regions.end()) return;
+
+    m_subject = *itr;
+    add_links_of(m_subject, m_subject->max_link_depth);
+    drop_unlinked_elements();
+}
+
+void MapMultiplexer::prefetch_toward(VectorD location, VectorD velocity) {
+    for (auto & link : m_pending_links) {
+        if (link.requested) continue;
+        // links further out only become known once their parents load, and
+        // so are fetched right away
+        if (   link.parent == m_subject
+            && time_to_edge(location, velocity, m_subject->map, link.edge) > k_prefetch_lead_time)
+        { continue; }
+        m_loader.prefetch(link.filename);
+        link.requested = true;
+    }
+    take_in_finished_links();
 }
 
 void MapMultiplexer::load_start
     (const std::string & filename)
 {
     m_other_regions.clear();
+    m_pending_links.clear();
 
     m_subject = std::make_shared<MapMultiplexerElement>();
-#   if 1
     m_subject->set_source(m_loader.load_map(filename), VectorD());
     prepare_element(*m_subject);
-#   endif
-#   if 0
-    prepare_element(filename, m_loader, *m_subject);
-#   endif
-    prepare_element_links(*m_subject, m_loader, m_other_regions);
+    m_tile_width  = m_subject->map.tile_width ();
+    m_tile_height = m_subject->map.tile_height();
     m_other_regions.push_back(m_subject);
+
+    // linked maps are left for prefetch_toward
+    add_links_of(m_subject, m_subject->max_link_depth);
 }
 
-namespace {
+bool MapMultiplexer::location_is_on_map(VectorD r) const {
+    return std::any_of(m_other_regions.begin(), m_other_regions.end(),
+        [r](const ElementPtr & el) { return is_inside(r, el->map); });
+}
 
-struct LinkInfo {
-    std::string filename;
-    VectorI offset;
-    MapEdge edge;
-};
+/* static */ void MapMultiplexer::run_tests() {
+    using namespace cul;
+    ts::TestSuite suite;
+    suite.start_series("MapMultiplexer");
+    // blank maps with 16x16 tiles
+    static const auto make_map = [](int width, int height, VectorD translation) {
+        CompiledLineMap compiled;
+        compiled.tile_width = compiled.tile_height = 16.;
+        compiled.foreground.make_blank_of_size(width, height);
+        compiled.background.make_blank_of_size(width, height);
+        compiled.transitions.set_size(width, height, TransitionTileType::no_transition);
+        LineMapLoader lml;
+        lml.load_map(std::move(compiled));
+        LineMap rv;
+        rv.load_map_from(lml);
+        rv.set_translation(translation);
+        return rv;
+    };
+    // map spans (0, 0) to (160, 160)
+    suite.test([]() {
+        auto map = make_map(10, 10, VectorD());
+        VectorD r(100, 80);
+        return ts::test(   are_very_close(time_to_edge(r, VectorD(120, 0), map, MapEdge::right), 0.5)
+                        && time_to_edge(r, VectorD(120, 0), map, MapEdge::left) == k_inf
+                        && are_very_close(time_to_edge(r, VectorD(-50, 0), map, MapEdge::left), 2.)
+                        && time_to_edge(r, VectorD(), map, MapEdge::bottom) == k_inf);
+    });
+    suite.test([]() {
+        // corners need both, so the later one
+        auto map = make_map(10, 10, VectorD());
+        VectorD r(100, 80);
+        return ts::test(   are_very_close(time_to_edge(r, VectorD(120, -80), map, MapEdge::top_right), 1.)
+                        && time_to_edge(r, VectorD(120, 0), map, MapEdge::top_right) == k_inf);
+    });
+    suite.test([]() {
+        // already past
+        auto map = make_map(10, 10, VectorD());
+        return ts::test(   time_to_edge(VectorD(170, 80), VectorD(), map, MapEdge::right) == 0.
+                        && time_to_edge(VectorD(100, 80), VectorD(), map, MapEdge::not_an_edge) == k_inf);
+    });
+    suite.test([]() {
+        auto parent = make_map(10, 10, VectorD(32, 0));
+        auto linked = make_map(5, 4, VectorD());
+        return ts::test(
+               translation_from_edge(parent, linked, VectorI(0, 2), MapEdge::right) == VectorD(192, 32)
+            && translation_from_edge(parent, linked, VectorI(0, -1), MapEdge::left) == VectorD(-48, -16)
+            && translation_from_edge(parent, linked, VectorI(3, 0), MapEdge::top) == VectorD(80, -64)
+            && translation_from_edge(parent, linked, VectorI(), MapEdge::bottom_right) == VectorD(192, 160)
+            && translation_from_edge(parent, linked, VectorI(), MapEdge::top_left) == VectorD(-48, -64));
+    });
+    suite.test([]() {
+        auto map = make_map(2, 2, VectorD());
+        bool threw = false;
+        try {
+            translation_from_edge(map, map, VectorI(), MapEdge::not_an_edge);
+        } catch (InvArg &) {
+            threw = true;
+        }
+        return ts::test(threw);
+    });
+    static const auto read_offset_of = [](const char * str, MapEdge edge)
+        { return read_offset(str, str + std::strlen(str), edge); };
+    suite.test([]() {
+        // offset runs along the edge
+        return ts::test(   read_offset_of("3" , MapEdge::right ) == VectorI(0, 3)
+                        && read_offset_of("-2", MapEdge::top   ) == VectorI(-2, 0)
+                        && read_offset_of("0" , MapEdge::bottom) == VectorI());
+    });
+    suite.test([]() {
+        auto throws = [](const char * str, MapEdge edge) {
+            try {
+                read_offset_of(str, edge);
+            } catch (InvArg &) {
+                return true;
+            }
+            return false;
+        };
+        return ts::test(   throws("x", MapEdge::left)
+                        && throws("1", MapEdge::top_left)
+                        && throws("1", MapEdge::not_an_edge));
+    });
+    suite.test([]() {
+        auto nfo = load_link("right; 4; linked.tmx");
+        return ts::test(   nfo.edge == MapEdge::right && nfo.offset == VectorI(0, 4)
+                        && nfo.filename == "linked.tmx");
+    });
+    suite.test([]() {
+        // corners have no offset
+        auto nfo = load_link("left-top;corner.tmx");
+        return ts::test(   nfo.edge == MapEdge::top_left && nfo.offset == VectorI()
+                        && nfo.filename == "corner.tmx");
+    });
+    suite.test([]() {
+        // not an edge, so not a link
+        auto nfo = load_link("sideways; 4; linked.tmx");
+        return ts::test(nfo.filename.empty());
+    });
+}
 
-inline bool is_semicolon(char c) { return c == ';'; }
+/* private */ void MapMultiplexer::add_links_of(const ElementPtr & el, int depth) {
+    if (depth < 1) return;
+    for_each_link(*el, [this, &el, depth](const LinkInfo & nfo) {
+        bool is_pending = std::any_of(m_pending_links.begin(), m_pending_links.end(),
+            [&nfo](const PendingLink & link) { return link.filename == nfo.filename; });
+        if (is_pending || has_element_for(nfo.filename)) return;
+
+        PendingLink link;
+        link.filename = nfo.filename;
+        link.offset   = nfo.offset;
+        link.edge     = nfo.edge;
+        link.parent   = el;
+        link.depth    = depth;
+        m_pending_links.push_back(link);
+    });
+}
 
-LinkInfo load_link(const std::string & link_string);
+/* private */ void MapMultiplexer::take_in_finished_links() {
+    // new elements may add more links, so no iterators here
+    for (std::size_t i = 0; i != m_pending_links.size(); ) {
+        MapInfoPtr info;
+        if (m_pending_links[i].requested)
+            { info = m_loader.poll(m_pending_links[i].filename); }
+        if (!info) {
+            ++i;
+            continue;
+        }
+        auto link = std::move(m_pending_links[i]);
+        m_pending_links.erase(m_pending_links.begin() + i);
+        add_linked_element(link, info);
+    }
+}
 
-[[deprecated]] VectorD get_translation_from_edge(const LineMap &, VectorI offset, MapEdge edge);
+/* private */ void MapMultiplexer::finish_links_toward(MapEdge edge) {
+    for (std::size_t i = 0; i != m_pending_links.size(); ) {
+        const auto & pending = m_pending_links[i];
+        if (pending.parent != m_subject || pending.edge != edge) {
+            ++i;
+            continue;
+        }
+        // this hitches, but there's no crossing the edge without it
+        auto link = std::move(m_pending_links[i]);
+        m_pending_links.erase(m_pending_links.begin() + i);
+        add_linked_element(link, m_loader.load_map(link.filename));
+    }
+}
 
-void prepare_element
-    (/*const std::string & filename, MultiMapLoader & loader,*/
-     MapMultiplexerElement & mme/*, VectorD translation*/)
+/* private */ void MapMultiplexer::add_linked_element
+    (const PendingLink & link, MapInfoPtr info)
 {
-#   if 0
-    mme.set_source(loader.load_map(filename), translation);
-#   endif
-    mme.links.set_dimensions(mme.width(), mme.height());
+    const auto & linked_map = *info->linemap;
+    if (   linked_map.tile_width () != m_tile_width
+        || linked_map.tile_height() != m_tile_height)
+    {
+        throw RtError("MapMultiplexer::add_linked_element: linked map \""
+                      + link.filename + "\" does not have the same tile size "
+                      "as the starting map.");
+    }
+    auto el = std::make_shared<MapMultiplexerElement>();
+    el->set_source(info, translation_from_edge(link.parent->map, linked_map,
+                                               link.offset, link.edge));
+    prepare_element(*el);
+
+    link.parent->linked_maps.push_back(el);
+    el->linked_maps.push_back(link.parent);
+    m_other_regions.push_back(el);
+    add_links_of(el, link.depth - 1);
+}
+
+/* private */ void MapMultiplexer::drop_unlinked_elements() {
+    // anything within the subject's link depth is kept
+    std::vector<const MapMultiplexerElement *> kept = { m_subject.get() };
+    std::size_t ring_begin = 0;
+    for (int depth = 0; depth < m_subject->max_link_depth; ++depth) {
+        auto ring_end = kept.size();
+        for (auto i = ring_begin; i != ring_end; ++i) {
+        for (const auto & wptr : kept[i]->linked_maps) {
+            auto ptr = wptr.lock();
+            if (!ptr || std::find(kept.begin(), kept.end(), ptr.get()) != kept.end())
+                continue;
+            kept.push_back(ptr.get());
+        }}
+        ring_begin = ring_end;
+    }
+    auto is_dropped = [&kept](const ElementPtr & el) {
+        return    !el->persists
+               && std::find(kept.begin(), kept.end(), el.get()) == kept.end();
+    };
+    // note: a prefetch still underway for a dropped link is left with the
+    //       loader, which hands it over if it's ever asked for again
+    m_pending_links.erase(
+        std::remove_if(m_pending_links.begin(), m_pending_links.end(),
+                       [&is_dropped](const PendingLink & link) { return is_dropped(link.parent); }),
+        m_pending_links.end());
+    m_other_regions.erase(
+        std::remove_if(m_other_regions.begin(), m_other_regions.end(), is_dropped),
+        m_other_regions.end());
+}
+
+/* private */ bool MapMultiplexer::has_element_for(const std::string & filename) const {
+    return std::any_of(m_other_regions.begin(), m_other_regions.end(),
+        [&filename](const ElementPtr & el) { return el->source_filename() == filename; });
+}
 
+// ----------------------------------------------------------------------------
+
+bool is_on_edge(VectorD r, const LineMap & map, Layer) {
+    // within a tile past the map's bounds
+    if (is_inside(r, map)) return false;
+    auto bounds = global_bounds_of(map);
+    return    r.x >= bounds.left - map.tile_width () && r.x < cul::right_of (bounds) + map.tile_width ()
+           && r.y >= bounds.top  - map.tile_height() && r.y < cul::bottom_of(bounds) + map.tile_height();
+}
+
+bool is_inside(VectorD r, const LineMap & map)
+    { return rect_contains(global_bounds_of(map), r); }
+
+namespace {
+
+void prepare_element(MapMultiplexerElement & mme) {
+    mme.links.set_dimensions(mme.width(), mme.height());
     const auto & map_props = mme.get_tmap().map_properties();
     auto itr = map_props.find("map-link-depth");
     if (itr != map_props.end()) {
@@ -104,7 +415,6 @@ void prepare_element
             // ideal emit a warning
         }
     }
-
     itr = map_props.find("map-persists");
     if (itr != map_props.end()) {
         if (itr->second == "true") {
@@ -117,20 +427,13 @@ void prepare_element
     }
 }
 
-void prepare_element_links
-    (MapMultiplexerElement & mme, MultiMapLoader & loader,
-     std::vector<ElementPtr> & vec, VectorD translation, int max_depth)
-{
-    if (max_depth == k_unset_depth) {
-        max_depth = mme.max_link_depth;
-    }
-    if (max_depth < 1) return;
-
+template <typename Func>
+void for_each_link(const MapMultiplexerElement & mme, Func && f) {
     const auto & map_props = mme.get_tmap().map_properties();
     auto itr = map_props.find("map-link-names");
     if (itr == map_props.end()) return;
-    using namespace cul;
 
+    using namespace cul;
     for_split<is_semicolon>(itr->second, [&](StringCIter beg, StringCIter end) {
         trim<is_whitespace>(beg, end);
         auto jtr = map_props.find(std::string { beg, end });
@@ -138,26 +441,87 @@ void prepare_element_links
             // emit warning
             return;
         }
-
         LinkInfo nfo = load_link(jtr->second);
         if (nfo.filename.empty()) return;
+        f(nfo);
+    });
+}
 
-        auto ptr = std::make_shared<MapMultiplexerElement>();
-        vec.push_back(ptr);
+VectorD translation_from_edge
+    (const LineMap & parent, const LineMap & linked, VectorI offset, MapEdge edge)
+{
+    // in tiles, from the parent's top left
+    auto tile_offset = [&]() {
+        switch (edge) {
+        case MapEdge::right       : return VectorI( parent.width(), offset.y);
+        case MapEdge::left        : return VectorI(-linked.width(), offset.y);
+        case MapEdge::bottom      : return VectorI(offset.x,  parent.height());
+        case MapEdge::top         : return VectorI(offset.x, -linked.height());
+        case MapEdge::bottom_right: return VectorI( parent.width(),  parent.height());
+        case MapEdge::bottom_left : return VectorI(-linked.width(),  parent.height());
+        case MapEdge::top_right   : return VectorI( parent.width(), -linked.height());
+        case MapEdge::top_left    : return VectorI(-linked.width(), -linked.height());
+        case MapEdge::not_an_edge :
+            throw InvArg("translation_from_edge: maps may only be linked by an edge.");
+        default: throw BadBranchException();
+        }
+    }();
+    return parent.translation() + VectorD(double(tile_offset.x)*parent.tile_width (),
+                                          double(tile_offset.y)*parent.tile_height());
+}
 
-        VectorD translation_ = translation + get_translation_from_edge(mme.map, nfo.offset, nfo.edge);
-        ptr->set_source(loader.load_map(nfo.filename), translation_);
-        prepare_element(*ptr);
-        prepare_element_links(*ptr, loader, vec, translation_, max_depth - 1);
-    });
+MapEdge edge_of(VectorD r, const LineMap & map) {
+    auto bounds = global_bounds_of(map);
+    bool left   = r.x <  bounds.left;
+    bool right  = r.x >= cul::right_of(bounds);
+    bool top    = r.y <  bounds.top;
+    bool bottom = r.y >= cul::bottom_of(bounds);
+    if (top    && left ) return MapEdge::top_left;
+    if (top    && right) return MapEdge::top_right;
+    if (bottom && left ) return MapEdge::bottom_left;
+    if (bottom && right) return MapEdge::bottom_right;
+    if (left  ) return MapEdge::left;
+    if (right ) return MapEdge::right;
+    if (top   ) return MapEdge::top;
+    if (bottom) return MapEdge::bottom;
+    return MapEdge::not_an_edge;
+}
+
+double time_to_edge(VectorD r, VectorD velocity, const LineMap & map, MapEdge edge) {
+    auto bounds = global_bounds_of(map);
+    auto time_to_low = [](double x, double vx, double low)
+        { return x <= low ? 0. : (vx < 0. ? (low - x) / vx : k_inf); };
+    auto time_to_high = [](double x, double vx, double high)
+        { return x >= high ? 0. : (vx > 0. ? (high - x) / vx : k_inf); };
+    auto left   = [&]() { return time_to_low (r.x, velocity.x, bounds.left            ); };
+    auto right  = [&]() { return time_to_high(r.x, velocity.x, cul::right_of (bounds)); };
+    auto top    = [&]() { return time_to_low (r.y, velocity.y, bounds.top             ); };
+    auto bottom = [&]() { return time_to_high(r.y, velocity.y, cul::bottom_of(bounds)); };
+    switch (edge) {
+    case MapEdge::left        : return left  ();
+    case MapEdge::right       : return right ();
+    case MapEdge::top         : return top   ();
+    case MapEdge::bottom      : return bottom();
+    // corners need both
+    case MapEdge::top_left    : return std::max(top   (), left ());
+    case MapEdge::top_right   : return std::max(top   (), right());
+    case MapEdge::bottom_left : return std::max(bottom(), left ());
+    case MapEdge::bottom_right: return std::max(bottom(), right());
+    case MapEdge::not_an_edge : return k_inf;
+    default: throw BadBranchException();
+    }
+}
+
+Rect global_bounds_of(const LineMap & map) {
+    auto r = map.translation();
+    return Rect(r.x, r.y, double(map.width ())*map.tile_width (),
+                          double(map.height())*map.tile_height());
 }
 
 // ----------------------------------------------------------------------------
 
 MapEdge to_map_edge(const char * beg, const char * end);
 
-VectorI read_offset(const char * beg, const char * end, MapEdge);
-
 LinkInfo load_link(const std::string & link_string) {
     LinkInfo rv;
     enum { k_read_edge, k_read_offset, k_read_filename, k_warned, k_done };
@@ -187,7 +551,7 @@ LinkInfo load_link(const std::string & link_string) {
             return;
         case k_read_offset:
             rv.offset = read_offset(beg, end, rv.edge);
-            phase = k_read_offset;
+            phase = k_read_filename;
             return;
         case k_read_filename:
             rv.filename = std::string(beg, end);
@@ -202,10 +566,6 @@ LinkInfo load_link(const std::string & link_string) {
     return rv;
 }
 
-VectorD get_translation_from_edge(const LineMap &, VectorI offset, MapEdge edge) {
-    return VectorD();
-}
-
 // ----------------------------------------------------------------------------
 
 MapEdge to_map_edge(const char * beg, const char * end) {
@@ -227,15 +587,20 @@ VectorI read_offset(const char * beg, const char * end, MapEdge edge) {
     case MapEdge::bottom_right: case MapEdge::bottom_left:
     case MapEdge::top_right   : case MapEdge::top_left   :
     case MapEdge::not_an_edge :
-
         throw std::invalid_argument("read_offset: this map edge type cannot have an offset");
     case MapEdge::right: case MapEdge::left  :
     case MapEdge::top  : case MapEdge::bottom:
-
-
-
+        break;
     default: throw BadBranchException();
     }
+    // offset runs along the edge
+    int offset = 0;
+    if (!cul::string_to_number(beg, end, offset)) {
+        throw std::invalid_argument("read_offset: offset must be an integer");
+    }
+    if (edge == MapEdge::right || edge == MapEdge::left)
+        { return VectorI(0, offset); }
+    return VectorI(offset, 0);
 }
 
 } // end of <anonymous> namespace
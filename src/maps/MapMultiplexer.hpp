@@ -25,7 +25,9 @@
 #include "MapLinks.hpp"
 #include "Maps.hpp"
 
-class MapObjectLoader;
+#include <future>
+#include <map>
+
 class LineMap;
 
 class MapMultiplexerLayer final {
@@ -36,19 +38,42 @@ public:
 
 namespace tmap { class TiledMap; }
 
-class MultiMapLoader {
+/// Loads TilEd maps along with their line maps, loads may either be done
+/// right away, or started on a worker thread and picked up later.
+///
+/// The loader itself is only ever touched from the thread that owns it, the
+/// workers only run the loading function (which shares nothing).
+class MultiMapLoader final {
 public:
     struct MapInfo {
+        std::string filename;
         std::unique_ptr<const tmap::TiledMap> tiledmap;
         std::unique_ptr<const LineMap       > linemap;
     };
+    using MapInfoPtr = std::shared_ptr<MapInfo>;
+
+    MultiMapLoader() {}
+    MultiMapLoader(const MultiMapLoader &) = delete;
+    MultiMapLoader & operator = (const MultiMapLoader &) = delete;
+
+    /// loads the map right away, a load already underway for it is waited on
+    MapInfoPtr load_map(const std::string & filename);
+
+    /// starts loading the map on a worker thread, does nothing if the map is
+    /// already loaded or on its way
+    void prefetch(const std::string & filename);
 
-    MultiMapLoader();
+    /// @returns the map if it is loaded, nullptr if it's still loading (or
+    ///          was never asked for)
+    MapInfoPtr poll(const std::string & filename);
 
-    std::shared_ptr<MapInfo> load_map(const std::string & filename)
-        { return m_maps.load(TypeTag<MapInfo>(), filename); }
 private:
-    CachedLoader<MapInfo, std::string> m_maps;
+    static MapInfoPtr load_map_info(const std::string & filename);
+
+    MapInfoPtr take_finished(std::map<std::string, std::future<MapInfoPtr>>::iterator);
+
+    std::map<std::string, std::weak_ptr<MapInfo>> m_loaded;
+    std::map<std::string, std::future<MapInfoPtr>> m_pending;
 };
 
 class MapMultiplexerElement final {
@@ -78,6 +103,8 @@ public:
 
     const tmap::TiledMap & get_tmap() const { return *m_cshrptr->tiledmap; }
 
+    const std::string & source_filename() const { return m_cshrptr->filename; }
+
 private:
     std::shared_ptr<LoaderInfo> m_cshrptr;
 };
@@ -89,31 +116,66 @@ class MapMultiplexer final {
 public:
     using ElementPtr = std::shared_ptr<MapMultiplexerElement>;
 
-    void set_subject_location(MapObjectLoader &, VectorD location, Layer layer) {
-        // there are three posibilities:
-        // - on subject map
-        // - on subject map edge
-        // - outside of subject map (we really want teleportation to be possible)
-        if (is_inside(location, m_subject->map)) {
-            return;
-        } else if (is_on_edge(location, m_subject->map, layer)) {
-            // moving to linked map
-            ;
-        } else {
-            // teleportation
-            // we'll have to check all loaded maps
-            ;
-        }
-    }
+    /// linked maps are prefetched once the subject is this close (in seconds
+    /// at its current velocity) to the edge they're linked to
+    static constexpr const double k_prefetch_lead_time = 1.5;
+
+    /// changes the subject map to whichever map the location is on
+    ///
+    /// there are three posibilities:
+    /// - on subject map
+    /// - on subject map edge, where a linked map that hasn't finished
+    ///   prefetching is waited on
+    /// - outside of subject map (we really want teleportation to be
+    ///   possible), where only loaded maps are checked
+    void set_subject_location(VectorD location, Layer);
+
+    /// starts loading maps linked to edges the subject is heading toward, and
+    /// takes in any which have finished
+    void prefetch_toward(VectorD location, VectorD velocity);
+
     MapMultiplexerLayer & get_layer(Layer);
+
+    /// only the starting map is loaded right away, its links are prefetched
     void load_start(const std::string & filename);
+
     bool location_is_on_map(VectorD) const;
+
+    /// the map the subject was last on, which changes only with
+    /// set_subject_location (or load_start)
+    const LineMap & subject_map() const { return m_subject->map; }
+
+    static void run_tests();
+
 private:
+    struct PendingLink {
+        std::string filename;
+        VectorI offset;
+        MapEdge edge = MapEdge::not_an_edge;
+        ElementPtr parent;
+        // from map-link-depth, counting down with each link followed
+        int depth = 0;
+        bool requested = false;
+    };
+
+    void add_links_of(const ElementPtr &, int depth);
+
+    void take_in_finished_links();
+
+    /// waits on links from the subject's given edge
+    void finish_links_toward(MapEdge);
+
+    void add_linked_element(const PendingLink &, MultiMapLoader::MapInfoPtr);
+
+    void drop_unlinked_elements();
+
+    bool has_element_for(const std::string & filename) const;
+
     static constexpr const double k_uninit_tile_size = 0.;
 
     MultiMapLoader m_loader;
-
     std::vector<ElementPtr> m_other_regions;
+    std::vector<PendingLink> m_pending_links;
     ElementPtr m_subject;
     // limitation: all maps must have the same tile size
     double m_tile_width  = k_uninit_tile_size;
@@ -0,0 +1,167 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "MapTileIndex.hpp"
+#include "../StageTimer.hpp"
+
+#include <tmap/TiledMap.hpp>
+
+namespace {
+
+using RtError  = std::runtime_error;
+using TileInfo = MapTileIndex::TileInfo;
+using TilePropertyMap = MapTileIndex::TilePropertyMap;
+
+using cul::for_split;
+using cul::string_to_number;
+using cul::trim;
+
+bool is_collision_layer(const tmap::MapLayer &);
+
+template <typename Key>
+const std::string * find_property(const TilePropertyMap &, const Key &);
+
+} // end of <anonymous> namespace
+
+void MapTileIndex::load_from(const tmap::TiledMap & map) {
+    StageTimer timer("MapTileIndex::load_from");
+    m_tile_size = LineMapLoader::load_tile_size(map);
+    m_segments_info = SegmentsInfo();
+    m_gids.clear();
+    m_waterfall_strips.clear();
+    m_waterfall_tiles.clear();
+
+    int layer_number = -1;
+    for (const tmap::MapLayer * layer : map) {
+        ++layer_number;
+        const auto * tile_layer = dynamic_cast<const tmap::TileLayer *>(layer);
+        if (!tile_layer) continue;
+        bool collision_layer = is_collision_layer(*tile_layer);
+        // columns first, which is the order waterfall tiles are wanted in
+        for (int x = 0; x != tile_layer->width (); ++x) {
+        for (int y = 0; y != tile_layer->height(); ++y) {
+            int gid = tile_layer->tile_gid(x, y);
+            auto [itr, is_new] = m_gids.try_emplace(gid);
+            auto & entry = itr->second;
+            if (is_new) {
+                // this is the only time any tile's properties are looked up
+                entry.properties = tile_layer->properties_of(x, y);
+                if (entry.properties) {
+                    if (auto * falls = find_property(*entry.properties, k_waterfall_property)) {
+                        entry.is_waterfall = true;
+                        m_waterfall_strips[gid] = *falls;
+                    }
+                }
+            }
+            if (!entry.properties) continue;
+            if (entry.is_waterfall)
+                { m_waterfall_tiles.push_back(TilePosition { layer_number, VectorI(x, y) }); }
+            if (collision_layer && !entry.on_collision_layer) {
+                entry.on_collision_layer = true;
+                add_collision_gid(gid, *entry.properties);
+            }
+        }}
+    }
+}
+
+const MapTileIndex::TilePropertyMap * MapTileIndex::properties_of(int gid) const {
+    auto itr = m_gids.find(gid);
+    return itr == m_gids.end() ? nullptr : itr->second.properties;
+}
+
+/* static */ MapTileIndex::TileInfo MapTileIndex::load_tile_info
+    (const TilePropertyMap & pmap)
+{
+    auto * lines = find_property(pmap, "lines");
+    if (!lines) return TileInfo();
+
+    TileInfo rv;
+    if (auto * hard_ceil = find_property(pmap, "hard-ceiling")) {
+        rv.hard_ceilling = *hard_ceil == "true";
+    }
+
+    static const constexpr auto k_exactly_points_msg =
+        "load_line_pairs: Each point pair must have exactly two points.";
+    static const constexpr auto k_exactly_two_nums_msg =
+        "load_line_pairs: Each point must have exactly two numbers.";
+    static const constexpr auto k_failed_str_to_num_msg =
+        "load_line_pairs: Cannot convert string to number for vector pairs.";
+
+    auto & segments = rv.segments;
+    for_split<is_semicolon>(lines->c_str(), lines->c_str() + lines->length(),
+        [&segments](const char * beg, const char * end)
+    {
+        VectorD a, b;
+        auto pts = { &a, &b };
+        auto vitr = pts.begin();
+        for_split<is_colon>(beg, end,
+            [&pts, &vitr](const char * beg, const char * end)
+        {
+            if (vitr == pts.end()) throw RtError(k_exactly_points_msg);
+            auto nums = { &(**vitr).x, &(**vitr).y };
+            ++vitr;
+            auto itr = nums.begin();
+            for_split<is_comma>(beg, end,
+                [&itr, &nums](const char * beg, const char * end)
+            {
+                if (itr == nums.end())
+                    throw RtError(k_exactly_two_nums_msg);
+                trim<is_whitespace>(beg, end);
+                if (!string_to_number(beg, end, **(itr++)))
+                    throw RtError(k_failed_str_to_num_msg);
+            });
+            if (itr != nums.end()) throw RtError(k_exactly_two_nums_msg);
+        });
+        if (vitr != pts.end()) throw RtError(k_exactly_points_msg);
+        segments.emplace_back(a, b);
+    });
+    return rv;
+}
+
+/* private */ void MapTileIndex::add_collision_gid
+    (int gid, const TilePropertyMap & properties)
+{
+    auto tileinfo = load_tile_info(properties);
+    if (tileinfo.segments.empty()) return;
+    for (auto & line : tileinfo.segments) {
+        line.a.x *= m_tile_size.width ;
+        line.a.y *= m_tile_size.height;
+        line.b.x *= m_tile_size.width ;
+        line.b.y *= m_tile_size.height;
+    }
+    m_segments_info.total_segments_count += int(tileinfo.segments.size());
+    m_segments_info.segment_map[gid] = std::move(tileinfo);
+}
+
+namespace {
+
+bool is_collision_layer(const tmap::MapLayer & layer) {
+    const auto & names = LineMapLoader::k_layer_list;
+    return std::any_of(names.begin(), names.end(),
+        [&layer](const char * name) { return layer.name() == name; });
+}
+
+template <typename Key>
+const std::string * find_property(const TilePropertyMap & map, const Key & key) {
+    auto itr = map.find(key);
+    if (itr == map.end()) return nullptr;
+    return &itr->second;
+}
+
+} // end of <anonymous> namespace
@@ -0,0 +1,90 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "LineMapLoader.hpp"
+
+#include <tmap/TileLayer.hpp>
+
+#include <map>
+#include <unordered_map>
+
+/// Everything loaders want to know about a TilEd map's tiles, gathered in
+/// one walk over its tile layers.
+///
+/// Tile properties belong to gids, so each gid's properties are parsed only
+/// once here. Line map loading and decor both read from the index, rather
+/// than each walking every layer again.
+class MapTileIndex final {
+public:
+    using SegmentsInfo    = LineMapLoader::SegmentsInfo;
+    using TileInfo        = LineMapLoader::TileInfo;
+    using TileSize        = LineMapLoader::TileSize;
+    using TilePropertyMap = tmap::TileLayer::PropertyMap;
+
+    static constexpr const char * k_waterfall_property = "animation-falls";
+
+    /// a tile of some layer, layers are numbered in map order (counting
+    /// layers of any kind)
+    struct TilePosition {
+        int layer = 0;
+        VectorI location;
+    };
+
+    void load_from(const tmap::TiledMap &);
+
+    TileSize tile_size() const { return m_tile_size; }
+
+    /// gids appearing on collision layers which have segments, segments are
+    /// scaled to tile size
+    const SegmentsInfo & segments_info() const { return m_segments_info; }
+
+    /// @returns nullptr if the gid has no properties (or is not on the map)
+    /// @note pointers are into the TilEd map, which must outlive their use
+    const TilePropertyMap * properties_of(int gid) const;
+
+    /// gids of waterfall tiles, to their waterfall property values
+    const std::map<int, std::string> & waterfall_strips() const
+        { return m_waterfall_strips; }
+
+    /// every waterfall tile on the map, ordered by layer, then column, then
+    /// row
+    const std::vector<TilePosition> & waterfall_tiles() const
+        { return m_waterfall_tiles; }
+
+    /// parses a tile's "lines" (and related) properties, segments are in
+    /// tile units
+    static TileInfo load_tile_info(const TilePropertyMap &);
+
+private:
+    struct GidEntry {
+        const TilePropertyMap * properties = nullptr;
+        bool is_waterfall = false;
+        bool on_collision_layer = false;
+    };
+
+    void add_collision_gid(int gid, const TilePropertyMap &);
+
+    TileSize m_tile_size;
+    SegmentsInfo m_segments_info;
+    std::unordered_map<int, GidEntry> m_gids;
+    std::map<int, std::string> m_waterfall_strips;
+    std::vector<TilePosition> m_waterfall_tiles;
+};
@@ -19,9 +19,14 @@
 
 #include "Maps.hpp"
 #include "LineMapLoader.hpp"
+#include "LineMapCache.hpp"
+#include "../StageTimer.hpp"
+#include "../Components.hpp"
 
 #include <common/TestSuite.hpp>
 
+#include <iostream>
+
 #include <cassert>
 
 namespace {
@@ -29,48 +34,181 @@ namespace {
 using Error = std::runtime_error;
 using InvArg = std::invalid_argument;
 
-template <typename Type>
-VectorI limit_vector_to(const Grid<Type> & grid, VectorI r) {
+template <typename GridType>
+VectorI limit_vector_to(const GridType & grid, VectorI r) {
     return VectorI(std::max(std::min(r.x, grid.width () - 1), 0),
                    std::max(std::min(r.y, grid.height() - 1), 0));
 }
 
 } // end of <anonymous> namespace
 
+void LayerSegments::make_blank_of_size(int width, int height) {
+    segments.clear();
+    geometry.clear();
+    tiles.clear();
+    tiles.set_size(width, height, Tile());
+    details_palette.assign(1, SurfaceDetails());
+}
+
+int LayerSegments::count_at(VectorI r) const {
+    if (!tiles.has_position(r)) return 0;
+    return int(tiles(r).count);
+}
+
+std::size_t LayerSegments::index_of(VectorI r, int segment_number) const {
+    if (segment_number < 0 || segment_number >= count_at(r)) {
+        throw std::out_of_range("LayerSegments::index_of: tile has no segment "
+                                "with that number.");
+    }
+    return std::size_t(tiles(r).offset) + std::size_t(segment_number);
+}
+
+uint8_t LayerSegments::palette_index_of(const SurfaceDetails & details) {
+    auto itr = std::find(details_palette.begin(), details_palette.end(), details);
+    if (itr != details_palette.end())
+        { return uint8_t(itr - details_palette.begin()); }
+    if (int(details_palette.size()) >= k_max_palette_size) {
+        throw Error("LayerSegments::palette_index_of: layer has too many "
+                    "distinct surface details (maximum "
+                    + std::to_string(k_max_palette_size) + ").");
+    }
+    details_palette.push_back(details);
+    return uint8_t(details_palette.size() - 1);
+}
+
+void LayerSegments::translate(VectorD r) {
+    for (auto & seg : segments) {
+        seg.a += r;
+        seg.b += r;
+    }
+}
+
+void LayerSegments::update_geometry() {
+    geometry.clear();
+    geometry.reserve(segments.size());
+    for (const auto & seg : segments)
+        { geometry.push_back(compute_geometry(seg)); }
+}
+
+void LayerSegments::swap(LayerSegments & rhs) {
+    segments       .swap(rhs.segments       );
+    geometry       .swap(rhs.geometry       );
+    tiles          .swap(rhs.tiles          );
+    details_palette.swap(rhs.details_palette);
+}
+
+// ----------------------------------------------------------------------------
+
+void SegmentNeighborTable::build(const LayerSegments & layer_segments) {
+    static const auto k_neighbor_offsets = {
+        VectorI( 0, 0), // check this tile too
+        VectorI(-1, 0), VectorI( 1, 0), VectorI(0, 1), VectorI(0, -1),
+        VectorI(-1,-1), VectorI(-1, 1), VectorI(1,-1), VectorI(1,  1)
+    };
+    const auto & tiles    = layer_segments.tiles;
+    const auto & segments = layer_segments.segments;
+
+    m_neighbors.clear();
+    m_neighbors_begin.clear();
+    m_neighbors_begin.resize(segments.size()*2 + 1, 0);
+    // runs of neighbors are only contiguous if segments are visited in order
+    std::size_t next_index = 0;
+    for (auto r = tiles.begin_position(); r != tiles.end_position(); r = tiles.next(r)) {
+    for (int i = 0; i != tiles(r).count; ++i) {
+        auto seg_idx = layer_segments.index_of(r, i);
+        if (seg_idx != next_index) {
+            throw InvArg("SegmentNeighborTable::build: tiles' segments must "
+                         "be stored in tile order.");
+        }
+        ++next_index;
+        const auto & current_seg = segments[seg_idx];
+    for (auto end : { LineSegment::k_a, LineSegment::k_b }) {
+        m_neighbors_begin[seg_idx*2 + ((end == LineSegment::k_a) ? 0 : 1)] = int(m_neighbors.size());
+        auto point = (end == LineSegment::k_a) ? current_seg.a : current_seg.b;
+        for (auto noffset : k_neighbor_offsets) {
+            auto tile_pos = noffset + r;
+            for (int j = 0; j != layer_segments.count_at(tile_pos); ++j) {
+                // skip originating segment
+                if (j == i && noffset == VectorI(0, 0)) continue;
+
+                const auto & other_seg = segments[layer_segments.index_of(tile_pos, j)];
+                Neighbor neighbor;
+                if (are_very_close(other_seg.a, point)) {
+                    neighbor.segment_end = LineSegment::k_a;
+                } else if (are_very_close(other_seg.b, point)) {
+                    neighbor.segment_end = LineSegment::k_b;
+                } else {
+                    continue;
+                }
+                neighbor.tile_location  = tile_pos;
+                neighbor.segment_number = j;
+                neighbor.transfer_angles[0] = angle_between(current_seg, other_seg, false);
+                neighbor.transfer_angles[1] = angle_between(current_seg, other_seg, true );
+                m_neighbors.push_back(neighbor);
+            }
+        }
+    }}}
+    m_neighbors_begin.back() = int(m_neighbors.size());
+}
+
+View<SegmentNeighborTable::NeighborIterator> SegmentNeighborTable::neighbors_of
+    (std::size_t segment_index, LineSegmentEnd end) const
+{
+    if (end != LineSegment::k_a && end != LineSegment::k_b) {
+        throw InvArg("SegmentNeighborTable::neighbors_of: end must be either "
+                     "a or b.");
+    }
+    auto idx = segment_index*2 + ((end == LineSegment::k_a) ? 0 : 1);
+    if (idx + 1 >= m_neighbors_begin.size()) {
+        throw std::out_of_range("SegmentNeighborTable::neighbors_of: segment "
+                                "index is out of range.");
+    }
+    return View<NeighborIterator>(m_neighbors.begin() + m_neighbors_begin[idx    ],
+                                  m_neighbors.begin() + m_neighbors_begin[idx + 1]);
+}
+
+void SegmentNeighborTable::swap(SegmentNeighborTable & rhs) {
+    m_neighbors_begin.swap(rhs.m_neighbors_begin);
+    m_neighbors      .swap(rhs.m_neighbors      );
+}
+
+// ----------------------------------------------------------------------------
+
 Surface LineMapLayer::operator ()(const VectorI & tile_loc, int segnum) const {
     static constexpr const char * const k_tile_loc_oor_msg =
         "LineMapLayer::operator(): tile_loc is out of range.";
 
-    auto view = m_segments_grid(tile_loc);
-    if (segnum < 0 || segnum >= int(view.size()))
+    if (segnum < 0 || segnum >= m_segments.count_at(tile_loc))
         throw std::out_of_range(k_tile_loc_oor_msg);
 
-    auto seg = *(view.begin() + segnum);
-    auto offset = get_pixel_offset(tile_loc);
-    seg.a += offset;
-    seg.b += offset;
-
-    return Surface { seg, *m_surface_details(tile_loc) };
+    const auto & tile = m_segments.tiles(tile_loc);
+    auto idx = tile.offset + uint32_t(segnum);
+    return Surface { m_segments.segments[idx],
+                     m_segments.details_palette[tile.details_index],
+                     m_segments.geometry[idx] };
 }
 
-int LineMapLayer::get_segment_count(const VectorI & tile_location) const {
-    if (!m_segments_grid.has_position(tile_location)) return 0;
-    return int(m_segments_grid(tile_location).size());
+int LineMapLayer::get_segment_count(const VectorI & tile_location) const
+    { return m_segments.count_at(tile_location); }
+
+View<const LineSegment *> LineMapLayer::segments_at(VectorI r) const {
+    auto count = m_segments.count_at(r);
+    if (count == 0) return View<const LineSegment *>(nullptr, nullptr);
+    const auto * beg = m_segments.segments.data() + m_segments.tiles(r).offset;
+    return View<const LineSegment *>(beg, beg + count);
 }
 
 void LineMapLayer::load_map_from(LineMapLoader & map_loader, Layer layer) {
-    map_loader.load_layer_into(m_segments_grid, m_surface_details, layer);
-    m_segments = map_loader.get_segments();
-    m_tile_width = map_loader.tile_width();
+    map_loader.load_layer_into(m_segments, m_neighbor_table, layer);
+    m_tile_width  = map_loader.tile_width ();
     m_tile_height = map_loader.tile_height();
-    check_invarients();
+    // loaded segments are untranslated
+    m_segments.translate(m_translation_to_global);
 }
 
 void LineMapLayer::make_blank_of_size(int width_, int height_) {
-    static const LinesView::Container blank_cont;
-    m_segments_grid.set_size(width_, height_, LinesView(blank_cont.begin(), blank_cont.end()));
-    m_surface_details.set_size(width_, height_, nullptr);
-    check_invarients();
+    m_segments.make_blank_of_size(width_, height_);
+    m_neighbor_table.build(m_segments);
 }
 
 VectorD LineMapLayer::get_pixel_offset(VectorI r) const {
@@ -79,7 +217,12 @@ VectorD LineMapLayer::get_pixel_offset(VectorI r) const {
 }
 
 VectorI LineMapLayer::limit_to(VectorI r) const {
-    return limit_vector_to(m_segments_grid, r);
+    return limit_vector_to(m_segments.tiles, r);
+}
+
+void LineMapLayer::set_translation(VectorD r) {
+    m_segments.translate(r - m_translation_to_global);
+    m_translation_to_global = r;
 }
 
 #if 0
@@ -92,11 +235,6 @@ bool LineMapLayer::is_edge_tile(VectorI r) const {
 }
 #endif
 
-/* private */ void LineMapLayer::check_invarients() const {
-    assert(m_segments_grid.height() == m_surface_details.height() &&
-           m_segments_grid.width () == m_surface_details.width ());
-}
-
 // ----------------------------------------------------------------------------
 
 Surface LineMap::operator ()(Layer layer, const VectorI & tile_loc, int segnum) const
@@ -117,11 +255,51 @@ const LineMapLayer & LineMap::get_layer(const Layer & layer) const {
 void LineMap::load_map_from(const tmap::TiledMap & tlmap) {
     LineMapLoader lml;
     lml.load_map(tlmap);
+    load_map_from(lml);
+}
+
+void LineMap::load_map_from
+    (const tmap::TiledMap & tlmap, const std::string & tmx_filename)
+{
+    if (load_compiled(tmx_filename)) return;
+    load_map_from(tlmap);
+}
+
+void LineMap::load_map_from
+    (const tmap::TiledMap & tlmap, const MapTileIndex & tile_index,
+     const std::string & tmx_filename)
+{
+    if (load_compiled(tmx_filename)) return;
+    LineMapLoader lml;
+    lml.load_map(tlmap, tile_index);
+    load_map_from(lml);
+}
+
+void LineMap::load_map_from(LineMapLoader & lml) {
     m_foreground.load_map_from(lml, Layer::foreground);
     m_background.load_map_from(lml, Layer::background);
     lml.load_transitions_into(m_transition_tiles);
 }
 
+/* private */ bool LineMap::load_compiled(const std::string & tmx_filename) {
+    if (!CompiledLineMap::is_current_for(tmx_filename)) return false;
+    CompiledLineMap compiled;
+    auto filename = CompiledLineMap::filename_for(tmx_filename);
+    try {
+        if (!compiled.load_from_file(filename)) return false;
+    } catch (Error & exp) {
+        // corrupt or truncated, the TMX file is still good
+        std::cerr << "Ignoring compiled line map \"" << filename << "\": "
+                  << exp.what() << std::endl;
+        return false;
+    }
+    StageTimer timer("LineMapLoader::load_map (compiled)");
+    LineMapLoader lml;
+    lml.load_map(std::move(compiled));
+    load_map_from(lml);
+    return true;
+}
+
 void LineMap::make_blank_of_size(int width_, int height_) {
     m_foreground.make_blank_of_size(width_, height_);
     m_background.make_blank_of_size(width_, height_);
@@ -20,30 +20,92 @@
 #pragma once
 
 #include "../Defs.hpp"
+#include "../ChunkedGrid.hpp"
 
 #include <memory>
+#include <vector>
+#include <limits>
+
+#include <cstdint>
+
+/// A layer's segments packed for lookups: every segment (in world space)
+/// sits in one contiguous array, and each tile knows where its run begins,
+/// how long it is, and which entry of the details palette applies to it.
+///
+/// Only the tile index is chunked: every segment of the layer stays resident
+/// for as long as the map is loaded, chunks are never paged in or out.
+struct LayerSegments final {
+    struct Tile {
+        uint32_t offset = 0;
+        uint8_t  count  = 0;
+        uint8_t  details_index = 0;
+    };
+
+    static constexpr const int k_max_segments_per_tile = std::numeric_limits<uint8_t>::max();
+    static constexpr const int k_max_palette_size      = std::numeric_limits<uint8_t>::max() + 1;
+
+    std::vector<LineSegment> segments;
+    // parallel to segments
+    std::vector<SegmentGeometry> geometry;
+    // sparse, so that large mostly empty layers stay cheap
+    ChunkedGrid<Tile> tiles;
+    // the first entry is always the default details
+    std::vector<SurfaceDetails> details_palette;
+
+    /// all tiles are empty
+    void make_blank_of_size(int width, int height);
+
+    /// @returns zero if the tile location is not on the layer
+    int count_at(VectorI) const;
+
+    /// @returns index into segments
+    /// @throws if the tile has no such segment
+    std::size_t index_of(VectorI, int segment_number) const;
+
+    /// @returns index of the given details, adding them if need be
+    uint8_t palette_index_of(const SurfaceDetails &);
+
+    void translate(VectorD);
+
+    /// recomputes geometry for all segments
+    void update_geometry();
 
-struct LinesView {
+    void swap(LayerSegments &);
+};
+
+// ----------------------------------------------------------------------------
+
+/// For each end of every segment on a layer, which segments connect to it and
+/// at what angles a tracker transfers onto them. Built once with the map, so
+/// that running off a segment does not need to search neighboring tiles.
+class SegmentNeighborTable final {
 public:
-    using ValueType = LineSegment;
-    using Container = std::vector<ValueType>;
-    using Iterator  = std::vector<ValueType>::const_iterator;
+    struct Neighbor {
+        VectorI tile_location;
+        int segment_number = 0;
+        // the neighbor's end which touches
+        LineSegmentEnd segment_end = LineSegment::k_neither;
+        // indexed by the inverted normal flag of the segment being left
+        std::array<double, 2> transfer_angles = {};
+
+        double transfer_angle(bool inverted_normal) const noexcept
+            { return transfer_angles[inverted_normal ? 1 : 0]; }
+    };
+    using NeighborIterator = std::vector<Neighbor>::const_iterator;
 
-    LinesView() {}
-    LinesView(Iterator beg_, Iterator end_): m_beg(beg_), m_end(end_) {}
+    /// neighbors are found in the same order as the old per transfer search:
+    /// the segment's own tile, then its eight surrounding tiles
+    void build(const LayerSegments &);
 
-    operator bool() const { return m_beg != m_end; }
-    bool operator == (const LinesView & rhs) const { return  is_same_as(rhs); }
-    bool operator != (const LinesView & rhs) const { return !is_same_as(rhs); }
+    /// @param segment_index as given by LayerSegments::index_of
+    View<NeighborIterator> neighbors_of(std::size_t segment_index, LineSegmentEnd) const;
 
-    Iterator begin() const { return m_beg; }
-    Iterator end  () const { return m_end; }
-    std::size_t size() const { return std::size_t(m_end - m_beg); }
+    void swap(SegmentNeighborTable &);
 
 private:
-    bool is_same_as(const LinesView & rhs) const
-        { return rhs.m_beg == m_beg && rhs.m_end == m_end; }
-    Iterator m_beg, m_end;
+    // per segment end, where its neighbors begin (one extra at the end)
+    std::vector<int> m_neighbors_begin;
+    std::vector<Neighbor> m_neighbors;
 };
 
 // ----------------------------------------------------------------------------
@@ -54,21 +116,22 @@ class LineMapLoader;
 
 class LineMapLayer final {
 public:
-    using SegmentsPtr       = std::shared_ptr<std::vector<LineSegment>>;
-    using SurfaceDetailsPtr = std::shared_ptr<std::vector<SurfaceDetails>>;
-
     Surface operator () (const VectorI &, int) const;
 
     int get_segment_count(const VectorI &) const;
 
+    /// all segments of a tile, which are contiguous
+    /// @returns an empty view if the tile location is not on the layer
+    View<const LineSegment *> segments_at(VectorI) const;
+
     void load_map_from(LineMapLoader &, Layer);
     void make_blank_of_size(int width, int height);
 
     double tile_width () const { return m_tile_width ; }
     double tile_height() const { return m_tile_height; }
 
-    int height() const { return m_segments_grid.height(); }
-    int width () const { return m_segments_grid.width (); }
+    int height() const { return m_segments.tiles.height(); }
+    int width () const { return m_segments.tiles.width (); }
 
     /// translates tile location to pixel location even if that tile location
     /// is out of the map's boundaries
@@ -77,26 +140,29 @@ public:
     VectorI limit_to(VectorI) const;
 
     bool has_position(VectorI r) const noexcept
-        { return m_segments_grid.has_position(r); }
+        { return m_segments.tiles.has_position(r); }
+
+    /// segments connecting to the given end of a segment
+    View<SegmentNeighborTable::NeighborIterator> neighbors_of
+        (VectorI tile_location, int segment_number, LineSegmentEnd end) const
+    {
+        return m_neighbor_table.neighbors_of
+            (m_segments.index_of(tile_location, segment_number), end);
+    }
 #   if 0
     VectorI tile_location_of(VectorD) const;
 
     bool is_edge_tile(VectorI) const;
 #   endif
-    void set_translation(VectorD r)
-        { m_translation_to_global = r; }
-
-private:
-    void check_invarients() const;
+    /// segments are stored in world space, so they're moved here
+    void set_translation(VectorD);
 
-    SegmentsPtr m_segments;
-    SurfaceDetailsPtr m_details_ptr;
+    VectorD translation() const { return m_translation_to_global; }
 
-    // addresses live in m_segments
-    Grid<LinesView> m_segments_grid;
+private:
+    LayerSegments m_segments;
 
-    // addresses live in m_details_ptr
-    Grid<const SurfaceDetails *> m_surface_details;
+    SegmentNeighborTable m_neighbor_table;
 
     double m_tile_width = 0., m_tile_height = 0.;
 
@@ -106,6 +172,7 @@ private:
 // ----------------------------------------------------------------------------
 
 namespace tmap { class TiledMap; }
+class MapTileIndex;
 
 enum class TransitionTileType : uint8_t {
     no_transition,
@@ -124,6 +191,14 @@ public:
     const LineMapLayer & get_layer(const Layer &) const;
 
     void load_map_from(const tmap::TiledMap &);
+    /// uses the compiled line map next to the TMX file if it's up to date,
+    /// the TilEd map otherwise (see CompiledLineMap)
+    void load_map_from(const tmap::TiledMap &, const std::string & tmx_filename);
+    /// as above, with the TilEd map already indexed
+    void load_map_from(const tmap::TiledMap &, const MapTileIndex &,
+                       const std::string & tmx_filename);
+    /// takes everything from an already loaded loader
+    void load_map_from(LineMapLoader &);
     void make_blank_of_size(int width, int height);
 
     bool tile_in_transition(VectorI) const;
@@ -144,7 +219,12 @@ public:
         m_foreground.set_translation(r);
         m_background.set_translation(r);
     }
+
+    VectorD translation() const { return m_foreground.translation(); }
 private:
+    /// @returns false if there's no up to date compiled line map to load
+    bool load_compiled(const std::string & tmx_filename);
+
     LineMapLayer m_foreground;
     LineMapLayer m_background;
 
@@ -153,19 +233,9 @@ private:
 
 // ----------------------------------------------------------------------------
 
-template <typename T>
-VectorI limit_to(VectorI r, const Grid<T> & grid) {
+template <typename GridType>
+VectorI limit_to(VectorI r, const GridType & grid) {
     return VectorI(std::min(std::max(r.x, 0), grid.width () - 1),
                    std::min(std::max(r.y, 0), grid.height() - 1));
 
 }
-
-inline std::size_t ref_to_index(const LinesView & view, const LinesView::ValueType & ref) {
-    static constexpr const char * k_not_belong_msg =
-        "ref does not belong to the container";
-    if (view.size() == 0) { throw std::invalid_argument(k_not_belong_msg); }
-    auto * beg = &*view.begin();
-    auto * end = beg + view.size();
-    if (&ref < beg || &ref >= end) { throw std::invalid_argument(k_not_belong_msg); }
-    return std::size_t(&ref - beg);
-}
@@ -18,10 +18,14 @@
 *****************************************************************************/
 
 #include "DrawSystems.hpp"
+#include "../RecordingGraphics.hpp"
 
 #include <SFML/Graphics/RenderTarget.hpp>
 
 #include <common/SfmlVectorTraits.hpp>
+#include <common/TestSuite.hpp>
+
+#include <algorithm>
 
 #include <cassert>
 
@@ -90,35 +94,37 @@
 
 // ----------------------------------------------------------------------------
 
-/* private */ void DrawSystem::update(const Entity & e) {
+/* private */ void DrawSystem::draw(const Entity & e) {
     if (!e.has<DisplayFrame>()) return;
     if (!e.get<PhysicsComponent>().state_is_valid()) return;
     const auto & df = e.get<DisplayFrame>();
     if (df.is_type<ColorCircle>()) {
-        update(e, df.as<ColorCircle>());
+        draw(e, df.as<ColorCircle>());
     } else if (df.is_type<CharacterAnimator>()) {
-        update(e, df.as<CharacterAnimator>());
+        draw(e, df.as<CharacterAnimator>());
     } else if (df.is_type<SingleImage>()) {
-        update(e, df.as<SingleImage>());
+        draw(e, df.as<SingleImage>());
     }
 }
 
-/* private */ void DrawSystem::update(const Entity & e, const ColorCircle & color_circle) {
+/* private */ void DrawSystem::draw(const Entity & e, const ColorCircle & color_circle) {
     VectorD loc;
     if (auto holder = get_holder(e.get<PhysicsComponent>())) {
         loc = hand_point_of<HeadOffset, PhysicsComponent>(Entity(holder));
     } else {
         loc = e.get<PhysicsComponent>().location() - VectorD(0, color_circle.radius);
     }
+    loc = draw_location_of(e, loc);
     graphics().draw_circle(loc, color_circle.radius, color_circle.color);
 }
 
-/* private */ void DrawSystem::update(const Entity & e, const CharacterAnimator & animator) {
+/* private */ void DrawSystem::draw(const Entity & e, const CharacterAnimator & animator) {
     sf::Sprite spt;
     // need to translate for frame's size
     animator.sprite_sheet->bind_to(spt, animator.current_sequence, animator.current_frame);
     VectorD foot_anchor(double(spt.getTextureRect().width)*0.5, double(spt.getTextureRect().height));
     static constexpr const auto k_high_run_speed = CharacterAnimator::k_high_run_speed_thershold;
+    const auto loc = draw_location_of(e, e.get<PhysicsComponent>().location());
 
     [this](Entity e, VectorD r) {
         auto & vec = m_previous_positions[e];
@@ -129,9 +135,9 @@
         }
         if (vec.size() > max_history)
             vec.erase(vec.begin(), vec.begin() + (vec.size() - max_history));
-    } (e, e.get<PhysicsComponent>().location());
+    } (e, loc);
 
-    spt.setPosition(convert_to<sf::Vector2f>(e.get<PhysicsComponent>().location()));
+    spt.setPosition(convert_to<sf::Vector2f>(loc));
     spt.setOrigin(convert_to<sf::Vector2f>(foot_anchor));
     if (e.get<PlayerControl>().last_direction == PlayerControl::k_left) {
         spt.setScale(-1.f, 1.f);
@@ -171,11 +177,11 @@
     } (e, spt);
 }
 
-/* private */ void DrawSystem::update(const Entity & e, const SingleImage & simg) {
+/* private */ void DrawSystem::draw(const Entity & e, const SingleImage & simg) {
     sf::Sprite spt;
     spt.setTexture(*simg.texture);
     spt.setTextureRect(simg.texture_rectangle);
-    auto loc = e.get<PhysicsComponent>().location();
+    auto loc = draw_location_of(e, e.get<PhysicsComponent>().location());
     if (!e.get<PhysicsComponent>().state_is_type<Rect>()) {
         Rect text_bounds = Rect(simg.texture_rectangle.left, simg.texture_rectangle.top, simg.texture_rectangle.width, simg.texture_rectangle.height);
         loc -= VectorD(text_bounds.width*0.5, text_bounds.height);
@@ -200,3 +206,64 @@
     spt.setPosition(convert_to<sf::Vector2f>(loc));
     graphics().draw_sprite(spt);
 }
+
+/* static */ void DrawSystem::run_tests() {
+    using namespace cul;
+    ts::TestSuite suite;
+    suite.start_series("DrawSystem tests");
+    struct Scene {
+        Scene() {
+            body = emanager.create_new_entity();
+            body.add<PhysicsComponent>().reset_state<FreeBody>();
+            add_color_circle(body, sf::Color::White);
+            draw.setup_queries(index);
+            draw.assign_graphics(gfx);
+            emanager.register_system(&index);
+            emanager.register_system(&draw);
+        }
+
+        // as GameDriver does it: any number of steps, then one draw
+        const std::vector<RecordingGraphics::Command> &
+            run_frame(int steps, double alpha = 1.)
+        {
+            for (int i = 0; i != steps; ++i) {
+                body.get<PhysicsComponent>().state_as<FreeBody>().location += VectorD(10., 0.);
+                emanager.update_systems();
+            }
+            draw.set_step_interpolation(alpha);
+            gfx.reset_for_new_frame();
+            draw.draw_frame();
+            return gfx.commands();
+        }
+
+        static int circles_in(const std::vector<RecordingGraphics::Command> & commands) {
+            return int(std::count_if(commands.begin(), commands.end(),
+                [](const RecordingGraphics::Command & cmd)
+                { return cmd.type == RecordingGraphics::k_circle; }));
+        }
+
+        EntityManager emanager;
+        Entity body;
+        EntityQueryIndex index;
+        RecordingGraphics gfx;
+        DrawSystem draw;
+    };
+    // many steps in one frame, still drawn once
+    suite.test([]() {
+        Scene scene;
+        return ts::test(Scene::circles_in(scene.run_frame(2)) == 1);
+    });
+    // no step in a frame, still drawn
+    suite.test([]() {
+        Scene scene;
+        scene.run_frame(1);
+        return ts::test(Scene::circles_in(scene.run_frame(0)) == 1);
+    });
+    // drawn between the last two steps
+    suite.test([]() {
+        Scene scene;
+        const auto & commands = scene.run_frame(2, 0.5);
+        return ts::test(   Scene::circles_in(commands) == 1
+                        && std::abs(commands.front().x - 15.f) < 0.001f);
+    });
+}
@@ -20,12 +20,22 @@
 #pragma once
 
 #include "SystemsDefs.hpp"
+#include "EntityQuery.hpp"
 
 #include <SFML/Graphics/Sprite.hpp>
 
-class AnimatorSystem final : public System, public TimeAware {
-    void update(const ContainerView & cont) override
-        { for (auto & e : cont) { update(e); } }
+class AnimatorSystem final : public System, public TimeAware, public QueryAware {
+public:
+    static SystemAccess access() {
+        return SystemAccess().reads<PhysicsComponent, Platform>().writes<DisplayFrame>();
+    }
+
+    void setup_queries(EntityQueryIndex & index) override
+        { m_animated = &index.query_for<DisplayFrame, PhysicsComponent>(); }
+
+private:
+    void update(const ContainerView &) override
+        { for (auto e : *m_animated) { update(e); } }
 
     void update(Entity & e) {
         if (!e.has<DisplayFrame>() || !e.has<PhysicsComponent>()) return;
@@ -45,36 +55,85 @@ class AnimatorSystem final : public System, public TimeAware {
 
     static void update_character_animation
         (double elapsed_time, const CharAniUpdate &, CharacterAnimator &);
+
+    const EntityQuery * m_animated = nullptr;
 };
 
-class DrawSystem final : public System, public GraphicsAware {
-    void update(const ContainerView & cont) override {
-        for (auto & e : cont) update(e);
+class DrawSystem final :
+    public System, public GraphicsAware, public QueryAware, public FrameDrawer
+{
+public:
+    static SystemAccess access()
+        { return SystemAccess().reads<DisplayFrame, PhysicsComponent>(); }
+
+    void setup_queries(EntityQueryIndex & index) override
+        { m_drawn = &index.query_for<DisplayFrame>(); }
+
+    void draw_frame() override
+        { for (const auto & e : *m_drawn) draw(e); }
+
+    static void run_tests();
+
+private:
+    void update(const ContainerView &) override {
+        m_step_positions.on_new_step();
+        for (const auto & e : *m_drawn) {
+            const auto * pcomp = e.ptr<PhysicsComponent>();
+            if (!pcomp || !pcomp->state_is_valid()) continue;
+            m_step_positions.record(e, pcomp->location());
+        }
     }
 
-    void update(const Entity &);
+    void draw(const Entity &);
 
-    void update(const Entity &, const ColorCircle &);
+    VectorD draw_location_of(const Entity & e, VectorD r) const
+        { return m_step_positions.interpolate(e, r, step_interpolation()); }
 
-    void update(const Entity &, const CharacterAnimator &);
+    void draw(const Entity &, const ColorCircle &);
 
-    void update(const Entity & e, const SingleImage &);
+    void draw(const Entity &, const CharacterAnimator &);
+
+    void draw(const Entity & e, const SingleImage &);
 
     static constexpr const std::size_t k_max_loc_history = 3;
     std::unordered_map<Entity, std::vector<VectorD>, EntityHasher> m_previous_positions;
+    StepPositions m_step_positions;
+    const EntityQuery * m_drawn = nullptr;
 };
 
-class PlatformDrawer final : public System, public GraphicsAware {
-    void update(const ContainerView & cont) override {
-        for (auto e : cont) {
+class PlatformDrawer final :
+    public System, public GraphicsAware, public QueryAware, public FrameDrawer
+{
+public:
+    static SystemAccess access() { return SystemAccess().reads<Platform>(); }
+
+    void setup_queries(EntityQueryIndex & index) override
+        { m_platforms = &index.query_for<Platform>(); }
+
+    void draw_frame() override {
+        for (auto e : *m_platforms) {
+            if (!e.has<Platform>()) continue;
+            draw(e, e.get<Platform>());
+        }
+    }
+
+private:
+    void update(const ContainerView &) override {
+        m_step_positions.on_new_step();
+        for (auto e : *m_platforms) {
             if (!e.has<Platform>()) continue;
-            update(e.get<Platform>());
+            m_step_positions.record(e, e.get<Platform>().offset());
         }
     }
 
-    void update(const Platform & platform) {
+    void draw(const Entity & e, const Platform & platform) {
+        auto offset = platform.offset();
+        auto shift  = m_step_positions.interpolate(e, offset, step_interpolation()) - offset;
         for (LineSegment surface : platform.surface_view()) {
-            graphics().draw_line(surface.a, surface.b, sf::Color::Cyan, 3.);
+            graphics().draw_line(surface.a + shift, surface.b + shift, sf::Color::Cyan, 3.);
         }
     }
+
+    StepPositions m_step_positions;
+    const EntityQuery * m_platforms = nullptr;
 };
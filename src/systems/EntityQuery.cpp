@@ -0,0 +1,171 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "EntityQuery.hpp"
+
+#include <common/TestSuite.hpp>
+
+#include <algorithm>
+
+/* private */ uint64_t EntityQueryIndex::signature_of(const Entity & e) const {
+    uint64_t rv = 0;
+    for (std::size_t i = 0; i != m_has_funcs.size(); ++i) {
+        if (m_has_funcs[i](e)) rv |= (uint64_t(1) << i);
+    }
+    return rv;
+}
+
+void EntityQueryIndex::apply_changes() {
+    // (a change noted more than once is simply found to be no change after
+    //  the first)
+    for (const auto & e : m_changed) {
+        auto new_sig = signature_of(e);
+        auto itr = m_entity_signatures.find(e);
+        auto old_sig = itr == m_entity_signatures.end() ? 0 : itr->second;
+        if (old_sig == new_sig) continue;
+        change_signature(e, old_sig, new_sig);
+        if (!new_sig) {
+            m_entity_signatures.erase(itr);
+        } else {
+            m_entity_signatures[e] = new_sig;
+        }
+    }
+    m_changed.clear();
+}
+
+void EntityQueryIndex::drop_deleted() {
+    for (auto itr = m_entity_signatures.begin(); itr != m_entity_signatures.end(); ) {
+        if (!itr->first.is_requesting_deletion()) {
+            ++itr;
+            continue;
+        }
+        change_signature(itr->first, itr->second, 0);
+        itr = m_entity_signatures.erase(itr);
+    }
+}
+
+/* private */ void EntityQueryIndex::change_signature
+    (const Entity & e, uint64_t old_sig, uint64_t new_sig)
+{
+    for (auto & query : m_queries) {
+        auto mask = query->m_mask;
+        bool was_in = (old_sig & mask) == mask;
+        bool is_in  = (new_sig & mask) == mask;
+        if (was_in == is_in) continue;
+        auto & entities = query->m_entities;
+        if (is_in) {
+            entities.push_back(e);
+        } else {
+            // order is kept, systems may depend on it (e.g. drawing)
+            entities.erase(std::find(entities.begin(), entities.end(), e));
+        }
+    }
+}
+
+/* static */ void EntityQueryIndex::run_tests() {
+    using namespace cul;
+    ts::TestSuite suite;
+    suite.start_series("EntityQueryIndex tests");
+    // lists hold exactly the matching entities, in order
+    suite.test([]() {
+        EntityManager emanager;
+        std::vector<Entity> entities;
+        for (int i = 0; i != 6; ++i) {
+            auto e = emanager.create_new_entity();
+            if (i % 2 == 0) e.add<Lifetime>();
+            if (i % 3 == 0) e.add<Snake>();
+            entities.push_back(e);
+        }
+        EntityQueryIndex index;
+        const auto & lifetimes = index.query_for<Lifetime>();
+        const auto & both      = index.query_for<Lifetime, Snake>();
+        index.refresh(entities);
+        return ts::test(   lifetimes.size() == 3 && both.size() == 1
+                        && *(lifetimes.begin() + 1) == entities[2]
+                        && *(lifetimes.begin() + 2) == entities[4]
+                        && *both.begin() == entities[0]);
+    });
+    // same signature, same query
+    suite.test([]() {
+        EntityQueryIndex index;
+        const auto & a = index.query_for<Lifetime, Snake>();
+        const auto & b = index.query_for<Lifetime, Snake>();
+        index.query_for<Snake>();
+        return ts::test(&a == &b && index.query_count() == 2);
+    });
+    // removals are seen on the next refresh
+    suite.test([]() {
+        EntityManager emanager;
+        auto e = emanager.create_new_entity();
+        e.add<Lifetime>();
+        std::vector<Entity> entities { e };
+        EntityQueryIndex index;
+        const auto & lifetimes = index.query_for<Lifetime>();
+        index.refresh(entities);
+        auto size_before = lifetimes.size();
+        e.remove<Lifetime>();
+        index.refresh(entities);
+        return ts::test(size_before == 1 && lifetimes.size() == 0);
+    });
+    // entities made mid frame are listed once changes are applied, without
+    // another refresh (e.g. snake balls, drawn the same frame they're made)
+    suite.test([]() {
+        EntityManager emanager;
+        auto e = emanager.create_new_entity();
+        e.add<Lifetime>();
+        std::vector<Entity> entities { e };
+        EntityQueryIndex index;
+        const auto & lifetimes = index.query_for<Lifetime>();
+        const auto & both      = index.query_for<Lifetime, Snake>();
+        index.refresh(entities);
+        auto made = emanager.create_new_entity();
+        made.add<Lifetime>();
+        made.add<Snake>();
+        {
+        EntityChangeListener::Scope scope(index);
+        EntityChangeListener::notify(made);
+        }
+        index.apply_changes();
+        return ts::test(   lifetimes.size() == 2 && *(lifetimes.begin() + 1) == made
+                        && both.size() == 1 && *both.begin() == made);
+    });
+    // removed components, and entities requesting deletion, leave lists
+    suite.test([]() {
+        EntityManager emanager;
+        auto a = emanager.create_new_entity();
+        auto b = emanager.create_new_entity();
+        for (auto e : { a, b }) {
+            e.add<Lifetime>();
+            e.add<Snake>();
+        }
+        std::vector<Entity> entities { a, b };
+        EntityQueryIndex index;
+        const auto & lifetimes = index.query_for<Lifetime>();
+        const auto & snakes    = index.query_for<Snake>();
+        index.refresh(entities);
+        a.remove<Snake>();
+        index.note_changed(a);
+        index.apply_changes();
+        bool removal_seen = snakes.size() == 1 && *snakes.begin() == b;
+        b.request_deletion();
+        index.drop_deleted();
+        return ts::test(   removal_seen && snakes.size() == 0
+                        && lifetimes.size() == 1 && *lifetimes.begin() == a);
+    });
+}
@@ -0,0 +1,194 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "SystemsDefs.hpp"
+
+#include <memory>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+/// A packed list of the entities having every component of a signature.
+///
+/// After a full refresh, lists are in the same order as the entity manager's
+/// view. Entities which come to match afterward are added to the end, in the
+/// order their changes were applied. Changes are applied after each system
+/// that may make them (see EntityQueryIndex), so a system earlier in the
+/// frame doesn't see entities made later in it. Removals are applied the same
+/// way, so systems should still check anything that may be removed by
+/// another system updating alongside them.
+class EntityQuery final {
+public:
+    using Iterator = std::vector<Entity>::const_iterator;
+
+    Iterator begin() const { return m_entities.begin(); }
+
+    Iterator end() const { return m_entities.end(); }
+
+    std::size_t size() const noexcept { return m_entities.size(); }
+
+private:
+    friend class EntityQueryIndex;
+
+    explicit EntityQuery(uint64_t mask): m_mask(mask) {}
+
+    uint64_t m_mask;
+    std::vector<Entity> m_entities;
+};
+
+/// Keeps every query's list, up to date with entities as they change.
+///
+/// Each entity's signature (over only those component types some query
+/// asks for) is kept, and matched against each query with a single mask
+/// test. This replaces each system checking has<> on every entity for itself.
+///
+/// Lists are kept up to date incrementally: the index listens for entities
+/// being made or having components added/removed (EntityChangeListener), and
+/// re-finds only those entities' signatures. Entities requesting deletion are
+/// dropped just before deletions are processed. The whole view is only walked
+/// on the first update, and after new queries are made.
+class EntityQueryIndex final : public System, public EntityChangeListener {
+public:
+    // one bit per component type in a signature
+    static constexpr const std::size_t k_max_component_types = 64;
+
+    /// applies changes noted by the index it was made for, registered after
+    /// each system which may make or change entities
+    class ChangeApplier final : public System {
+    public:
+        explicit ChangeApplier(EntityQueryIndex & index): m_index(&index) {}
+
+    private:
+        void update(const ContainerView &) override { m_index->apply_changes(); }
+
+        EntityQueryIndex * m_index;
+    };
+
+    /// queries for the same set (in the same order) of types are shared
+    /// @returns a reference which stays valid for the index's lifetime
+    template <typename ... Types>
+    const EntityQuery & query_for();
+
+    /// rebuilds every query's list from a container of entities, anything not
+    /// in the container is forgotten
+    template <typename EntityCont>
+    void refresh(const EntityCont &);
+
+    /// e is looked at again on the next call to apply_changes
+    void note_changed(const Entity & e) { m_changed.push_back(e); }
+
+    /// updates lists for every entity noted as changed since the last call
+    void apply_changes();
+
+    /// removes every entity requesting deletion from all lists, must be
+    /// called before deletion requests are processed
+    void drop_deleted();
+
+    std::size_t query_count() const noexcept { return m_queries.size(); }
+
+    static void run_tests();
+
+private:
+    using HasFunc = bool(*)(const Entity &);
+    using SignatureMap = std::unordered_map<Entity, uint64_t, EntityHasher>;
+
+    void update(const ContainerView & view) override {
+        if (m_needs_refresh) { refresh(view); }
+        else                 { apply_changes(); }
+    }
+
+    void on_entity_changed(const Entity & e) override { note_changed(e); }
+
+    template <typename T>
+    uint64_t bit_for();
+
+    uint64_t signature_of(const Entity &) const;
+
+    /// moves e between lists, going from one signature to another
+    void change_signature(const Entity &, uint64_t old_sig, uint64_t new_sig);
+
+    std::vector<HasFunc> m_has_funcs;
+    std::unordered_map<std::type_index, uint64_t> m_type_bits;
+    std::unordered_map<std::type_index, EntityQuery *> m_signatures;
+    std::vector<std::unique_ptr<EntityQuery>> m_queries;
+    // only entities having at least one queried type
+    SignatureMap m_entity_signatures;
+    std::vector<Entity> m_changed;
+    bool m_needs_refresh = true;
+};
+
+/// systems which walk queries (see EntityQuery), rather than the whole view
+class QueryAware {
+public:
+    /// queries should be made here
+    virtual void setup_queries(EntityQueryIndex &) = 0;
+protected:
+    QueryAware() {}
+    ~QueryAware() {}
+};
+
+// ----------------------------------------------------------------------------
+
+template <typename ... Types>
+const EntityQuery & EntityQueryIndex::query_for() {
+    static_assert(sizeof...(Types) > 0, "queries must ask for at least one type");
+    std::type_index key = typeid(cul::TypeList<Types...>);
+    auto itr = m_signatures.find(key);
+    if (itr != m_signatures.end()) return *itr->second;
+    uint64_t mask = (bit_for<Types>() | ...);
+    m_queries.emplace_back(new EntityQuery(mask));
+    // the new list has to be filled from scratch
+    m_needs_refresh = true;
+    m_signatures[key] = m_queries.back().get();
+    return *m_queries.back();
+}
+
+template <typename EntityCont>
+void EntityQueryIndex::refresh(const EntityCont & cont) {
+    for (auto & query : m_queries) {
+        query->m_entities.clear();
+    }
+    m_entity_signatures.clear();
+    m_changed.clear();
+    m_needs_refresh = false;
+    if (m_queries.empty()) return;
+    for (const auto & e : cont) {
+        auto sig = signature_of(e);
+        if (!sig) continue;
+        m_entity_signatures[e] = sig;
+        change_signature(e, 0, sig);
+    }
+}
+
+template <typename T>
+/* private */ uint64_t EntityQueryIndex::bit_for() {
+    std::type_index key = typeid(T);
+    auto itr = m_type_bits.find(key);
+    if (itr != m_type_bits.end()) return itr->second;
+    if (m_has_funcs.size() == k_max_component_types) {
+        throw std::runtime_error("EntityQueryIndex::bit_for: too many component "
+                                 "types are used in queries.");
+    }
+    uint64_t bit = uint64_t(1) << m_has_funcs.size();
+    m_has_funcs.push_back([](const Entity & e) { return e.has<T>(); });
+    m_type_bits[key] = bit;
+    return bit;
+}
@@ -20,12 +20,188 @@
 #include "EnvironmentCollisionSystem.hpp"
 #include "LineTrackerPhysics.hpp"
 #include "FreeBodyPhysics.hpp"
+#include "SystemScheduler.hpp"
+
+#include "../maps/Maps.hpp"
+#include "../maps/LineMapLoader.hpp"
+
+#include <common/TestSuite.hpp>
 
 #include <iostream>
 
 #include <cassert>
 
 /* static */ void EnvironmentCollisionSystem::run_tests() {
+    run_freebody_physics_tests();
+    {
+    using namespace cul;
+    ts::TestSuite suite;
+    suite.start_series("EnvironmentCollisionSystem et debt tests");
+    // a map with one lone flat segment, in the middle of a 3x3 tile map
+    static auto make_lone_segment_map = []() {
+        static constexpr const double k_tile_size = 16.;
+        LineMapLoader::SegmentsInfo nfo;
+        nfo.segment_map[1].segments.emplace_back(4., 8., 12., 8.);
+        nfo.total_segments_count = 1;
+        Grid<int> gids;
+        gids.set_size(3, 3, 0);
+        gids(VectorI(1, 1)) = 1;
+        LineMapLoader::TileSize tsize;
+        tsize.width = tsize.height = k_tile_size;
+        LineMapLoader loader;
+        loader.load_map(nfo, gids, gids, tsize);
+        auto rv = std::make_unique<LineMap>();
+        rv->load_map_from(loader);
+        return rv;
+    };
+    // tracker at "position", running along the segment at "speed"
+    static auto make_tracker_body = []
+        (EntityManager & emanager, const LineMap & map, double position, double speed)
+    {
+        auto body = emanager.create_new_entity();
+        auto & pcomp = body.add<PhysicsComponent>();
+        pcomp.active_layer = Layer::foreground;
+        SurfaceRef ref;
+        ref.set(map.get_layer(Layer::foreground), VectorI(1, 1), 0);
+        auto & tracker = pcomp.reset_state<LineTracker>();
+        tracker.set_surface_ref(ref);
+        tracker.position = position;
+        tracker.speed    = speed;
+        // normal facing up (against gravity)
+        tracker.inverted_normal = normal_for(*ref, false).y > 0.;
+        return body;
+    };
+    // a budget cut owes everything it was given
+    suite.test([]() {
+        EntityManager emanager;
+        auto map = make_lone_segment_map();
+        PlatformBroadphase platforms;
+        auto body = make_tracker_body(emanager, *map, 0.5, 0.1);
+        auto & pcomp = body.get<PhysicsComponent>();
+        EnvColParams ecp(pcomp, *map, nullptr, platforms);
+        ecp.set_owner(body);
+        for (int i = 0; i != EnvColParams::k_handler_call_budget; ++i)
+            { ecp.take_handler_call(); }
+        handle_tracker_physhics(ecp, 0.1);
+        return ts::test(   magnitude(pcomp.et_debt - 0.1) < k_error
+                        && pcomp.state_ptr<LineTracker>()
+                        && pcomp.state_as<LineTracker>().position == 0.5);
+    });
+    // flying off owes the time past reaching the segment's end
+    suite.test([]() {
+        EntityManager emanager;
+        auto map = make_lone_segment_map();
+        PlatformBroadphase platforms;
+        // reaches the end at 0.025, of a 0.1 update (and fast enough that
+        // friction doesn't stop it first)
+        auto body = make_tracker_body(emanager, *map, 0.5, 20.);
+        auto & pcomp = body.get<PhysicsComponent>();
+        EnvColParams ecp(pcomp, *map, nullptr, platforms);
+        ecp.set_owner(body);
+        handle_tracker_physhics(ecp, 0.1);
+        return ts::test(   pcomp.state_ptr<FreeBody>()
+                        && magnitude(pcomp.et_debt - 0.075) < 0.001);
+    });
+    }
+    {
+    using namespace cul;
+    ts::TestSuite suite;
+    suite.start_series("EnvironmentCollisionSystem thread tests");
+    // records the order bodies land on its platform
+    class LandingRecorder final : public Script {
+    public:
+        explicit LandingRecorder(std::vector<EntityRef> & landings):
+            m_landings(landings) {}
+
+        void on_landing(Entity, VectorD, EntityRef other) override
+            { m_landings.push_back(other); }
+
+    private:
+        std::vector<EntityRef> & m_landings;
+    };
+    struct SceneResults {
+        std::vector<VectorD> locations;
+        std::vector<int> landing_order;
+        EnvColCounters counters;
+    };
+    // many batches worth of bodies falling onto a platform, for two frames
+    static auto run_scene = [](int thread_count) {
+        static constexpr const int k_body_count =
+            int(EnvironmentCollisionSystem::k_bodies_per_batch)*3 + 5;
+        LineMapLoader::SegmentsInfo nfo;
+        Grid<int> gids;
+        gids.set_size(4, 4, 0);
+        LineMapLoader::TileSize tsize;
+        tsize.width = tsize.height = 16.;
+        LineMapLoader loader;
+        loader.load_map(nfo, gids, gids, tsize);
+        LineMap map;
+        map.load_map_from(loader);
+
+        EntityManager emanager;
+        std::vector<EntityRef> landings;
+        auto platform = emanager.create_new_entity();
+        platform.add<Platform>().set_surfaces(std::vector<Surface>
+            { Surface(LineSegment(VectorD(0., 40.), VectorD(64., 40.))) });
+        platform.add<ScriptUPtr>() = std::make_unique<LandingRecorder>(landings);
+        std::vector<Entity> bodies;
+        for (int i = 0; i != k_body_count; ++i) {
+            auto body = emanager.create_new_entity();
+            auto & pcomp = body.add<PhysicsComponent>();
+            pcomp.active_layer = Layer::foreground;
+            auto & freebody = pcomp.reset_state<FreeBody>();
+            // some reach the platform in the first frame, the rest in the
+            // second
+            freebody.location = VectorD(2. + double(i % 60), 25. + double(i % 7)*1.5);
+            freebody.velocity = VectorD(double(i % 5) - 2., 100.);
+            bodies.push_back(body);
+        }
+
+        std::unique_ptr<SystemWorkerPool> pool;
+        EntityQueryIndex index;
+        EnvironmentCollisionSystem envcol;
+        envcol.setup_queries(index);
+        envcol.assign_map(map);
+        envcol.set_elapsed_time(0.1);
+        if (thread_count > 1) {
+            pool = std::make_unique<SystemWorkerPool>(thread_count);
+            envcol.assign_worker_pool(*pool);
+        }
+        emanager.register_system(&index);
+        emanager.register_system(&envcol);
+
+        auto & counters = EnvColCounters::instance();
+        counters.reset();
+        emanager.update_systems();
+        emanager.update_systems();
+
+        SceneResults rv;
+        rv.counters = counters;
+        for (const auto & body : bodies)
+            { rv.locations.push_back(body.get<PhysicsComponent>().location()); }
+        for (const auto & ref : landings) {
+            auto itr = std::find(bodies.begin(), bodies.end(), Entity(ref));
+            rv.landing_order.push_back(int(itr - bodies.begin()));
+        }
+        return rv;
+    };
+    // results, callback order, and counts, don't depend on the thread count
+    suite.test([]() {
+        auto one  = run_scene(1);
+        auto many = run_scene(4);
+        return ts::test(   !one.landing_order.empty()
+                        && one.locations     == many.locations
+                        && one.landing_order == many.landing_order
+                        && one.counters.bisection_probes    == many.counters.bisection_probes
+                        && one.counters.budget_exhaustions  == many.counters.budget_exhaustions
+                        && one.counters.max_recursion_depth == many.counters.max_recursion_depth);
+    });
+    // worker threads' counts reach the updating thread
+    suite.test([]() {
+        auto many = run_scene(4);
+        return ts::test(many.counters.max_recursion_depth > 0);
+    });
+    }
 #   if 0
     static auto test_refl = []
         (double ax, double ay, double bx, double by,
@@ -50,6 +226,7 @@ EnvColParams::EnvColParams
      const PlatformsCont & platforms_):
     bounce_thershold (pcomp.bounce_thershold),
     layer            (pcomp.active_layer),
+    et_debt          (pcomp.et_debt),
     map              (map_),
     platforms        (platforms_)
 {
@@ -60,20 +237,67 @@ EnvColParams::EnvColParams
     }
 }
 
+bool EnvColParams::take_handler_call() {
+    if (m_handler_calls_left > 0) {
+        --m_handler_calls_left;
+        return true;
+    }
+    // counted once per update
+    if (!m_budget_spent) ++EnvColCounters::instance().budget_exhaustions;
+    m_budget_spent = true;
+    return false;
+}
+
+void EnvColParams::incur_et_debt(double et) {
+    if (!is_real(et) || et <= 0.) return;
+    et_debt = std::min(et_debt + et, k_max_et_debt);
+}
+
+double EnvColParams::repay_et_debt(double max_et) {
+    auto paid = std::min(et_debt, max_et);
+    et_debt -= paid;
+    return paid;
+}
+
 // ----------------------------------------------------------------------------
 
-/* private */ void EnvironmentCollisionSystem::update(const ContainerView & cont) {
-    m_platforms.clear();
-    for (auto & e : cont) {
-        if (e.has<Platform>()) m_platforms.push_back(e);
+/* private */ void EnvironmentCollisionSystem::update(const ContainerView &) {
+    // only platforms whose bounds changed are re-bucketed
+    m_platform_broadphase.update(*m_platforms);
+
+    auto batch_count = (m_bodies->size() + k_bodies_per_batch - 1) / k_bodies_per_batch;
+    if (m_deferred_calls.size() < batch_count) {
+        m_deferred_calls.resize(batch_count);
+        m_batch_counters.resize(batch_count);
+    }
+    if (auto * pool = worker_pool()) {
+        pool->run(batch_count, [this](std::size_t idx) { update_batch(idx); });
+    } else {
+        for (std::size_t i = 0; i != batch_count; ++i) { update_batch(i); }
+    }
+    auto & counters = EnvColCounters::instance();
+    for (std::size_t i = 0; i != batch_count; ++i) {
+        counters.merge(m_batch_counters[i]);
+        m_deferred_calls[i].call_all();
+    }
+}
+
+/* private */ void EnvironmentCollisionSystem::update_batch(std::size_t batch_idx) {
+    DeferredSurfaceCallbacks::Scope scope(m_deferred_calls[batch_idx]);
+    m_batch_counters[batch_idx].reset();
+    EnvColCounters::Scope counting(m_batch_counters[batch_idx]);
+    auto beg = batch_idx*k_bodies_per_batch;
+    auto end = std::min(beg + k_bodies_per_batch, m_bodies->size());
+    for (auto i = beg; i != end; ++i) {
+        Entity e = *(m_bodies->begin() + i);
+        update(e);
     }
-    for (auto & e : cont) { update(e); }
 }
 
 /* private */ void EnvironmentCollisionSystem::update(Entity & e) {
     if (!e.has<PhysicsComponent>()) return;
     auto & pcomp = e.get<PhysicsComponent>();
-    EnvColParams ecp(pcomp, line_map(), e.ptr<PlayerControl>(), m_platforms);
+    EnvColParams ecp(pcomp, line_map(), e.ptr<PlayerControl>(), m_platform_broadphase);
     ecp.set_owner(e);
     auto old_id = pcomp.state_type_id();
     switch (pcomp.state_type_id()) {
@@ -82,13 +306,18 @@ EnvColParams::EnvColParams
         if (!is_real(fb.velocity) || !is_real(fb.location)) {
             throw std::runtime_error("EnvCol System: freebody's location and velocity must both be real vectors.");
         }
-        handle_freebody_physics(ecp, fb.location + fb.velocity*elapsed_time());
+        // owed time is made up at no more than double speed
+        auto et = elapsed_time() + ecp.repay_et_debt(elapsed_time());
+        handle_freebody_physics(ecp, fb.location + fb.velocity*et);
         }
         break;
     case k_tracker_state:
-        handle_tracker_physhics(ecp, elapsed_time());
+        handle_tracker_physhics(ecp, elapsed_time() + ecp.repay_et_debt(elapsed_time()));
         break;
-    default: return;
+    default:
+        // held, or otherwise not moving on its own
+        pcomp.et_debt = 0.;
+        return;
     }
     if (old_id != pcomp.state_type_id() && ecp.should_log_debug()) {
         switch (pcomp.state_type_id()) {
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "SystemsMisc.hpp"
+#include "PlatformBroadphase.hpp"
 
 struct EnvColStateMask {
 
@@ -81,22 +82,128 @@ private:
 };
 
 struct EnvColParams final : public EnvColStateMask {
-    using PlatformsCont = std::vector<Entity>;
+    using PlatformsCont = PlatformBroadphase;
+
+    // handler calls (each transfer, slide, and so on recurses) allowed per
+    // update, so that no corner of the map can stall a frame
+    static constexpr const int k_handler_call_budget = 32;
+    // owed time beyond this is forgiven
+    static constexpr const double k_max_et_debt = 0.25;
 
     EnvColParams(PhysicsComponent &, const LineMap &, const PlayerControl *,
                  const PlatformsCont &);
 
+    /// called at the top of each handler
+    /// @returns false if this update's budget is spent, the handler should
+    ///          incur the time it was given as debt, and return
+    bool take_handler_call();
+
+    /// for time this update was meant to cover, but won't
+    void incur_et_debt(double et);
+
+    /// @returns owed time to add on to this update, at most max_et
+    double repay_et_debt(double max_et);
+
           bool            acting_will      = false;
           double          bounce_thershold = std::numeric_limits<double>::infinity();
           Layer         & layer            ;
+          double        & et_debt          ;
     const LineMap       & map              ;
     const PlatformsCont & platforms        ;
+
+private:
+    int m_handler_calls_left = k_handler_call_budget;
+    bool m_budget_spent = false;
+};
+
+/// tallies of the work done handling physics, these are always kept (they are
+/// cheap) and are meant to be read by benchmarks
+struct EnvColCounters {
+    int recursion_depth     = 0;
+    int max_recursion_depth = 0;
+    // each evaluation of a bisection search's predicate
+    int bisection_probes    = 0;
+    // updates cut short by the handler call budget
+    int budget_exhaustions  = 0;
+
+    /// while open, this thread's counts go to the given counters instead
+    class Scope final {
+    public:
+        explicit Scope(EnvColCounters & counters):
+            m_previous(open_on_this_thread())
+        { open_on_this_thread() = &counters; }
+
+        Scope(const Scope &) = delete;
+        Scope & operator = (const Scope &) = delete;
+
+        ~Scope() { open_on_this_thread() = m_previous; }
+
+    private:
+        EnvColCounters * m_previous;
+    };
+
+    /// one per thread, unless a scope is open on it
+    static EnvColCounters & instance() {
+        if (auto * counters = open_on_this_thread()) return *counters;
+        thread_local EnvColCounters inst;
+        return inst;
+    }
+
+    static void count_bisection_probe() { ++instance().bisection_probes; }
+
+    void reset() { *this = EnvColCounters(); }
+
+    /// adds tallies counted elsewhere (e.g. on a worker thread)
+    void merge(const EnvColCounters & rhs) {
+        max_recursion_depth = std::max(max_recursion_depth, recursion_depth + rhs.max_recursion_depth);
+        bisection_probes   += rhs.bisection_probes;
+        budget_exhaustions += rhs.budget_exhaustions;
+    }
+
+private:
+    static EnvColCounters *& open_on_this_thread() {
+        thread_local EnvColCounters * inst = nullptr;
+        return inst;
+    }
+};
+
+/// placed at the top of each recursive physics handler
+class EnvColDepthGuard final {
+public:
+    EnvColDepthGuard(): m_counters(EnvColCounters::instance()) {
+        m_counters.max_recursion_depth = std::max
+            (++m_counters.recursion_depth, m_counters.max_recursion_depth);
+    }
+
+    EnvColDepthGuard(const EnvColDepthGuard &) = delete;
+    EnvColDepthGuard & operator = (const EnvColDepthGuard &) = delete;
+
+    ~EnvColDepthGuard() { --m_counters.recursion_depth; }
+
+private:
+    EnvColCounters & m_counters;
 };
 
+/// Updates in two phases. First every body is moved, each only writing its
+/// own physics state, while the map and platforms (as of the start of the
+/// update) are read only. Bodies are split into fixed size batches, which run
+/// on the worker pool if there is one. Then the landing/departing script
+/// calls set off by the first phase are made, batch by batch, in entity
+/// order. So the results are the same no matter how many threads are used.
+/// Each batch also keeps its own EnvColCounters, which are added to the
+/// updating thread's once all batches are done.
 class EnvironmentCollisionSystem final :
-    public System, public MapAware, public TimeAware
+    public System, public MapAware, public TimeAware, public WorkerPoolAware,
+    public QueryAware
 {
 public:
+    static constexpr const std::size_t k_bodies_per_batch = 32;
+
+    void setup_queries(EntityQueryIndex & index) override {
+        m_platforms = &index.query_for<Platform>();
+        m_bodies    = &index.query_for<PhysicsComponent>();
+    }
+
     static void run_tests();
 
 private:
@@ -104,5 +211,14 @@ private:
 
     void update(Entity & e);
 
-    std::vector<Entity> m_platforms;
+    void update_batch(std::size_t batch_idx);
+
+    const EntityQuery * m_platforms = nullptr;
+    const EntityQuery * m_bodies    = nullptr;
+    // one per batch, script calls deferred from the first phase
+    std::vector<DeferredSurfaceCallbacks> m_deferred_calls;
+    // one per batch, as batches may run on any thread
+    std::vector<EnvColCounters> m_batch_counters;
+    // persists between frames, so that only moved platforms are re-bucketed
+    PlatformBroadphase m_platform_broadphase;
 };
@@ -19,9 +19,12 @@
 
 #include "FreeBodyPhysics.hpp"
 #include "EnvironmentCollisionSystem.hpp"
+#include "SegmentBatch.hpp"
 
 #include "../maps/Maps.hpp"
 
+#include <common/TestSuite.hpp>
+
 #include <cassert>
 
 // need to code clean
@@ -35,13 +38,13 @@ void compute_intersections(IntersectionsVec &, const EnvColParams &, VectorD);
 bool is_inverted_normal(const LineSegment &, VectorD old_pos, VectorD new_pos);
 
 FreeBody handle_slide
-    (const LineSegment & seg, const FreeBody & freebody, bool inverted_normal,
+    (const Surface & seg, const FreeBody & freebody, bool inverted_normal,
      VectorD & new_pos);
 
-void affect_speed(LineTracker &, const LineSegment &, const FreeBody &);
+void affect_speed(LineTracker &, const Surface &, const FreeBody &);
 
 FreeBody handle_bounce
-    (const LineSegment &, const FreeBody &, VectorD new_pos);
+    (const Surface &, const FreeBody &, VectorD new_pos);
 
 // walk through all intersecting segments
 // the big thing is to account for layer transitions
@@ -56,41 +59,56 @@ public:
 
     bool is_done() const { return !m_parent; }
 
-private:
-
-    enum Side : uint_fast8_t { k_left, k_right, k_top, k_bottom };
-
-    static LineSegment get_side_of(const LineMap & lmap, Side side, VectorI r);
+    // for handling a whole tile's segments at once
 
-    static VectorD get_pixel_location(const LineMap & lmap, VectorI r);
+    VectorI tile_location() const { return m_tile; }
 
-    static std::array<Side, 3> get_other_sides(Side side);
+    /// layer may change while walking, so this is only good for the
+    /// current tile
+    Layer layer() const { return *m_current_layer; }
 
-    VectorD find_point_in_other_tile
-        (VectorI tile_loc, Side other_tiles_side) const;
+    void skip_tile() { move_to_next_tile(); }
 
+private:
+    // walks tiles with an exact grid traversal (Amanatides & Woo), each step
+    // crosses exactly one tile side, in the order the segment does
     void move_to_next_tile();
 
     void move_to_end() { m_parent = nullptr; }
 
-    void set_view_to(VectorI r);
+    // switches layers as needed, and views the tile's first segment
+    // @returns false if the tile has no segments on the current layer
+    bool set_view_to(VectorI r);
 
     static VectorI tile_location_of(const LineMap & lmap, VectorD r);
 
-    VectorI tile_location() const
-        { return tile_location_of(*m_parent, m_cur_pos); }
-
     const LineMap * m_parent = nullptr;
-    VectorD m_cur_pos;
-    VectorD m_dest_pos;
     SurfaceRef m_current_line;
     Layer * m_current_layer = nullptr;
     bool m_previous_was_transition = false;
+
+    VectorI m_tile;
+    VectorI m_end_tile;
+    VectorI m_step;
+    // parameter along the segment [0 1], at which the next tile side on each
+    // axis is crossed
+    VectorD m_t_max;
+    // change in parameter to cross one whole tile on each axis
+    VectorD m_t_delta;
 };
 
 } // end of <anonymous> namespace
 
 /* free fn */ void handle_freebody_physics(EnvColParams & params, VectorD new_pos) {
+    EnvColDepthGuard depth_guard;
+    if (!params.take_handler_call()) {
+        // owes however long the rest of the displacement would have taken
+        const auto & fb = params.state_as<FreeBody>();
+        auto speed = magnitude(fb.velocity);
+        if (speed > k_error)
+            { params.incur_et_debt(magnitude(new_pos - fb.location) / speed); }
+        return;
+    }
     IntersectionsVec intersections;
     intersections.reserve(k_intersections_in_place_length);
     compute_intersections(intersections, params, new_pos);
@@ -159,12 +177,19 @@ void add_map_intersections
      VectorD old_pos, VectorD new_pos)
 {
     FreeBodyMapIterator itr(params.map, old_pos, new_pos, &params.layer);
-    for (; !itr.is_done(); ++itr) {
-        const auto nfo = *itr;
-        auto intersection = find_intersection(*nfo, old_pos, new_pos);
-        if (intersection == k_no_intersection) continue;
-
-        intersections.emplace_back(nfo, intersection);
+    for (; !itr.is_done(); itr.skip_tile()) {
+        const auto & map_layer = params.map.get_layer(itr.layer());
+        const auto r = itr.tile_location();
+        auto segments = map_layer.segments_at(r);
+        for_each_intersection(
+            segments.begin(), std::size_t(segments.end() - segments.begin()),
+            VectorD(), old_pos, new_pos,
+            [&intersections, &map_layer, r](std::size_t i, VectorD intersection)
+        {
+            SurfaceRef ref;
+            ref.set(map_layer, r, int(i));
+            intersections.emplace_back(ref, intersection);
+        });
     }
 }
 
@@ -172,23 +197,23 @@ void add_map_intersections
     (const EnvColParams & params, IntersectionsVec & intersections,
      VectorD old_pos, VectorD new_pos)
 {
-    for (Entity platform : params.platforms) {
-        auto surface_view = platform.get<Platform>().surface_view();
-        for (auto itr = surface_view.begin(); itr != surface_view.end(); ++itr) {
-            Layer layer = Layer::neither;
-            if (auto * pcomp = platform.ptr<PhysicsComponent>())
-                { layer = pcomp->active_layer; }
-
-            // skip if platform is on another layer
-            if (layer != Layer::neither && layer != params.layer) continue;
-
-            auto intersection = find_intersection(*itr, old_pos, new_pos);
-            if (intersection == k_no_intersection) continue;
+    params.platforms.for_each_near(old_pos, new_pos,
+        [&params, &intersections, old_pos, new_pos](Entity platform, Layer layer)
+    {
+        // skip if platform is on another layer
+        if (layer != Layer::neither && layer != params.layer) return;
+
+        const auto & plat = platform.get<Platform>();
+        for_each_intersection(
+            plat.local_surfaces().data(), plat.surface_count(), plat.offset(),
+            old_pos, new_pos,
+            [&intersections, platform](std::size_t i, VectorD intersection)
+        {
             SurfaceRef sr;
-            sr.set(platform, itr - surface_view.begin());
+            sr.set(platform, int(i));
             intersections.emplace_back(sr, intersection);
-        }
-    }
+        });
+    });
 }
 
 /* free fn */ void sort_intersections
@@ -207,7 +232,26 @@ namespace {
 std::pair<double, VectorD>
     handle_intersection(const LineSegment & seg, VectorD old_, VectorD new_);
 
-VectorD reflect_approach(const LineSegment & seg, VectorD approach);
+/// @returns parameter x, where a point moving from "from" (x = 0) to "to"
+///          (x = 1) crosses the segment's line; not a real number if it
+///          moves parallel to it
+double line_crossing_parameter(const LineSegment &, VectorD from, VectorD to);
+
+/** Finds how far (as a parameter in [0 1]) a displacement may go before it
+ *  intersects something, starting from a closed form contact parameter and
+ *  backing off a little.
+ *
+ *  Falls back on the old bisection if the closed form is degenerate, if
+ *  there's no intersection just past it (the line is crossed beyond the
+ *  segment's end), or backing off doesn't clear the intersection (e.g.
+ *  contact is with the segment's end point, rather than its line).
+ *  @param intersects predicate, must be false for 0 for the result to mean
+ *         anything (just like find_highest_false)
+ */
+template <typename Func>
+double clip_before_contact(double contact, Func && intersects);
+
+VectorD reflect_approach(const Surface & seg, VectorD approach);
 
 void compute_intersections(IntersectionsVec & intersections, const EnvColParams & params, VectorD new_pos) {
     auto & freebody = params.state_as<FreeBody>();
@@ -223,7 +267,7 @@ bool is_inverted_normal(const LineSegment & seg, VectorD old_pos, VectorD new_po
 
 // clips vector
 FreeBody handle_slide
-    (const LineSegment & seg, const FreeBody & freebody, bool inverted_normal,
+    (const Surface & seg, const FreeBody & freebody, bool inverted_normal,
      VectorD & new_pos)
 {
     auto old_pos = freebody.location;
@@ -235,7 +279,12 @@ FreeBody handle_slide
     auto cull_new_pos = [old_pos, n_comp, p_comp](double x)
         { return old_pos + p_comp + n_comp*x; };
     assert(find_intersection(seg, old_pos, cull_new_pos(0)) == k_no_intersection);
-    auto t = find_highest_false<double>([cull_new_pos, &seg, old_pos](double x) {
+    // the end point moves in a straight line, contact is (usually) when it
+    // reaches the segment's line
+    auto t = clip_before_contact(
+        line_crossing_parameter(seg, cull_new_pos(0), cull_new_pos(1)),
+        [cull_new_pos, &seg, old_pos](double x)
+    {
         return k_no_intersection !=
                find_intersection(seg, old_pos, cull_new_pos(x));
     });
@@ -256,19 +305,17 @@ FreeBody handle_slide
     return rv;
 }
 
-void affect_speed(LineTracker & tracker, const LineSegment & seg, const FreeBody & freebody) {
-    auto segdiff = seg.b - seg.a;
-    tracker.speed = magnitude(project_onto(freebody.velocity, segdiff)) / magnitude(segdiff);
+void affect_speed(LineTracker & tracker, const Surface & seg, const FreeBody & freebody) {
+    const auto & geo = seg.geometry;
+    auto along = dot(freebody.velocity, geo.unit_direction);
+    tracker.speed = magnitude(along)*geo.inverse_length;
     if (magnitude(tracker.speed) < k_error) return;
-    auto tracker_vel = velocity_along(tracker.speed, seg);
-    auto proj = project_onto(freebody.velocity, segdiff);
-    if (angle_between(tracker_vel, proj) > k_pi*.5) {
-        tracker.speed *= -1.;
-    }
+    // heading toward a
+    if (along < 0.) tracker.speed *= -1.;
 }
 
 FreeBody handle_bounce
-    (const LineSegment & seg, const FreeBody & freebody, VectorD new_pos)
+    (const Surface & seg, const FreeBody & freebody, VectorD new_pos)
 {
     auto old_pos = freebody.location;
     auto gv = handle_intersection(seg, freebody.location, new_pos);
@@ -284,24 +331,83 @@ FreeBody handle_bounce
     return fb;
 }
 
+double line_crossing_parameter(const LineSegment & seg, VectorD from, VectorD to) {
+    auto side_of = [&seg](VectorD r) {
+        auto u = seg.b - seg.a;
+        auto v = r - seg.a;
+        return u.x*v.y - u.y*v.x;
+    };
+    // signed distances (scaled) are linear along the displacement
+    auto from_side = side_of(from);
+    auto to_side   = side_of(to  );
+    if (from_side == to_side) return k_inf;
+    return from_side / (from_side - to_side);
+}
+
+template <typename Func>
+double clip_before_contact(double contact, Func && intersects) {
+    // back off is quadrupled each time, so this tops out around 1e-2
+    static constexpr const double k_first_back_off = 1e-10;
+    static constexpr const int    k_max_back_offs  = 12;
+    auto bisect = [&intersects]() {
+        return find_highest_false<double>([&intersects](double x) {
+            EnvColCounters::count_bisection_probe();
+            return intersects(x);
+        });
+    };
+    auto t = [&]() {
+        if (!is_real(contact) || contact < 0. || contact > 1.) return bisect();
+        // the line may be crossed past the segment's end (e.g. sliding off
+        // the end of a wall), which isn't contact at all
+        if (!intersects(std::min(1., contact + k_first_back_off))) return bisect();
+        double back_off = k_first_back_off;
+        for (int i = 0; i != k_max_back_offs; ++i) {
+            auto x = std::max(0., contact - back_off);
+            if (!intersects(x) || x == 0.) return x;
+            back_off *= 4.;
+        }
+        return bisect();
+    } ();
+    return t;
+}
+
 // --------------------- <anonymous> namespace continued ----------------------
 
-VectorD normal_from_approach(const LineSegment &, VectorD approach);
+VectorD normal_from_approach(const Surface &, VectorD approach);
 
 FreeBodyMapIterator::FreeBodyMapIterator
     (const LineMap & parent, VectorD src, VectorD dest, Layer * layer):
     m_parent(&parent),
-    m_cur_pos(src),
-    m_dest_pos(dest),
     m_current_layer(layer),
     m_previous_was_transition(false)
 {
     if (!layer) {
         throw std::invalid_argument("FreeBodyMapIterator(): layer must not be a nullptr.");
     }
-    auto start_loc = tile_location_of(parent, src);
-    m_previous_was_transition = parent.tile_in_transition(start_loc);
-    set_view_to(start_loc);
+    m_tile     = tile_location_of(parent, src );
+    m_end_tile = tile_location_of(parent, dest);
+
+    auto setup_axis = []
+        (double src_, double diff, int tile, double tile_size,
+         int & step, double & t_max, double & t_delta)
+    {
+        if (diff == 0.) {
+            step  = 0;
+            t_max = t_delta = k_inf;
+            return;
+        }
+        step = diff > 0. ? 1 : -1;
+        // the side which will be crossed first
+        double side = double(diff > 0. ? tile + 1 : tile)*tile_size;
+        t_max   = (side - src_) / diff;
+        t_delta = tile_size / magnitude(diff);
+    };
+    auto diff = dest - src;
+    setup_axis(src.x, diff.x, m_tile.x, parent.tile_width (), m_step.x, m_t_max.x, m_t_delta.x);
+    setup_axis(src.y, diff.y, m_tile.y, parent.tile_height(), m_step.y, m_t_max.y, m_t_delta.y);
+
+    m_previous_was_transition = parent.tile_in_transition(m_tile);
+    if (!set_view_to(m_tile)) move_to_next_tile();
 }
 
 SurfaceRef FreeBodyMapIterator::operator * () const {
@@ -322,99 +428,26 @@ void FreeBodyMapIterator::operator ++ () {
     }
 }
 
-/* private static */ LineSegment FreeBodyMapIterator::get_side_of
-    (const LineMap & lmap, Side side, VectorI r)
-{
-    // r is top left to begin with
-    VectorI u;
-    switch (side) {
-    // tl and bl
-    case k_left: u = r + VectorI(0, 1); break;
-    // tr and br
-    case k_right:
-        u = r + VectorI(1, 0);
-        r += VectorI(1, 1);
-        break;
-    // tl and tr
-    case k_top: u = r + VectorI(1, 0); break;
-    // bl and br
-    case k_bottom:
-        u = r + VectorI(0, 1);
-        r += VectorI(1, 1);
-        break;
-    }
-    return LineSegment(get_pixel_location(lmap, r), get_pixel_location(lmap, u));
-}
-
-/* private static */ VectorD FreeBodyMapIterator::get_pixel_location
-    (const LineMap & lmap, VectorI r)
-{
-    return VectorD(double(r.x)*lmap.tile_width (),
-                   double(r.y)*lmap.tile_height());
-}
-
-/* private static */ std::array<FreeBodyMapIterator::Side, 3>
-    FreeBodyMapIterator::get_other_sides(Side side)
-{
-    switch (side) {
-    case k_left  : return {         k_right, k_top, k_bottom };
-    case k_right : return { k_left,          k_top, k_bottom };
-    case k_top   : return { k_left, k_right,        k_bottom };
-    case k_bottom: return { k_left, k_right, k_top           };
-    }
-    throw BadBranchException();
-}
-
-/* private */ VectorD FreeBodyMapIterator::find_point_in_other_tile
-    (VectorI tile_loc, Side other_tiles_side) const
-{
-    using namespace std::placeholders;
-    auto get_side = std::bind(get_side_of, std::cref(*m_parent), _1, tile_loc);
-
-    auto intr = find_intersection(get_side(other_tiles_side), m_cur_pos, m_dest_pos);
-    if (intr == k_no_intersection) return k_no_intersection;
-
-    VectorD other_intr = k_no_intersection;
-    for (auto other_side : get_other_sides(other_tiles_side)) {
-        auto other_ls = get_side(other_side);
-        other_intr = find_intersection(other_ls, m_cur_pos, m_dest_pos);
-        if (other_intr != k_no_intersection) break;
-    }
-    if (other_intr == k_no_intersection) return m_dest_pos;
-
-    auto rv = (other_intr + intr)*0.5;
-    assert(tile_location_of(*m_parent, rv) == tile_loc);
-    return rv;
-}
-
 /* private */ void FreeBodyMapIterator::move_to_next_tile() {
-    if (m_cur_pos == m_dest_pos ||
-        tile_location() == tile_location_of(*m_parent, m_dest_pos))
-    { return move_to_end(); }
-
-    auto cur_loc = tile_location();
-
-    VectorI dx(m_dest_pos.x > m_cur_pos.x ? 1 : -1, 0);
-    // side of the next tile
-    auto hside = dx.x < 0 ? k_right  : k_left;
-    auto gv = find_point_in_other_tile(cur_loc + dx, hside);
-    if (gv != k_no_intersection) {
-        m_cur_pos = gv;
-        return set_view_to(cur_loc + dx);
-    }
-
-    VectorI dy(0, m_dest_pos.y > m_cur_pos.y ? 1 : -1);
-    auto vside = dy.y < 0 ? k_bottom : k_top ;
-    gv = find_point_in_other_tile(cur_loc + dy, vside);
-    // else? extend and try again?
-    if (gv != k_no_intersection) {
-        m_cur_pos = gv;
-        return set_view_to(cur_loc + dy);
+    while (m_tile != m_end_tile) {
+        // ties (exact corners) go horizontal first
+        bool step_x = m_t_max.x <= m_t_max.y;
+        // rounding may leave the walk just short of the end tile, never walk
+        // past the end of the segment looking for it
+        if ((step_x ? m_t_max.x : m_t_max.y) > 1.) break;
+        if (step_x) {
+            m_tile.x  += m_step.x;
+            m_t_max.x += m_t_delta.x;
+        } else {
+            m_tile.y  += m_step.y;
+            m_t_max.y += m_t_delta.y;
+        }
+        if (set_view_to(m_tile)) return;
     }
-    throw BadBranchException();
+    move_to_end();
 }
 
-/* private */ void FreeBodyMapIterator::set_view_to(VectorI r) {
+/* private */ bool FreeBodyMapIterator::set_view_to(VectorI r) {
     // here lies the magic to the whole enterprise
     // here we switch to the other layer for freebodies
     if (m_parent->tile_in_transition(r) && !m_previous_was_transition) {
@@ -422,9 +455,10 @@ void FreeBodyMapIterator::operator ++ () {
     }
     m_previous_was_transition = m_parent->tile_in_transition(r);
     if (m_parent->get_segment_count(*m_current_layer, r) == 0)
-        { return move_to_next_tile(); }
+        { return false; }
 
     m_current_line.set(m_parent->get_layer(*m_current_layer), r, 0);
+    return true;
 }
 
 /* private static */ VectorI FreeBodyMapIterator::tile_location_of
@@ -440,7 +474,9 @@ std::pair<double, VectorD>
     auto diff = new_ - old_;
     auto cull_new_pos = [old_, diff](double x) { return old_ + diff*x; };
 
-    auto t = find_highest_false<double>([old_, &seg, &cull_new_pos](double x) {
+    auto t = clip_before_contact(line_crossing_parameter(seg, old_, new_),
+        [old_, &seg, &cull_new_pos](double x)
+    {
         return k_no_intersection !=
                find_intersection(seg, old_, cull_new_pos(x));
     });
@@ -457,7 +493,7 @@ std::pair<double, VectorD>
     return std::make_pair(t, new_);
 }
 
-VectorD reflect_approach(const LineSegment & seg, VectorD approach) {
+VectorD reflect_approach(const Surface & seg, VectorD approach) {
     auto antiapproach = -approach;
     auto normal = normal_from_approach(seg, approach);
     double angle = angle_between(normal, antiapproach);
@@ -470,12 +506,63 @@ VectorD reflect_approach(const LineSegment & seg, VectorD approach) {
 // --------------------- <anonymous> namespace continued ----------------------
 
 VectorD normal_from_approach
-    (const LineSegment & seg, VectorD approach)
+    (const Surface & seg, VectorD approach)
 {
-    auto normal = rotate_vector(seg.a - seg.b, k_pi*0.5);
-    auto a = angle_between(-normal, -approach);
-    auto b = angle_between( normal, -approach);
-    return (a < b ? -1. : 1.)*normal;
+    // (a - b) rotated a quarter turn
+    const auto & normal = seg.geometry.inverted_normal;
+    // which of +/- normal makes the smaller angle with -approach, without
+    // any trig
+    return (dot(normal, approach) > 0. ? -1. : 1.)*normal;
 }
 
 } // end of <anonymous> namespace
+
+/* free fn */ void run_freebody_physics_tests() {
+    using namespace cul;
+    ts::TestSuite suite;
+    suite.start_series("FreeBodyPhysics tests");
+    // the closed form should only differ from the old bisection kernel by
+    // its back off, for displacements crossing a segment's interior
+    static auto clips_like_bisection = [](double angle, double along, double depth) {
+        auto dir  = rotate_vector(VectorD(1, 0), angle);
+        auto norm = rotate_vector(dir, k_pi*0.5);
+        VectorD c(7, -3);
+        LineSegment seg(c - dir*5., c + dir*5.);
+        auto from = c + dir*along + norm*depth;
+        auto to   = c + dir*(along*-0.5) - norm*(depth*2.);
+        auto intersects = [&seg, from, to](double x)
+            { return k_no_intersection != find_intersection(seg, from, from + (to - from)*x); };
+        auto t = clip_before_contact(line_crossing_parameter(seg, from, to), intersects);
+        auto bisect_t = find_highest_false<double>(intersects);
+        return !intersects(t) && magnitude(bisect_t - t) < k_error;
+    };
+    suite.test([]() {
+        bool all_clip = true;
+        for (int i = 0; i != 16; ++i) {
+            double angle = 0.1 + k_pi*i / 8.;
+            all_clip =    all_clip
+                       && clips_like_bisection(angle,  0. , 1. )
+                       && clips_like_bisection(angle,  3.5, 0.2)
+                       && clips_like_bisection(angle, -2. , 4. );
+        }
+        return ts::test(all_clip);
+    });
+    // sliding past the end of a segment, the end point crosses the segment's
+    // line beyond its end (at a third), which mustn't stop the slide there
+    suite.test([]() {
+        Surface seg(LineSegment(0., 0., 10., 0.));
+        FreeBody freebody;
+        freebody.location = VectorD(9., -1.);
+        VectorD new_pos(11., 2.);
+        handle_slide(seg, freebody, false, new_pos);
+        // just about clears the end point at (10, 0), two thirds of the way
+        auto old_pos = freebody.location;
+        auto intersects = [&seg, old_pos](double x)
+            { return k_no_intersection != find_intersection(seg, old_pos, VectorD(11., -1. + 3.*x)); };
+        auto t = clip_before_contact(line_crossing_parameter(seg, VectorD(11., -1.), VectorD(11., 2.)),
+                                     intersects);
+        return ts::test(   magnitude(t - find_highest_false<double>(intersects)) < k_error
+                        && magnitude(t - 2. / 3.) < 0.01
+                        && new_pos.y > 0.9);
+    });
+}
@@ -48,3 +48,7 @@ void add_platform_intersections
 
 /// sorts intersections with the nearest coming first
 void sort_intersections(IntersectionsVec &, VectorD old_pos);
+
+/// checks the closed form clipping of free body displacements against
+/// bisection over sample segments
+void run_freebody_physics_tests();
@@ -78,7 +78,7 @@ bool in_segment_range(double x) { return x >= 0. && x <= 1.; }
 
 double check_for_traversal_interruption(EnvColParams &, double et_trav);
 
-void apply_friction(double & tracker_speed, const LineSegment &, double et);
+void apply_friction(double & tracker_speed, const Surface &, double et);
 
 LinkSegTransfer find_linked_transfer
     (const LineTracker &, const LineMapLayer &, LineSegmentEnd);
@@ -96,20 +96,39 @@ void update_layer
     (const LineTracker & old_tracker, const LineTracker & new_tracker,
      const LineMap &, Layer *);
 
+/** Settles a closed form time of impact onto either side of where pred
+ *  first becomes true. Bisection (find_smallest_diff) is only used if the
+ *  closed form is degenerate, or too far off to be nudged into place.
+ *
+ *  @param toi closed form solution, as a fraction of the time step
+ *  @returns the same pair find_smallest_diff does, the highest "false" and
+ *           the lowest "true" found
+ */
+template <typename Func>
+std::pair<double, double> find_crossing_near(double toi, Func && pred);
+
 } // end of <anonymous> namespace
 
 /* free fn */ void handle_tracker_physhics(EnvColParams & params, double et) {
     if (et < k_error) return;
+    EnvColDepthGuard depth_guard;
+    if (!params.take_handler_call()) {
+        params.incur_et_debt(et);
+        return;
+    }
 
     double et_after = 0.;
     double et_trav  = et;
     {
     const auto & tracker = params.state_as<LineTracker>();
     if (!in_segment_range(tracker.position + et*tracker.speed)) {
-        auto [port_before, port_after] = find_smallest_diff<double>([&tracker, et](double x) {
-            auto new_pos = tracker.position + et*x*tracker.speed;
-            return !in_segment_range(new_pos);
-        });
+        // position is linear with time, so it's just when the position
+        // reaches the end it's heading toward
+        auto seg_end = tracker.speed > 0. ? 1. : 0.;
+        auto [port_before, port_after] = find_crossing_near(
+            (seg_end - tracker.position) / (et*tracker.speed),
+            [&tracker, et](double x)
+        { return !in_segment_range(tracker.position + et*x*tracker.speed); });
         et_trav  = port_before*et;
         et_after = port_after *et;
     }
@@ -130,8 +149,13 @@ void update_layer
     }
 
     // zero to interruption taken as "canceling" out further changes
-    // (also point of incuring et debt)
-    if (et_after_itrp < k_error) return;
+    if (et_after_itrp < k_error) {
+        // falling off happens before any traversal, leaving all of et
+        // unspent (stopping doesn't, there is nothing left to do with it)
+        if (params.state_is_type<FreeBody>())
+            { params.incur_et_debt(et); }
+        return;
+    }
 
     // if traversal was interupted
     // basically restart and try again
@@ -162,7 +186,10 @@ void update_layer
         (params.state_as<LineTracker>(), params.map.get_layer(params.layer), segment_end_of(new_pos));
 
     if (check_for_segment_transfer_interrupt(params, segxfer, new_pos)) {
-        // incurs et debt here
+        // flying off leaves the time past the segment's end unspent, the
+        // segment's end takes et_after to reach
+        if (params.state_is_type<FreeBody>())
+            { params.incur_et_debt(et - et_after); }
         return;
     }
 
@@ -217,16 +244,13 @@ template <typename T>
 cul::Vector2<T> next_after(const cul::Vector2<T> & r, const cul::Vector2<T> & u)
     { return cul::Vector2<T>(std::nextafter(r.x, u.x), std::nextafter(r.y, u.y)); }
 
-double angle_between(const LineSegment & old, const LineSegment & new_,
-                     bool inverted_normal_on_old);
-
 LinkSegTransfer find_smallest_angle_neighbor
     (const LineMapLayer &,
      const LineTracker & tracker, LineSegmentEnd);
 
 FreeBody fly_off_tracker_to_freebody(const LineTracker &, double new_pos);
 
-double convert_tracker_speed(const LineTracker & from, const LineSegment & to);
+double convert_tracker_speed(const LineTracker & from, const Surface & to);
 
 double check_for_traversal_interruption(EnvColParams & params, double et_trav) {
     const auto & tracker = params.state_as<LineTracker>();
@@ -262,7 +286,7 @@ double check_for_traversal_interruption(EnvColParams & params, double et_trav) {
         // want to reduce error, we'll have to handle the remaining et
         // that is another run with the other physics systems with the
         // remaining et...
-        // incurs et debt here
+        // (the caller incurs it as et debt)
         params.set_freebody(fbody);
         return 0.;
     }
@@ -276,7 +300,7 @@ double check_for_traversal_interruption(EnvColParams & params, double et_trav) {
     return k_inf;
 }
 
-void apply_friction(double & tracker_speed, const LineSegment & seg, double et) {
+void apply_friction(double & tracker_speed, const Surface & seg, double et) {
     const constexpr double k_speed_loss_ps  = 0.20;
     const constexpr double k_stop_thershold = 35.;
     if (magnitude(tracker_speed)*segment_length(seg) < k_stop_thershold) {
@@ -388,12 +412,6 @@ void update_layer
 
 // ----------------------------------------------------------------------------
 
-inline double cross_magnitude(VectorD a, VectorD b) { return a.x*b.y - a.y*b.x; }
-
-template <typename Func>
-void find_position_neighbor
-    (const LineMapLayer &, const SurfaceRef &, VectorD point_location, Func && f);
-
 PlatformTransfer check_for_platform_transfer
     (const EnvColParams & params, const LineTracker & tracker, double fullet)
 {
@@ -439,9 +457,14 @@ PlatformTransfer check_for_platform_transfer
         std::cout << std::endl;
     }
 
+    // the tracker moves linearly from old_pos to new_pos, so the time of
+    // impact is how far along that the intersection (already known) lies
+    const auto displacement = new_pos - old_pos;
+    const auto toi = dot(inx.intersection - old_pos, displacement)
+                     / dot(displacement, displacement);
     PlatformTransfer rv;
-    std::tie(rv.et_to_transfer, rv.et_after_transfer) = find_smallest_diff<double>(
-        [&tracker, &inx, fullet](double x)
+    std::tie(rv.et_to_transfer, rv.et_after_transfer) = find_crossing_near(
+        toi, [&tracker, &inx, fullet](double x)
     {
         auto old_loc2d = location_along(tracker.position, *tracker.surface_ref());
         auto new_loc2d = location_along(tracker.position + tracker.speed*fullet*x, *tracker.surface_ref());
@@ -513,11 +536,13 @@ LineTracker transfer_tracker
         if (new_speed < 0.) {
             // if we're heading toward a, we want to 'move' pt b
             return find_highest_false<double>([&](double x) {
+                EnvColCounters::count_bisection_probe();
                 return find_intersection(old_segment, location_along(x, new_surface), new_surface.a) !=
                        k_no_intersection;
             });
         } else if (new_speed > 0.) {
             return find_lowest_true<double>([&](double x) {
+                EnvColCounters::count_bisection_probe();
                 return find_intersection(old_segment, location_along(x, new_surface), new_surface.b) ==
                        k_no_intersection;
             });
@@ -539,75 +564,65 @@ LineTracker transfer_tracker
     return new_tracker;
 }
 
-double angle_between(const LineSegment & old, const LineSegment & new_,
-                     bool inverted_normal_on_old)
-{
-    assert(!are_very_close(old.a, old.b));
-    assert(!are_very_close(new_.a, new_.b));
-    const VectorD * pivot     = nullptr;
-    const VectorD * extremity = nullptr;
-    const VectorD * other_ext = nullptr;
-    if (are_very_close(old.a, new_.b)) {
-        pivot = &old.a;
-        extremity = &old.b;
-
-        other_ext = &new_.a;
-    } else if (are_very_close(old.b, new_.a)) {
-        pivot = &old.b;
-        extremity = &old.a;
-
-        other_ext = &new_.b;
-    } else if (are_very_close(old.a, new_.a)) {
-        pivot = &old.a;
-        extremity = &old.b;
-
-        other_ext = &new_.b;
-    } else if (are_very_close(old.b, new_.b)) {
-        pivot = &old.b;
-        extremity = &old.a;
-
-        other_ext = &new_.a;
-    } else {
-        throw std::invalid_argument("angle_between: segments do not connect");
+template <typename Func>
+std::pair<double, double> find_crossing_near(double toi, Func && pred) {
+    // nudges double each time, 24 of them covers roughly 1e-12 to 1e-5
+    static constexpr const int    k_max_nudges  = 24;
+    static constexpr const double k_first_nudge = 1e-12;
+    auto fallback = [&pred]() {
+        return find_smallest_diff<double>([&pred](double x) {
+            EnvColCounters::count_bisection_probe();
+            return pred(x);
+        });
+    };
+    if (!is_real(toi)) return fallback();
+    toi = std::clamp(toi, 0., 1.);
+
+    // rounding may put the closed form on either side of the crossing
+    double before = toi, after = toi;
+    double nudge = k_first_nudge;
+    for (int i = 0; pred(before); ++i) {
+        if (i == k_max_nudges || before == 0.) return fallback();
+        after  = before;
+        before = std::max(0., toi - nudge);
+        nudge *= 2.;
     }
-    assert(pivot && extremity && other_ext);
-    auto saught = normal_for(old, inverted_normal_on_old) + (old.a + old.b)*0.5;
-    auto shortest_ang = angle_between(*extremity - *pivot, *other_ext - *pivot);
-
-    if (magnitude(shortest_ang - k_pi) < k_error) return k_pi;
-
-    auto cross_z = cross_magnitude(saught - *pivot, *extremity - *pivot);
-    assert(cross_z != 0.);
-    shortest_ang *= (cross_z > 0.) ? -1. : 1.;
-    if (magnitude(normalize(rotate_vector(*extremity - *pivot, shortest_ang)) -
-                  normalize(              *other_ext - *pivot              )) < k_error)
-    {
-        return magnitude(shortest_ang);
+    if (after != before) return std::make_pair(before, after);
+
+    nudge = k_first_nudge;
+    for (int i = 0; true; ++i) {
+        if (i == k_max_nudges || after == 1.) return fallback();
+        after = std::min(1., toi + nudge);
+        if (pred(after)) break;
+        before = after;
+        nudge *= 2.;
     }
-    return 2*k_pi - magnitude(shortest_ang);
+    return std::make_pair(before, after);
 }
 
 LinkSegTransfer find_smallest_angle_neighbor
     (const LineMapLayer & map_layer, const LineTracker & tracker, LineSegmentEnd end)
 {
+    const auto & ref = tracker.surface_ref();
+    if (ref.tile_location() == SurfaceRef::k_no_location) {
+        throw std::invalid_argument("find_smallest_angle_neighbor: surface "
+                                    "reference does not refer to the map "
+                                    "(platform entities require special handling)");
+    }
     NeighborPosition gnp;
     double min_ang = std::numeric_limits<double>::infinity();
-    const auto & current_seg = *tracker.surface_ref();
-    auto end_point = (end == LineSegment::k_a) ? current_seg.a : current_seg.b;
-
     // no layer transitions occur here, this is not done during segment
     // transfers
-    find_position_neighbor(
-        map_layer, tracker.surface_ref(), end_point,
-        [&min_ang, &gnp, &current_seg, &tracker]
-        (const NeighborPosition & np)
-    {
-        auto ang = angle_between(current_seg, *np, tracker.inverted_normal);
+    auto neighbors = map_layer.neighbors_of
+        (ref.tile_location(), ref.segment_number(), end);
+    for (const auto & neighbor : neighbors) {
+        auto ang = neighbor.transfer_angle(tracker.inverted_normal);
         if (ang < min_ang) {
             min_ang = ang;
-            gnp     = np ;
+            gnp.set(map_layer, neighbor.tile_location, neighbor.segment_number);
+            gnp.segment_end = neighbor.segment_end;
         }
-    });
+    }
     return LinkSegTransfer(gnp, min_ang);
 }
 
@@ -630,50 +645,10 @@ FreeBody fly_off_tracker_to_freebody
     return freebody;
 }
 
-double convert_tracker_speed(const LineTracker & from, const LineSegment & to) {
+double convert_tracker_speed(const LineTracker & from, const Surface & to) {
     auto old_seg = *from.surface_ref();
-    auto true_speed = magnitude(from.speed)*segment_length(old_seg);
-    return (true_speed / segment_length(to));
-}
-
-// ----------------------------------------------------------------------------
-
-template <typename Func>
-void find_position_neighbor
-    (const LineMapLayer & lmap, const SurfaceRef & lref,
-     VectorD point_location, Func && f)
-{
-    static const auto k_neighbor_offsets = {
-        VectorI( 0, 0), // check this tile too
-        VectorI(-1, 0), VectorI( 1, 0), VectorI(0, 1), VectorI(0, -1),
-        VectorI(-1,-1), VectorI(-1, 1), VectorI(1,-1), VectorI(1,  1)
-    };
-    if (lref.tile_location() == SurfaceRef::k_no_location) {
-        throw std::invalid_argument("find_position_neighbor: surface reference "
-                                    "does not refer to the map (platform "
-                                    "entities require special handling)");
-    }
-    for (auto noffset : k_neighbor_offsets) {
-        auto tile_pos = noffset + lref.tile_location();
-        for (int i = 0; i != lmap.get_segment_count(tile_pos); ++i) {
-            // skip originating segment
-            if (i == lref.segment_number() && noffset == VectorI(0, 0)) continue;
-
-            LineSegment offseted_ls = lmap(tile_pos, i);
-            auto closest_neighbor = LineSegment::k_neither;
-            if (are_very_close(offseted_ls.a, point_location)) {
-                closest_neighbor = LineSegment::k_a;
-            } else if (are_very_close(offseted_ls.b, point_location)) {
-                closest_neighbor = LineSegment::k_b;
-            } else {
-                continue;
-            }
-            NeighborPosition np;
-            np.set(lmap, tile_pos, i);
-            np.segment_end = closest_neighbor;
-            f(std::cref(np));
-        }
-    }
+    auto true_speed = magnitude(from.speed)*old_seg.geometry.length;
+    return true_speed*to.geometry.inverse_length;
 }
 
 } // end of <anonymous> namespace
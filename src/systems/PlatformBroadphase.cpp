@@ -0,0 +1,161 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "PlatformBroadphase.hpp"
+
+#include <common/TestSuite.hpp>
+
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+/* private */ void PlatformBroadphase::update_entry(const Entity & e, unsigned stamp) {
+    const auto & platform = e.get<Platform>();
+    auto layer = Layer::neither;
+    if (const auto * pcomp = e.ptr<PhysicsComponent>())
+        { layer = pcomp->active_layer; }
+    auto itr = m_entries.find(e.hash());
+    if (itr == m_entries.end()) {
+        auto & entry = m_entries[e.hash()];
+        entry.entity = e;
+        entry.bounds = platform.bounds();
+        entry.layer  = layer;
+        entry.bounds_version = platform.bounds_version();
+        entry.seen_stamp = stamp;
+        add_to_cells(entry);
+        return;
+    }
+    auto & entry = itr->second;
+    entry.seen_stamp = stamp;
+    entry.layer = layer;
+    // (most platforms don't move)
+    if (entry.bounds_version == platform.bounds_version()) return;
+    entry.bounds_version = platform.bounds_version();
+    auto bounds = platform.bounds();
+    // same cells, don't bother re-bucketing
+    auto old_range = cell_range_of(entry.bounds);
+    auto new_range = cell_range_of(bounds);
+    if (   old_range.left  == new_range.left  && old_range.top    == new_range.top
+        && old_range.right == new_range.right && old_range.bottom == new_range.bottom)
+    {
+        entry.bounds = bounds;
+        return;
+    }
+    remove_from_cells(entry);
+    entry.bounds = bounds;
+    add_to_cells(entry);
+}
+
+/* private */ void PlatformBroadphase::remove_unseen(unsigned stamp) {
+    // platforms gone since the last update
+    for (auto itr = m_entries.begin(); itr != m_entries.end(); ) {
+        if (itr->second.seen_stamp == stamp) {
+            ++itr;
+            continue;
+        }
+        remove_from_cells(itr->second);
+        itr = m_entries.erase(itr);
+    }
+}
+
+/* static */ void PlatformBroadphase::run_tests() {
+    using namespace cul;
+    ts::TestSuite suite;
+    suite.start_series("PlatformBroadphase tests");
+    suite.test([]() {
+        auto range = cell_range_of(Rect(-1., 10., 300., 0.));
+        return ts::test(   range.left == -1 && range.right  == 2
+                        && range.top  ==  0 && range.bottom == 0);
+    });
+    suite.test([]() {
+        return ts::test(   overlaps(Rect(0, 0, 10, 10), Rect(10, 10, 0, 0))
+                        && !overlaps(Rect(0, 0, 10, 10), Rect(11, 0, 5, 5)));
+    });
+    suite.test([]() {
+        return ts::test(to_key(-1, 0) != to_key(0, -1) && to_key(3, 4) == to_key(3, 4));
+    });
+    // moving a platform (bumping its bounds version) re-buckets it, and
+    // platforms no longer given are forgotten
+    suite.test([]() {
+        EntityManager emanager;
+        auto e = emanager.create_new_entity();
+        e.add<Platform>().set_surfaces(std::vector<Surface>
+            { Surface(LineSegment(VectorD(), VectorD(10., 0.))) });
+        std::vector<Entity> platforms { e };
+        PlatformBroadphase broadphase;
+        auto count_near = [&broadphase](double x) {
+            int count = 0;
+            broadphase.for_each_near(VectorD(x, -1.), VectorD(x, 1.),
+                                     [&count](Entity, Layer) { ++count; });
+            return count;
+        };
+        broadphase.update(platforms);
+        bool found_before = count_near(5.) == 1;
+        e.get<Platform>().set_offset(VectorD(1000., 0.));
+        broadphase.update(platforms);
+        bool moved = count_near(5.) == 0 && count_near(1005.) == 1;
+        broadphase.update(std::vector<Entity>());
+        return ts::test(found_before && moved && broadphase.size() == 0);
+    });
+}
+
+/* private static */ PlatformBroadphase::CellRange
+    PlatformBroadphase::cell_range_of(const Rect & rect)
+{
+    auto to_cell = [](double x) { return int(std::floor(x / k_cell_size)); };
+    CellRange rv;
+    rv.left   = to_cell(rect.left);
+    rv.top    = to_cell(rect.top);
+    rv.right  = to_cell(rect.left + rect.width );
+    rv.bottom = to_cell(rect.top  + rect.height);
+    return rv;
+}
+
+/* private static */ PlatformBroadphase::CellKey
+    PlatformBroadphase::to_key(int x, int y)
+{ return (CellKey(uint32_t(x)) << 32) | CellKey(uint32_t(y)); }
+
+/* private static */ bool PlatformBroadphase::overlaps
+    (const Rect & lhs, const Rect & rhs)
+{
+    // touching counts, a segment may lie right along a platform's edge
+    return    lhs.left <= rhs.left + rhs.width  && rhs.left <= lhs.left + lhs.width
+           && lhs.top  <= rhs.top  + rhs.height && rhs.top  <= lhs.top  + lhs.height;
+}
+
+/* private */ void PlatformBroadphase::add_to_cells(Entry & entry) {
+    auto range = entry.cells = cell_range_of(entry.bounds);
+    for (int y = range.top ; y <= range.bottom; ++y) {
+    for (int x = range.left; x <= range.right ; ++x) {
+        m_cells[to_key(x, y)].push_back(&entry);
+    }}
+}
+
+/* private */ void PlatformBroadphase::remove_from_cells(const Entry & entry) {
+    auto range = cell_range_of(entry.bounds);
+    for (int y = range.top ; y <= range.bottom; ++y) {
+    for (int x = range.left; x <= range.right ; ++x) {
+        auto itr = m_cells.find(to_key(x, y));
+        assert(itr != m_cells.end());
+        auto & cell = itr->second;
+        cell.erase(std::find(cell.begin(), cell.end(), &entry));
+        if (cell.empty()) m_cells.erase(itr);
+    }}
+}
@@ -0,0 +1,131 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "SystemsDefs.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+/** Uniform grid over the bounds of all platforms, kept from frame to frame.
+ *
+ *  Platforms are only re-bucketed when their bounds version changes (which
+ *  Platform::set_offset and set_surfaces bump, e.g. from
+ *  PlatformMovementSystem). Bounds of platforms which haven't moved aren't
+ *  even computed. Collision queries then only have to look at platforms near
+ *  the swept segment, rather than every one on the map.
+ */
+class PlatformBroadphase final {
+public:
+    static constexpr const double k_cell_size = 128.;
+
+    PlatformBroadphase() {}
+    // cells point into entries, so no copying
+    PlatformBroadphase(const PlatformBroadphase &) = delete;
+    PlatformBroadphase(PlatformBroadphase &&) = default;
+
+    PlatformBroadphase & operator = (const PlatformBroadphase &) = delete;
+    PlatformBroadphase & operator = (PlatformBroadphase &&) = default;
+
+    /** @param platforms every entity which has a platform component (like
+     *         the query for them), anything known from previous updates but
+     *         not present is removed
+     */
+    template <typename EntityCont>
+    void update(const EntityCont & platforms);
+
+    /** calls f once for every platform whose bounds overlap the box which
+     *  contains the segment from a to b
+     *
+     *  f is given the platform entity, and its layer as of the last update
+     *  (Layer::neither if it has no physics component). Queries change
+     *  nothing, so any number may run at once between updates.
+     */
+    template <typename Func>
+    void for_each_near(VectorD a, VectorD b, Func && f) const;
+
+    std::size_t size() const noexcept { return m_entries.size(); }
+
+    static void run_tests();
+
+private:
+    struct CellRange { int left, top, right, bottom; };
+
+    struct Entry {
+        Entity entity;
+        Rect bounds;
+        // cells the entry is bucketed into
+        CellRange cells;
+        Layer layer = Layer::neither;
+        unsigned bounds_version = 0;
+        unsigned seen_stamp = 0;
+    };
+
+    using CellKey = uint64_t;
+
+    static CellRange cell_range_of(const Rect &);
+
+    static CellKey to_key(int x, int y);
+
+    static bool overlaps(const Rect &, const Rect &);
+
+    void update_entry(const Entity &, unsigned stamp);
+
+    /// removes entries not seen with the given stamp
+    void remove_unseen(unsigned stamp);
+
+    void add_to_cells(Entry &);
+
+    void remove_from_cells(const Entry &);
+
+    // keyed by entity hash
+    std::unordered_map<std::size_t, Entry> m_entries;
+    std::unordered_map<CellKey, std::vector<Entry *>> m_cells;
+    unsigned m_update_stamp = 0;
+};
+
+template <typename EntityCont>
+void PlatformBroadphase::update(const EntityCont & platforms) {
+    auto stamp = ++m_update_stamp;
+    for (const auto & e : platforms) { update_entry(e, stamp); }
+    remove_unseen(stamp);
+}
+
+template <typename Func>
+void PlatformBroadphase::for_each_near(VectorD a, VectorD b, Func && f) const {
+    if (m_entries.empty()) return;
+    Rect box(std::min(a.x, b.x), std::min(a.y, b.y),
+             std::abs(a.x - b.x), std::abs(a.y - b.y));
+    auto range = cell_range_of(box);
+    for (int y = range.top ; y <= range.bottom; ++y) {
+    for (int x = range.left; x <= range.right ; ++x) {
+        auto itr = m_cells.find(to_key(x, y));
+        if (itr == m_cells.end()) continue;
+        for (const Entry * entry : itr->second) {
+            // entries spanning several cells are only visited from the
+            // first cell shared with the query (the first one reached)
+            if (   x != std::max(range.left, entry->cells.left)
+                || y != std::max(range.top , entry->cells.top ))
+            { continue; }
+            if (!overlaps(entry->bounds, box)) continue;
+            f(entry->entity, entry->layer);
+        }
+    }}
+}
@@ -0,0 +1,265 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "SegmentBatch.hpp"
+
+#include <common/TestSuite.hpp>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+// AVX isn't assumed of the target, it's compiled in for this file's kernel
+// alone, and only used if the CPU running has it
+#if defined(MACRO_COMPILER_GCC) && (defined(__x86_64__) || defined(__i386__))
+#   define MACRO_SEGMENT_BATCH_HAS_AVX_KERNEL
+#   include <immintrin.h>
+#endif
+
+namespace {
+
+using Lanes = std::array<double, SegmentBatch::k_size>;
+
+// each intersects lanes [first, first + lane width), same math as
+// find_intersection, with the segment as "a" and the motion as "b":
+// p = seg.a, r = seg.b - seg.a, q = old_pos, s = new_pos - old_pos
+// t = (q - p) x s / (r x s), u = (q - p) x r / (r x s)
+// hits when r x s is non zero and both t and u are in [0 1]
+
+unsigned intersect_lanes_scalar
+    (const Lanes & ax, const Lanes & ay, const Lanes & bx, const Lanes & by,
+     std::size_t i, VectorD q, VectorD s, Lanes & hit_x, Lanes & hit_y)
+{
+    auto rx = bx[i] - ax[i];
+    auto ry = by[i] - ay[i];
+    auto r_cross_s = rx*s.y - ry*s.x;
+    if (r_cross_s == 0.) return 0;
+
+    auto qpx = q.x - ax[i];
+    auto qpy = q.y - ay[i];
+    auto t = (qpx*s.y - qpy*s.x) / r_cross_s;
+    if (t < 0. || t > 1.) return 0;
+    auto u = (qpx*ry - qpy*rx) / r_cross_s;
+    if (u < 0. || u > 1.) return 0;
+
+    hit_x[i] = ax[i] + t*rx;
+    hit_y[i] = ay[i] + t*ry;
+    return 1;
+}
+
+#if defined(__SSE2__)
+
+unsigned intersect_lanes_sse2
+    (const Lanes & ax, const Lanes & ay, const Lanes & bx, const Lanes & by,
+     std::size_t first, VectorD q, VectorD s, Lanes & hit_x, Lanes & hit_y)
+{
+    auto px = _mm_load_pd(ax.data() + first);
+    auto py = _mm_load_pd(ay.data() + first);
+    auto rx = _mm_sub_pd(_mm_load_pd(bx.data() + first), px);
+    auto ry = _mm_sub_pd(_mm_load_pd(by.data() + first), py);
+    auto sx = _mm_set1_pd(s.x);
+    auto sy = _mm_set1_pd(s.y);
+    auto qpx = _mm_sub_pd(_mm_set1_pd(q.x), px);
+    auto qpy = _mm_sub_pd(_mm_set1_pd(q.y), py);
+
+    auto r_cross_s = _mm_sub_pd(_mm_mul_pd(rx, sy), _mm_mul_pd(ry, sx));
+    auto t = _mm_div_pd(_mm_sub_pd(_mm_mul_pd(qpx, sy), _mm_mul_pd(qpy, sx)), r_cross_s);
+    auto u = _mm_div_pd(_mm_sub_pd(_mm_mul_pd(qpx, ry), _mm_mul_pd(qpy, rx)), r_cross_s);
+
+    auto zero = _mm_setzero_pd();
+    auto one  = _mm_set1_pd(1.);
+    // (comparisons with NaN are false, which covers r x s being zero for t
+    // and u, cmpneq is checked anyway for clarity)
+    auto hits = _mm_and_pd(
+        _mm_and_pd(_mm_cmpneq_pd(r_cross_s, zero),
+                   _mm_and_pd(_mm_cmpge_pd(t, zero), _mm_cmple_pd(t, one))),
+        _mm_and_pd(_mm_cmpge_pd(u, zero), _mm_cmple_pd(u, one)));
+
+    _mm_store_pd(hit_x.data() + first, _mm_add_pd(px, _mm_mul_pd(t, rx)));
+    _mm_store_pd(hit_y.data() + first, _mm_add_pd(py, _mm_mul_pd(t, ry)));
+    return unsigned(_mm_movemask_pd(hits));
+}
+
+#endif
+
+#ifdef MACRO_SEGMENT_BATCH_HAS_AVX_KERNEL
+
+__attribute__((target("avx"))) unsigned intersect_lanes_avx
+    (const Lanes & ax, const Lanes & ay, const Lanes & bx, const Lanes & by,
+     std::size_t first, VectorD q, VectorD s, Lanes & hit_x, Lanes & hit_y)
+{
+    auto px = _mm256_load_pd(ax.data() + first);
+    auto py = _mm256_load_pd(ay.data() + first);
+    auto rx = _mm256_sub_pd(_mm256_load_pd(bx.data() + first), px);
+    auto ry = _mm256_sub_pd(_mm256_load_pd(by.data() + first), py);
+    auto sx = _mm256_set1_pd(s.x);
+    auto sy = _mm256_set1_pd(s.y);
+    auto qpx = _mm256_sub_pd(_mm256_set1_pd(q.x), px);
+    auto qpy = _mm256_sub_pd(_mm256_set1_pd(q.y), py);
+
+    auto r_cross_s = _mm256_sub_pd(_mm256_mul_pd(rx, sy), _mm256_mul_pd(ry, sx));
+    auto t = _mm256_div_pd(_mm256_sub_pd(_mm256_mul_pd(qpx, sy), _mm256_mul_pd(qpy, sx)), r_cross_s);
+    auto u = _mm256_div_pd(_mm256_sub_pd(_mm256_mul_pd(qpx, ry), _mm256_mul_pd(qpy, rx)), r_cross_s);
+
+    auto zero = _mm256_setzero_pd();
+    auto one  = _mm256_set1_pd(1.);
+    auto hits = _mm256_and_pd(
+        _mm256_and_pd(_mm256_cmp_pd(r_cross_s, zero, _CMP_NEQ_OQ),
+                      _mm256_and_pd(_mm256_cmp_pd(t, zero, _CMP_GE_OQ),
+                                    _mm256_cmp_pd(t, one , _CMP_LE_OQ))),
+        _mm256_and_pd(_mm256_cmp_pd(u, zero, _CMP_GE_OQ),
+                      _mm256_cmp_pd(u, one , _CMP_LE_OQ)));
+
+    _mm256_store_pd(hit_x.data() + first, _mm256_add_pd(px, _mm256_mul_pd(t, rx)));
+    _mm256_store_pd(hit_y.data() + first, _mm256_add_pd(py, _mm256_mul_pd(t, ry)));
+    return unsigned(_mm256_movemask_pd(hits));
+}
+
+#endif
+
+static_assert(SegmentBatch::k_size % 4 == 0,
+              "batch size must be a multiple of the widest lane width");
+
+} // end of <anonymous> namespace
+
+unsigned SegmentBatch::intersect(VectorD old_pos, VectorD new_pos) {
+    static const Kernel k_best = [] {
+#       ifdef MACRO_SEGMENT_BATCH_HAS_AVX_KERNEL
+        if (__builtin_cpu_supports("avx")) return Kernel::avx;
+#       endif
+#       if defined(__SSE2__)
+        return Kernel::sse2;
+#       else
+        return Kernel::scalar;
+#       endif
+    } ();
+    return intersect_with(k_best, old_pos, new_pos);
+}
+
+/* private static */ std::vector<SegmentBatch::Kernel> SegmentBatch::available_kernels() {
+    std::vector<Kernel> rv { Kernel::scalar };
+#   if defined(__SSE2__)
+    rv.push_back(Kernel::sse2);
+#   endif
+#   ifdef MACRO_SEGMENT_BATCH_HAS_AVX_KERNEL
+    if (__builtin_cpu_supports("avx")) rv.push_back(Kernel::avx);
+#   endif
+    return rv;
+}
+
+/* private */ unsigned SegmentBatch::intersect_with
+    (Kernel kernel, VectorD old_pos, VectorD new_pos)
+{
+    auto s = new_pos - old_pos;
+    auto run_lanes = [this, old_pos, s](int lane_width, auto && intersect_lanes) {
+        unsigned rv = 0;
+        for (int i = 0; i < m_count; i += lane_width) {
+            rv |= intersect_lanes(m_ax, m_ay, m_bx, m_by, std::size_t(i), old_pos, s,
+                                  m_hit_x, m_hit_y) << unsigned(i);
+        }
+        return rv;
+    };
+    unsigned rv = 0;
+    switch (kernel) {
+    case Kernel::scalar: rv = run_lanes(1, intersect_lanes_scalar); break;
+#   if defined(__SSE2__)
+    case Kernel::sse2  : rv = run_lanes(2, intersect_lanes_sse2  ); break;
+#   endif
+#   ifdef MACRO_SEGMENT_BATCH_HAS_AVX_KERNEL
+    case Kernel::avx   : rv = run_lanes(4, intersect_lanes_avx   ); break;
+#   endif
+    default: throw std::invalid_argument("SegmentBatch::intersect_with: kernel "
+                                         "is not available in this build.");
+    }
+    return rv & ((1u << unsigned(m_count)) - 1u);
+}
+
+/* static */ void SegmentBatch::run_tests() {
+    using namespace cul;
+    ts::TestSuite suite;
+    suite.start_series("SegmentBatch tests");
+    // must agree with find_intersection on each segment
+    suite.test([]() {
+        std::array<LineSegment, 6> segs = {
+            LineSegment(VectorD(0, 0), VectorD(10, 0)),
+            LineSegment(VectorD(0, 5), VectorD(10, 5)),
+            LineSegment(VectorD(5, -5), VectorD(5, 20)), // steep, still crosses
+            LineSegment(VectorD(20, 0), VectorD(30, 10)), // too far
+            LineSegment(VectorD(-1, 8), VectorD(11, 9)),
+            LineSegment(VectorD(5, -2), VectorD(7, 12)) // parallel
+        };
+        VectorD old_pos(4, -2), new_pos(6, 12);
+        bool agrees = true;
+        int hit_count = 0;
+        for_each_intersection(segs.data(), segs.size(), VectorD(), old_pos, new_pos,
+            [&](std::size_t i, VectorD intx)
+        {
+            ++hit_count;
+            auto expected = find_intersection(segs[i], old_pos, new_pos);
+            agrees = agrees && magnitude(expected - intx) < k_error;
+        });
+        for (const auto & seg : segs) {
+            if (find_intersection(seg, old_pos, new_pos) != k_no_intersection)
+                { --hit_count; }
+        }
+        return ts::test(agrees && hit_count == 0);
+    });
+    // offsets are applied, and more than one batch worth works
+    suite.test([]() {
+        std::vector<LineSegment> segs;
+        for (int i = 0; i != SegmentBatch::k_size*2 + 3; ++i) {
+            segs.emplace_back(VectorD(double(i), 0), VectorD(double(i), 1));
+        }
+        std::vector<std::size_t> hits;
+        for_each_intersection(segs.data(), segs.size(), VectorD(0, 10),
+                              VectorD(-0.5, 10.5), VectorD(100, 10.5),
+                              [&hits](std::size_t i, VectorD) { hits.push_back(i); });
+        bool in_order = true;
+        for (std::size_t i = 0; i != hits.size(); ++i)
+            { in_order = in_order && hits[i] == i; }
+        return ts::test(in_order && hits.size() == segs.size());
+    });
+    // every kernel this build/CPU has agrees with the scalar one
+    suite.test([]() {
+        std::default_random_engine rng { 0x5e6b };
+        std::uniform_real_distribution<double> coord { -20., 20. };
+        auto random_vector = [&]() { return VectorD(coord(rng), coord(rng)); };
+        std::array<LineSegment, SegmentBatch::k_size> segs;
+        SegmentBatch scalar, other;
+        bool agrees = true;
+        for (int trial = 0; trial != 200; ++trial) {
+            for (auto & seg : segs) seg = LineSegment(random_vector(), random_vector());
+            auto old_pos = random_vector();
+            auto new_pos = random_vector();
+            int count = trial % (SegmentBatch::k_size + 1);
+            scalar.pack(segs.data(), count);
+            auto expected = scalar.intersect_with(Kernel::scalar, old_pos, new_pos);
+            for (auto kernel : available_kernels()) {
+                other.pack(segs.data(), count);
+                auto hits = other.intersect_with(kernel, old_pos, new_pos);
+                agrees = agrees && hits == expected;
+                for (int i = 0; i != count; ++i) {
+                    if (!(hits & (1u << unsigned(i)))) continue;
+                    agrees = agrees && magnitude(scalar.intersection(i) - other.intersection(i)) < k_error;
+                }
+            }
+        }
+        return ts::test(agrees);
+    });
+}
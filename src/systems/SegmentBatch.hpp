@@ -0,0 +1,112 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "../Defs.hpp"
+
+#include <cassert>
+#include <vector>
+
+/** A small batch of segments, stored one array per coordinate so that
+ *  several may be intersected against one motion segment at once.
+ *
+ *  Uses AVX (four at a time) when built with GCC for x86 and the running
+ *  CPU has it, else SSE2 (two at a time) when the compiler targets it,
+ *  otherwise it's plain scalar code. The math is the same as
+ *  find_intersection.
+ */
+class SegmentBatch final {
+public:
+    static constexpr const int k_size = 8;
+
+    /// @param count must not exceed k_size
+    /// @param offset is added to every segment (for platforms)
+    template <typename T>
+    void pack(const T * segments, int count, VectorD offset = VectorD());
+
+    int size() const noexcept { return m_count; }
+
+    /// @returns bit mask of which segments the motion intersects
+    unsigned intersect(VectorD old_pos, VectorD new_pos);
+
+    /// valid only for segments hit in the last call to intersect
+    VectorD intersection(int i) const
+        { return VectorD(m_hit_x[std::size_t(i)], m_hit_y[std::size_t(i)]); }
+
+    static void run_tests();
+
+private:
+    using Lanes = std::array<double, k_size>;
+
+    enum class Kernel { scalar, sse2, avx };
+
+    /// kernels usable in this build and on this CPU, scalar first
+    static std::vector<Kernel> available_kernels();
+
+    unsigned intersect_with(Kernel, VectorD old_pos, VectorD new_pos);
+
+    alignas(32) Lanes m_ax, m_ay, m_bx, m_by;
+    alignas(32) Lanes m_hit_x, m_hit_y;
+    int m_count = 0;
+};
+
+/** Calls f(index, intersection) for each segment (anything derived from
+ *  LineSegment) which the motion from old_pos to new_pos intersects, in
+ *  order. Segments are tested SegmentBatch::k_size at a time.
+ */
+template <typename T, typename Func>
+void for_each_intersection
+    (const T * segments, std::size_t count, VectorD offset,
+     VectorD old_pos, VectorD new_pos, Func && f);
+
+// ----------------------------------------------------------------------------
+
+template <typename T>
+void SegmentBatch::pack(const T * segments, int count, VectorD offset) {
+    assert(count >= 0 && count <= k_size);
+    for (int i = 0; i != count; ++i) {
+        const LineSegment & seg = segments[i];
+        auto j = std::size_t(i);
+        m_ax[j] = seg.a.x + offset.x;
+        m_ay[j] = seg.a.y + offset.y;
+        m_bx[j] = seg.b.x + offset.x;
+        m_by[j] = seg.b.y + offset.y;
+    }
+    // degenerate padding, never hits
+    for (auto j = std::size_t(count); j != std::size_t(k_size); ++j)
+        { m_ax[j] = m_ay[j] = m_bx[j] = m_by[j] = 0.; }
+    m_count = count;
+}
+
+template <typename T, typename Func>
+void for_each_intersection
+    (const T * segments, std::size_t count, VectorD offset,
+     VectorD old_pos, VectorD new_pos, Func && f)
+{
+    SegmentBatch batch;
+    for (std::size_t i = 0; i < count; i += SegmentBatch::k_size) {
+        auto batch_size = int(std::min(count - i, std::size_t(SegmentBatch::k_size)));
+        batch.pack(segments + i, batch_size, offset);
+        auto hits = batch.intersect(old_pos, new_pos);
+        for (int j = 0; hits; ++j, hits >>= 1) {
+            if (hits & 1u) f(i + std::size_t(j), batch.intersection(j));
+        }
+    }
+}
@@ -0,0 +1,230 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "SystemScheduler.hpp"
+
+#include <common/TestSuite.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+using InvArg = std::invalid_argument;
+using RtError = std::runtime_error;
+
+} // end of <anonymous> namespace
+
+SystemWorkerPool::SystemWorkerPool(int thread_count) {
+    for (int i = 1; i < thread_count; ++i) {
+        m_threads.emplace_back([this] { work_loop(); });
+    }
+}
+
+SystemWorkerPool::~SystemWorkerPool() {
+    {
+    std::unique_lock lk(m_mutex);
+    m_quitting = true;
+    }
+    m_work_ready.notify_all();
+    for (auto & thread : m_threads) {
+        thread.join();
+    }
+}
+
+void SystemWorkerPool::run(std::size_t job_count, const JobFunc & job) {
+    if (job_count == 0) return;
+    {
+    std::unique_lock lk(m_mutex);
+    // stragglers from the last run may still be on their way out
+    m_work_done.wait(lk, [this] { return m_busy == 0; });
+    m_job = &job;
+    m_job_count = job_count;
+    m_next_job = 0;
+    m_finished = 0;
+    m_error = nullptr;
+    ++m_generation;
+    }
+    m_work_ready.notify_all();
+
+    do_jobs(job_count, job);
+
+    std::exception_ptr error;
+    {
+    std::unique_lock lk(m_mutex);
+    m_work_done.wait(lk, [this] { return m_finished == m_job_count; });
+    m_job = nullptr;
+    std::swap(error, m_error);
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+/* private */ void SystemWorkerPool::work_loop() {
+    unsigned seen_generation = 0;
+    std::unique_lock lk(m_mutex);
+    while (true) {
+        m_work_ready.wait(lk, [this, seen_generation]
+            { return m_quitting || m_generation != seen_generation; });
+        if (m_quitting) return;
+        seen_generation = m_generation;
+        if (!m_job) continue;
+        ++m_busy;
+        auto job_count = m_job_count;
+        const auto & job = *m_job;
+        lk.unlock();
+
+        do_jobs(job_count, job);
+
+        lk.lock();
+        --m_busy;
+        m_work_done.notify_all();
+    }
+}
+
+/* private */ void SystemWorkerPool::do_jobs
+    (std::size_t job_count, const JobFunc & job)
+{
+    for (auto idx = m_next_job++; idx < job_count; idx = m_next_job++) {
+        std::exception_ptr error;
+        try {
+            job(idx);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        std::unique_lock lk(m_mutex);
+        if (error && !m_error) m_error = error;
+        if (++m_finished == job_count) m_work_done.notify_all();
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+void SystemScheduler::add(System & sys, const SystemAccess & access) {
+    std::size_t stage = 0;
+    for (std::size_t i = 0; i != m_accesses.size(); ++i) {
+        if (!m_accesses[i].conflicts_with(access)) continue;
+        stage = std::max(stage, m_system_stages[i] + 1);
+    }
+    if (stage == m_stages.size()) m_stages.emplace_back();
+    m_stages[stage].push_back(&sys);
+    m_accesses.push_back(access);
+    m_system_stages.push_back(stage);
+}
+
+std::size_t SystemScheduler::stage_of(std::size_t idx) const {
+    if (idx >= m_system_stages.size()) {
+        throw InvArg("SystemScheduler::stage_of: index is out of range.");
+    }
+    return m_system_stages[idx];
+}
+
+/* private */ void SystemScheduler::update(const ContainerView & view) {
+    for (auto & stage : m_stages) {
+        if (!m_pool || stage.size() == 1) {
+            for (auto * sys : stage) { sys->update(view); }
+            continue;
+        }
+        // replacing a tracker's state may call scripts, which may touch
+        // anything, so those calls wait for the stage to finish
+        if (m_deferred_calls.size() < stage.size())
+            { m_deferred_calls.resize(stage.size()); }
+        m_pool->run(stage.size(), [this, &stage, &view](std::size_t idx) {
+            DeferredSurfaceCallbacks::Scope scope(m_deferred_calls[idx]);
+            stage[idx]->update(view);
+        });
+        // in the order systems were added, whichever threads ran them
+        for (std::size_t i = 0; i != stage.size(); ++i)
+            { m_deferred_calls[i].call_all(); }
+    }
+}
+
+/* static */ void SystemScheduler::run_tests() {
+    using namespace cul;
+    ts::TestSuite suite;
+    suite.start_series("SystemScheduler tests");
+
+    struct A final {};
+    struct B final {};
+    struct C final {};
+    class DummySystem final : public System {
+        void update(const ContainerView &) override {}
+    };
+    static DummySystem s_dummy;
+
+    // readers of the same thing share a stage
+    suite.test([]() {
+        SystemScheduler sched(nullptr);
+        sched.add(s_dummy, SystemAccess().reads<A>());
+        sched.add(s_dummy, SystemAccess().reads<A, B>());
+        sched.add(s_dummy, SystemAccess().writes<C>());
+        return ts::test(sched.stage_count() == 1);
+    });
+    // write then read (or read then write) orders them
+    suite.test([]() {
+        SystemScheduler sched(nullptr);
+        sched.add(s_dummy, SystemAccess().writes<A>());
+        sched.add(s_dummy, SystemAccess().reads<A>());
+        sched.add(s_dummy, SystemAccess().writes<A>());
+        return ts::test(   sched.stage_of(0) == 0 && sched.stage_of(1) == 1
+                        && sched.stage_of(2) == 2);
+    });
+    // a later system may land in an earlier stage, if nothing it conflicts
+    // with comes before it
+    suite.test([]() {
+        SystemScheduler sched(nullptr);
+        sched.add(s_dummy, SystemAccess().writes<A>());
+        sched.add(s_dummy, SystemAccess().reads<A>().writes<B>());
+        sched.add(s_dummy, SystemAccess().writes<C>());
+        return ts::test(sched.stage_of(1) == 1 && sched.stage_of(2) == 0);
+    });
+    // exclusive systems get a stage to themselves, and nothing passes them
+    suite.test([]() {
+        SystemScheduler sched(nullptr);
+        sched.add(s_dummy, SystemAccess().writes<A>());
+        sched.add(s_dummy, SystemAccess::exclusive());
+        sched.add(s_dummy, SystemAccess().writes<C>());
+        return ts::test(   sched.stage_of(1) == 1 && sched.stage_of(2) == 2
+                        && sched.stage_count() == 3);
+    });
+    // every job runs exactly once, over many runs
+    suite.test([]() {
+        SystemWorkerPool pool(4);
+        std::vector<std::atomic<int>> counts(37);
+        for (int run = 0; run != 100; ++run) {
+            pool.run(counts.size(), [&counts](std::size_t idx) { ++counts[idx]; });
+        }
+        return ts::test(std::all_of(counts.begin(), counts.end(),
+            [](const std::atomic<int> & n) { return n == 100; }));
+    });
+    // exceptions reach the caller, and the pool is still usable after
+    suite.test([]() {
+        SystemWorkerPool pool(3);
+        bool caught = false;
+        try {
+            pool.run(8, [](std::size_t idx) {
+                if (idx == 5) throw RtError("");
+            });
+        } catch (RtError &) {
+            caught = true;
+        }
+        std::atomic<int> count = 0;
+        pool.run(8, [&count](std::size_t) { ++count; });
+        return ts::test(caught && count == 8);
+    });
+}
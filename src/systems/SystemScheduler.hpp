@@ -0,0 +1,119 @@
+/****************************************************************************
+
+    Copyright 2021 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "SystemsDefs.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed set of worker threads, kept alive between frames.
+///
+/// The calling thread takes jobs too, so "thread_count" includes it. Runs
+/// may not nest, a job must not start a run of its own on the same pool.
+class SystemWorkerPool final {
+public:
+    using JobFunc = std::function<void(std::size_t)>;
+
+    explicit SystemWorkerPool(int thread_count);
+
+    SystemWorkerPool(const SystemWorkerPool &) = delete;
+    SystemWorkerPool & operator = (const SystemWorkerPool &) = delete;
+
+    ~SystemWorkerPool();
+
+    /// calls job with each index in [0 job_count), returning once all calls
+    /// have returned
+    /// @throws the first exception thrown by any job (after all have finished)
+    void run(std::size_t job_count, const JobFunc & job);
+
+    int thread_count() const noexcept { return int(m_threads.size()) + 1; }
+
+private:
+    void work_loop();
+
+    void do_jobs(std::size_t job_count, const JobFunc & job);
+
+    std::mutex m_mutex;
+    // workers wait on this for a new generation (or to quit)
+    std::condition_variable m_work_ready;
+    // caller waits on this for jobs to finish, and workers to go idle
+    std::condition_variable m_work_done;
+
+    const JobFunc * m_job = nullptr;
+    std::size_t m_job_count = 0;
+    std::atomic<std::size_t> m_next_job = 0;
+    std::size_t m_finished = 0;
+    unsigned m_generation = 0;
+    int m_busy = 0;
+    bool m_quitting = false;
+    std::exception_ptr m_error;
+
+    std::vector<std::thread> m_threads;
+};
+
+/// Runs systems in stages, systems within a stage have no conflicting
+/// accesses (see SystemAccess), and so update at the same time.
+///
+/// A system's stage is one past the latest stage of any system added before
+/// it that it conflicts with. So any two conflicting systems still update in
+/// the order they were added, which is the order of a plain serial run.
+///
+/// The scheduler doesn't own its systems (or pool), and doesn't set them
+/// up. It is registered with the entity manager in their place.
+///
+/// Stages of one system run it on the calling thread, so that system may
+/// use the same pool for its own work.
+///
+/// Surface callbacks (landing/departing) made by systems of a multi-system
+/// stage are deferred, and called on the calling thread once the stage is
+/// done.
+class SystemScheduler final : public System {
+public:
+    /// @param pool if nullptr, updates every system on the calling thread
+    ///        (still in stage order)
+    explicit SystemScheduler(SystemWorkerPool * pool): m_pool(pool) {}
+
+    void add(System &, const SystemAccess &);
+
+    std::size_t stage_count() const noexcept { return m_stages.size(); }
+
+    /// @returns the stage of the nth added system
+    std::size_t stage_of(std::size_t idx) const;
+
+    static void run_tests();
+
+private:
+    using SystemType = EntityManager::SystemType;
+
+    void update(const ContainerView &) override;
+
+    std::vector<SystemAccess> m_accesses;
+    std::vector<std::size_t> m_system_stages;
+    std::vector<std::vector<SystemType *>> m_stages;
+    // one per system of the widest stage run on the pool
+    std::vector<DeferredSurfaceCallbacks> m_deferred_calls;
+    SystemWorkerPool * m_pool = nullptr;
+};
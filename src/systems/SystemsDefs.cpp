@@ -21,8 +21,22 @@
 
 #include "../maps/Maps.hpp"
 
+#include <algorithm>
+
 // gotta have unique filenames for all translation units
 
+bool SystemAccess::conflicts_with(const SystemAccess & rhs) const {
+    if (m_exclusive || rhs.m_exclusive) return true;
+    using TypeCont = std::vector<std::type_index>;
+    auto overlaps = [](const TypeCont & lhs, const TypeCont & rhs) {
+        return std::any_of(lhs.begin(), lhs.end(), [&rhs](const std::type_index & type)
+            { return std::find(rhs.begin(), rhs.end(), type) != rhs.end(); });
+    };
+    return    overlaps(m_writes, rhs.m_writes)
+           || overlaps(m_writes, rhs.m_reads )
+           || overlaps(m_reads , rhs.m_writes);
+}
+
 const LineMapLayer & MapAware::get_map_layer(const Layer & layer) {
     return m_lmap->get_layer(layer);
 }
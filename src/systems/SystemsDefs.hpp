@@ -21,6 +21,10 @@
 
 #include "../Components.hpp"
 
+#include <algorithm>
+#include <typeindex>
+#include <unordered_map>
+
 namespace sf { class RenderTarget; }
 
 class System : public EntityManager::SystemType {
@@ -30,6 +34,75 @@ protected:
     System() {}
 };
 
+// stand ins for state that systems share, which aren't components
+
+/// creating and removing entities, adding and removing components (every
+/// system reads this, as every system walks entities)
+struct EntityStructureResource final {};
+struct DeletionRequestsResource final {};
+struct GraphicsResource final {};
+
+/// Which components (and other shared state) a system reads and writes.
+/// Systems whose accesses don't conflict may update at the same time (see
+/// SystemScheduler).
+///
+/// Systems declare theirs with a public "static SystemAccess access()".
+class SystemAccess final {
+public:
+    SystemAccess() { reads<EntityStructureResource>(); }
+
+    /// conflicts with every other system
+    static SystemAccess exclusive() {
+        SystemAccess rv;
+        rv.m_exclusive = true;
+        return rv;
+    }
+
+    template <typename ... Types>
+    SystemAccess & reads() {
+        (m_reads.emplace_back(typeid(Types)), ...);
+        return *this;
+    }
+
+    template <typename ... Types>
+    SystemAccess & writes() {
+        (m_writes.emplace_back(typeid(Types)), ...);
+        return *this;
+    }
+
+    bool conflicts_with(const SystemAccess &) const;
+
+    /// @returns true if T is written, or the access is exclusive
+    template <typename T>
+    bool writes_to() const {
+        return m_exclusive || std::find(m_writes.begin(), m_writes.end(),
+                                        std::type_index(typeid(T))) != m_writes.end();
+    }
+
+    bool is_exclusive() const noexcept { return m_exclusive; }
+
+private:
+    std::vector<std::type_index> m_reads, m_writes;
+    bool m_exclusive = false;
+};
+
+template <typename T, typename = void>
+struct HasSystemAccess : std::false_type {};
+
+template <typename T>
+struct HasSystemAccess<T, std::void_t<decltype(T::access())>> : std::true_type {};
+
+/// @returns the system's declared access, systems that don't declare one
+///          are exclusive
+template <typename T>
+SystemAccess access_of() {
+    if constexpr (HasSystemAccess<T>::value) {
+        return T::access();
+    } else {
+        return SystemAccess::exclusive();
+    }
+}
+
 class TimeAware {
 public:
     void set_elapsed_time(double et) { m_et = et; }
@@ -39,6 +112,20 @@ private:
     double m_et = 0.;
 };
 
+class SystemWorkerPool;
+
+/// systems which split their own updates across threads
+class WorkerPoolAware {
+public:
+    void assign_worker_pool(SystemWorkerPool & pool) { m_pool = &pool; }
+protected:
+    WorkerPoolAware() {}
+    /// @returns nullptr if there are no other threads to use
+    SystemWorkerPool * worker_pool() const noexcept { return m_pool; }
+private:
+    SystemWorkerPool * m_pool = nullptr;
+};
+
 class LineMap;
 class LineMapLayer;
 
@@ -82,6 +169,10 @@ public:
         on_graphics_assigned();
     }
 
+    /// with fixed steps, how far past the last step the frame is drawn at,
+    /// in [0 1], zero draws things where they were a step earlier
+    void set_step_interpolation(double alpha) { m_step_alpha = alpha; }
+
 protected:
     GraphicsBase & graphics() {
         if (!m_graphics) {
@@ -91,6 +182,48 @@ protected:
     }
     virtual void on_graphics_assigned() {}
 
+    double step_interpolation() const noexcept { return m_step_alpha; }
+
 private:
     GraphicsBase * m_graphics = nullptr;
+    double m_step_alpha = 1.;
+};
+
+/// For systems which draw. Their updates (once per step) only keep track of
+/// what's needed to draw, posting graphics is done once per rendered frame,
+/// after however many steps the frame took (none included).
+class FrameDrawer {
+public:
+    virtual ~FrameDrawer() {}
+
+    /// called once graphics have been reset for the new frame
+    virtual void draw_frame() = 0;
+};
+
+/// Where each entity was in the last two steps, so that draws may be placed
+/// between them.
+class StepPositions final {
+public:
+    /// called at the start of each step
+    void on_new_step() {
+        m_prior.swap(m_current);
+        m_current.clear();
+    }
+
+    /// records this step's position for e
+    void record(const Entity & e, VectorD r) { m_current[e] = r; }
+
+    /// @returns where to draw something at r belonging to e, moved back
+    ///          toward where e was a step earlier (all the way at zero
+    ///          alpha), r if e wasn't recorded in both steps
+    VectorD interpolate(const Entity & e, VectorD r, double alpha) const {
+        auto itr = m_prior.find(e);
+        auto jtr = m_current.find(e);
+        if (itr == m_prior.end() || jtr == m_current.end()) return r;
+        return r + (itr->second - jtr->second)*(1. - alpha);
+    }
+
+private:
+    using PositionMap = std::unordered_map<Entity, VectorD, EntityHasher>;
+    PositionMap m_prior, m_current;
 };
@@ -193,8 +193,8 @@
 
 // ----------------------------------------------------------------------------
 
-/* private */ void SnakeSystem::update(const ContainerView & view) {
-    for (auto & e : view) {
+/* private */ void SnakeSystem::update(const ContainerView &) {
+    for (auto e : *m_snakes) {
         if (!e.has<Snake>()) continue;
         update(e);
     }
@@ -216,6 +216,7 @@
         reset<ColorCircle>().color = instance_color(snake);
     new_ball.add<PhysicsComponent>().
         reset_state<FreeBody>().location = snake.location;
+    EntityChangeListener::notify(new_ball);
 
     snake.elapsed_time = 0.;
     --snake.instances_remaining;
@@ -320,7 +321,9 @@ void ItemCollisionSystem::check_item_collection(Entity collector, Entity item) {
     m_subjects.clear();
     for (auto e : view) {
         if (is_subject(e)) {
+            bool is_new_subject = !e.has<TriggerBoxSubjectHistory>();
             m_subjects.emplace_back(e, e.ensure<TriggerBoxSubjectHistory>());
+            if (is_new_subject) EntityChangeListener::notify(e);
             continue;
         }
 
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "SystemsDefs.hpp"
+#include "EntityQuery.hpp"
 
 class PlayerControlSystem final : public System, public TimeAware {
     static constexpr const double k_acceleration        = 125.;
@@ -43,9 +44,18 @@ class PlayerControlSystem final : public System, public TimeAware {
     static void handle_tracker_jumping(PhysicsComponent &, const LineTracker &, PlayerControl &);
 };
 
-class LifetimeSystem final : public System, public TimeAware {
-    void update(const ContainerView & view) {
-        for (auto & e : view) {
+class LifetimeSystem final : public System, public TimeAware, public QueryAware {
+public:
+    static SystemAccess access() {
+        return SystemAccess().writes<Lifetime, DeletionRequestsResource>();
+    }
+
+    void setup_queries(EntityQueryIndex & index) override
+        { m_lifetimes = &index.query_for<Lifetime>(); }
+
+private:
+    void update(const ContainerView &) {
+        for (auto e : *m_lifetimes) {
             if (!e.has<Lifetime>()) continue;
             auto & lt = e.get<Lifetime>().value;
             lt -= elapsed_time();
@@ -54,15 +64,37 @@ class LifetimeSystem final : public System, public TimeAware {
             }
         }
     }
+
+    const EntityQuery * m_lifetimes = nullptr;
 };
 
-class SnakeSystem final : public System, public TimeAware {
+class SnakeSystem final : public System, public TimeAware, public QueryAware {
+public:
+    static SystemAccess access() {
+        return SystemAccess()
+            .writes<Snake, DeletionRequestsResource, EntityStructureResource>();
+    }
+
+    void setup_queries(EntityQueryIndex & index) override
+        { m_snakes = &index.query_for<Snake>(); }
+
+private:
     void update(const ContainerView & view);
     void update(Entity & e) const;
     static sf::Color instance_color(const Snake & snake);
+
+    const EntityQuery * m_snakes = nullptr;
 };
 
 class ExtremePositionsControlSystem final : public System, public MapAware {
+public:
+    static SystemAccess access() {
+        return SystemAccess()
+            .reads <ReturnPoint, Platform>()
+            .writes<PhysicsComponent, DeletionRequestsResource>();
+    }
+
+private:
     void update(const ContainerView & cont) override
         { for (auto & e : cont) { update(e); } }
 
@@ -70,6 +102,14 @@ class ExtremePositionsControlSystem final : public System, public MapAware {
 };
 
 class GravityUpdateSystem final : public System, public TimeAware {
+public:
+    static SystemAccess access() {
+        return SystemAccess()
+            .reads <Collector, Item, Platform>()
+            .writes<PhysicsComponent>();
+    }
+
+private:
     void update(const ContainerView & cont) override
         { for (auto e : cont) { update(e); } }
 
@@ -218,9 +258,18 @@ class TriggerBoxOccupancySystem final : public System, public TimeAware {
     std::vector<Entity> m_targets ;
 };
 
-class WaypointPositionSystem final : public System, public TimeAware {
-    void update(const ContainerView & view) override {
-        for (auto e : view) {
+class WaypointPositionSystem final : public System, public TimeAware, public QueryAware {
+public:
+    static SystemAccess access() {
+        return SystemAccess().reads<Waypoints>().writes<InterpolativePosition>();
+    }
+
+    void setup_queries(EntityQueryIndex & index) override
+        { m_movers = &index.query_for<Waypoints, InterpolativePosition>(); }
+
+private:
+    void update(const ContainerView &) override {
+        for (auto e : *m_movers) {
             if (should_skip(e)) continue;
             update(e.get<Waypoints>().points(), e.get<InterpolativePosition>(), elapsed_time());
         }
@@ -247,13 +296,26 @@ class WaypointPositionSystem final : public System, public TimeAware {
         if (!e.has<Waypoints>() || !e.has<InterpolativePosition>()) return true;
         return false;
     }
+
+    const EntityQuery * m_movers = nullptr;
 };
 
-class PlatformMovementSystem final : public System {
+class PlatformMovementSystem final : public System, public QueryAware {
+public:
+    static SystemAccess access() {
+        return SystemAccess()
+            .reads <Waypoints, InterpolativePosition, PhysicsComponent>()
+            .writes<Platform>();
+    }
+
+    void setup_queries(EntityQueryIndex & index) override
+        { m_platforms = &index.query_for<Platform>(); }
+
+private:
     // waypoints position -> platform positions
     // physics component
-    void update(const ContainerView & view) {
-        for (auto e : view) {
+    void update(const ContainerView &) {
+        for (auto e : *m_platforms) {
             if (!e.has<Platform>()) continue;
             update(e);
         }
@@ -271,6 +333,8 @@ class PlatformMovementSystem final : public System {
         }
         e.get<Platform>().set_offset(offset);
     }
+
+    const EntityQuery * m_platforms = nullptr;
 };
 
 class HoldItemSystem final : public System {
@@ -288,12 +352,27 @@ class HoldItemSystem final : public System {
 
 };
 
-class PlatformBreakingSystem final : public System {
-    void update(const ContainerView & view) override {
+class PlatformBreakingSystem final : public System, public QueryAware {
+public:
+    static SystemAccess access() {
+        return SystemAccess()
+            .reads <Platform, Item, PhysicsComponent>()
+            .writes<DeletionRequestsResource>();
+    }
+
+    void setup_queries(EntityQueryIndex & index) override {
+        m_platform_query = &index.query_for<Platform>();
+        m_item_query     = &index.query_for<Item, PhysicsComponent>();
+    }
+
+private:
+    void update(const ContainerView &) override {
         m_platforms.clear();
         m_items.clear();
-        for (auto e : view) {
+        for (auto e : *m_platform_query) {
             if (e.has<Platform>()) m_platforms.push_back(e);
+        }
+        for (auto e : *m_item_query) {
             if (e.has<Item>() && e.has<PhysicsComponent>()) {
                 if (e.get<Item>().hold_type == Item::platform_breaker)
                     m_items.push_back(e);
@@ -339,11 +418,24 @@ class PlatformBreakingSystem final : public System {
 
     std::vector<Entity> m_platforms;
     std::vector<Entity> m_items    ;
+    const EntityQuery * m_platform_query = nullptr;
+    const EntityQuery * m_item_query     = nullptr;
 };
 
-class CratePositionUpdateSystem final : public System {
-    void update(const ContainerView & view) override {
-        for (auto e : view) {
+class CratePositionUpdateSystem final : public System, public QueryAware {
+public:
+    static SystemAccess access() {
+        return SystemAccess()
+            .reads <Item, PhysicsComponent>()
+            .writes<Platform, EntityStructureResource>();
+    }
+
+    void setup_queries(EntityQueryIndex & index) override
+        { m_items = &index.query_for<Item, PhysicsComponent>(); }
+
+private:
+    void update(const ContainerView &) override {
+        for (auto e : *m_items) {
             if (auto * itm = e.ptr<Item>()) {
                 if (itm->hold_type == Item::crate)
                     { update(e); }
@@ -354,18 +446,30 @@ class CratePositionUpdateSystem final : public System {
     void update(Entity e) {
         auto & pcomp = e.get<PhysicsComponent>();
         if (pcomp.state_is_type<HeldState>()) {
-            if (e.has<Platform>()) e.remove<Platform>();
+            if (!e.has<Platform>()) return;
+            e.remove<Platform>();
         } else if (!e.has<Platform>()) {
             Surface surf;
             surf.a.x = -30.;
             surf.b.x =  30.;
             surf.a.y = surf.b.y = -60.;
             e.add<Platform>().set_surfaces(std::vector<Surface>({ surf }));
+        } else {
+            return;
         }
+        EntityChangeListener::notify(e);
     }
+
+    const EntityQuery * m_items = nullptr;
 };
 
 class FallOffSystem final : public System {
+public:
+    static SystemAccess access() {
+        return SystemAccess().reads<PhysicsComponent, Platform, DeletionRequestsResource>();
+    }
+
+private:
     void update(const ContainerView & view) override {
         for (auto e : view) {
             auto * tracker = get_tracker(e);
@@ -382,9 +486,18 @@ class FallOffSystem final : public System {
     }
 };
 
-class RecallBoundsSystem final : public System, public TimeAware {
-    void update(const ContainerView & view) override {
-        for (auto e : view) {
+class RecallBoundsSystem final : public System, public TimeAware, public QueryAware {
+public:
+    static SystemAccess access() {
+        return SystemAccess().reads<Platform>().writes<ReturnPoint, PhysicsComponent>();
+    }
+
+    void setup_queries(EntityQueryIndex & index) override
+        { m_returners = &index.query_for<ReturnPoint, PhysicsComponent>(); }
+
+private:
+    void update(const ContainerView &) override {
+        for (auto e : *m_returners) {
            update(e);
         }
     }
@@ -402,12 +515,16 @@ class RecallBoundsSystem final : public System, public TimeAware {
         if ((rt_point.recall_time -= elapsed_time()) <= 0.) {
             rt_point.recall_time = 0.;
             auto & pcomp = e.get<PhysicsComponent>();
+            // may detach a tracker, its departing script call waits on the
+            // scheduler if other systems are updating alongside this one
             auto & fb = pcomp.reset_state<FreeBody>();
             fb.velocity = VectorD();
             fb.location = center_of(Entity(rt_point.ref).get<PhysicsComponent>().state_as<Rect>());
             // post disappear and reappear effects
         }
     }
+
+    const EntityQuery * m_returners = nullptr;
 };
 
 class ScriptUpdateSystem final : public System, public TimeAware {